@@ -170,6 +170,16 @@ public class PathAction implements Serializable {
         return op == 'U';
     }
 
+    /**
+     * Checks whether this path action is a rename. The path is the
+     * destination and the source is available as the link target.
+     * 
+     * @return true, if rename
+     */
+    public boolean isRename() {
+        return op == 'M';
+    }
+
     /**
      * Checks whether this path action is a symbolic link operation.
      * 
@@ -252,6 +252,22 @@
 /// A test for CSV_NULL_FIELD.
 #define	CSV_FIELD_IS_NULL(s)		(!*(s) || !strcmp(s, CSV_NULL_FIELD))
 
+/// Binary PA records (see the Audit.Format property) begin with this
+/// byte, which cannot start a CSV line. It's followed by a version
+/// byte and the length of the entire record as a 32-bit unsigned
+/// integer in little-endian order.
+#define BIN_REC_MARK			'\001'
+/// The binary record version written by this code.
+#define BIN_REC_VERSION			1
+/// The size of the binary record header.
+#define BIN_REC_HDR_SIZE		6
+/// The longest binary record accepted. A legal record holds no more
+/// than three paths and a handful of short fields, so anything longer
+/// is corrupt and not worth buffering.
+#define BIN_REC_MAX_SIZE		(64 * 1024)
+/// The most space an integer can take up in a binary record.
+#define BIN_INT_MAX_SIZE		10
+
 /// The conventional radix (base) for stringifying integral values.
 /// We prefer a high-numbered base for compactness.
 #define CSV_RADIX			36
@@ -273,6 +289,7 @@ typedef enum {
     OP_LINK = 'L',		/// File modify operation
     OP_SYMLINK = 'S',		/// File modify operation
     OP_UNLINK = 'U',		/// File modify operation
+    OP_RENAME = 'M',		/// File move (rename) operation
     OP_MKDIR = 'D',		/// Directory create operation
 } op_e;
 
@@ -341,6 +358,24 @@ class ## _get_ ## attr(class ## _o obj)					\
     return obj->class ## _ ## attr ? obj->class ## _ ## attr : dflt;	\
 }
 
+/// Generates the definition of a setter for string values in a class
+/// whose objects may live in an arena (see arena.c). Such objects keep
+/// their strings in the same arena, copied there by the named function.
+#define GEN_SETTER_DEFN_ARENA_STR(class, attr, type, copy)		\
+void									\
+class ## _set_ ## attr(class ## _o obj, type val)			\
+{									\
+    if (!obj->class ## _arena) {					\
+	putil_free(obj->class ## _ ## attr);				\
+    }									\
+    if ((val) && !CSV_FIELD_IS_NULL(val)) {				\
+	obj->class ## _ ## attr = obj->class ## _arena ?		\
+	    copy(obj->class ## _arena, val) : putil_strdup(val);	\
+    } else {								\
+	obj->class ## _ ## attr = NULL;					\
+    }									\
+}
+
 /// Generates the definition of a setter/getter pair.
 #define GEN_SETTER_GETTER_DEFN(class, attr, type)			\
 GEN_SETTER_DEFN(class, attr, type)					\
@@ -351,6 +386,12 @@ GEN_GETTER_DEFN(class, attr, type)
 GEN_SETTER_DEFN_STR(class, attr, type)					\
 GEN_GETTER_DEFN_STR(class, attr, type, dflt)
 
+/// Generates the definition of a setter/getter pair for string values
+/// in a class whose objects may live in an arena.
+#define GEN_SETTER_GETTER_DEFN_ARENA_STR(class, attr, type, dflt, copy)	\
+GEN_SETTER_DEFN_ARENA_STR(class, attr, type, copy)			\
+GEN_GETTER_DEFN_STR(class, attr, type, dflt)
+
 /// Generates the definition of a delegate getter.
 #define GEN_DELEGATE_GETTER_DEFN(class, dclass, attr, type)		\
 type									\
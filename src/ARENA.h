@@ -0,0 +1,37 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+/// @file
+/// @brief Declarations for arena.c
+
+/// @cond ARENA This is an opaque typedef.
+typedef struct arena_s *arena_o;
+
+/// @endcond ARENA
+
+extern arena_o arena_new(void);
+extern void *arena_alloc(arena_o, size_t);
+extern void arena_free(arena_o, void *);
+extern CS arena_strdup(arena_o, CCS);
+extern CCS arena_intern(arena_o, CCS);
+extern void arena_reset(arena_o);
+extern void arena_destroy(arena_o);
+
+#endif				/*ARENA_H */
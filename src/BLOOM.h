@@ -0,0 +1,33 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+/// @file
+/// @brief Declarations for bloom.c
+
+// Monitor side.
+extern CCS bloom_create(unsigned long);
+extern void bloom_add(const void *, size_t);
+extern void bloom_destroy(void);
+
+// Auditor side.
+extern int bloom_attach(CCS);
+extern int bloom_may_contain(const void *, size_t);
+
+#endif				/*BLOOM_H */
@@ -41,6 +41,8 @@ extern ca_o ca_new(void);
 extern ca_o ca_newFromCSVString(CCS);
 extern void ca_merge(ca_o, ca_o);
 extern void ca_record_pa(ca_o, pa_o);
+extern arena_o ca_get_arena(ca_o);
+extern int ca_has_raw_read(ca_o, CCS);
 extern int ca_has_leader(ca_o);
 extern int ca_has_pathcode(ca_o);
 extern int ca_is_top(ca_o);
@@ -48,7 +50,11 @@ extern int ca_is_uploadable(ca_o);
 extern int ca_get_pa_count(ca_o);
 extern int ca_foreach_raw_pa(ca_o, int (*)(pa_o, void *), void *);
 extern int ca_foreach_cooked_pa(ca_o, int (*)(pa_o, void *), void *);
-extern void ca_write(ca_o, int);
+extern void ca_write(ca_o, int, int);
+extern void ca_write_to(ca_o, int,
+			int (*)(const void *, size_t, void *), void *);
+extern void ca_write_some_to(ca_o, int, pa_o (*)(pa_o),
+			int (*)(const void *, size_t, void *), void *);
 extern void ca_coalesce(ca_o);
 extern void ca_start_group(ca_o, int);
 extern void ca_aggregate(ca_o, ca_o);
@@ -57,6 +63,8 @@ extern void ca_publish(ca_o, void (*)(ca_o));
 extern void ca_derive_pathcode(ca_o);
 extern CCS ca_format_header(ca_o);
 extern CCS ca_toCSVString(ca_o);
+extern void ca_set_dcoder(void (*)(pa_o *, int));
+extern ca_o ca_next_processed(void);
 extern int ca_o_hash_cmp(const void *, const void *);
 extern hash_val_t ca_o_hash_func(const void *);
 extern void ca_clear_pa(ca_o);
@@ -160,6 +160,7 @@ extern int http_namestate(CCS, CCS, CS const *);
 extern int http_ping(void);
 extern int http_heartbeat(int64_t);
 extern int http_restart(void);
+extern void http_fork_child(void);
 extern void http_fini(void);
 
 #endif				/*HTTP_H */
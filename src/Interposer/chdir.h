@@ -28,6 +28,10 @@ extern "C" {
 // in comments elsewhere. If you want to do something with it you need
 // only provide a suitable chdir_wrapper() function.
 
+// The fchdir call is not, but anyone keeping track of the cwd
+// must hear about it too.
+WRAP(int, fchdir, (int fildes), fildes)
+
 #ifdef  __cplusplus
 }
 #endif
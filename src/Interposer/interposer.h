@@ -204,6 +204,30 @@ n_type n_call (int fildes, const char *path, int oflag, ...) {		\
     }									\
 }
 
+// Special case due to variadic arg list. No system call takes more
+// than six arguments and each fits in a long, so six longs are always
+// passed along. Any beyond those actually supplied are garbage but are
+// ignored by the kernel.
+#define WRAP_SYSCALL(n_type, n_call)					\
+n_type n_call (long number, ...) {					\
+    va_list ap;								\
+    long a1, a2, a3, a4, a5, a6;					\
+    WRAP_PROLOG(n_type, n_call)						\
+    va_start(ap, number);						\
+    a1 = va_arg(ap, long);						\
+    a2 = va_arg(ap, long);						\
+    a3 = va_arg(ap, long);						\
+    a4 = va_arg(ap, long);						\
+    a5 = va_arg(ap, long);						\
+    a6 = va_arg(ap, long);						\
+    va_end(ap);								\
+    if (poseur && interposer_is_active) {				\
+	return poseur(#n_call, stooge, number, a1, a2, a3, a4, a5, a6);	\
+    } else {								\
+	return stooge(number, a1, a2, a3, a4, a5, a6);			\
+    }									\
+}
+
 #define WRAP_VOID(n_type, n_call)					\
 n_type n_call (void) {							\
     WRAP_PROLOG(n_type, n_call)						\
@@ -38,6 +38,12 @@ WRAP(int, linkat,   (int olddirfd, const char *oldpath, int newdirfd, const char
 WRAP(int, unlinkat, (int dirfd, const char *path, int flag), dirfd, path, flag)
 #endif	/*AT_FDCWD*/
 
+// Linux only, and declared by glibc only since 2.28. Before that
+// it could be had only via syscall(); see <Interposer/syscall.h>.
+#ifdef RENAME_NOREPLACE
+WRAP(int, renameat2, (int fromfd, const char *oldpath, int tofd, const char *newpath, unsigned int flags), fromfd, oldpath, tofd, newpath, flags)
+#endif	/*RENAME_NOREPLACE*/
+
 #ifdef  __cplusplus
 }
 #endif
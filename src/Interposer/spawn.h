@@ -0,0 +1,52 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _INTERPOSER_SPAWN_H
+#define	_INTERPOSER_SPAWN_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <Interposer/interposer.h>
+
+#include <spawn.h>
+
+// The posix_spawn() functions create a process and exec a program
+// in one call. Implementations are free to (and glibc does) avoid
+// copying the parent's address space, which is why modern build
+// drivers prefer them. The internal fork and exec they make are
+// not visible to us, so they must be wrapped in their own right.
+
+WRAP(int, posix_spawn,
+     (pid_t *pid, const char *path,
+      const posix_spawn_file_actions_t *file_actions,
+      const posix_spawnattr_t *attrp,
+      char *const argv[], char *const envp[]),
+     pid, path, file_actions, attrp, argv, envp)
+WRAP(int, posix_spawnp,
+     (pid_t *pid, const char *file,
+      const posix_spawn_file_actions_t *file_actions,
+      const posix_spawnattr_t *attrp,
+      char *const argv[], char *const envp[]),
+     pid, file, file_actions, attrp, argv, envp)
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif	/* _INTERPOSER_SPAWN_H */
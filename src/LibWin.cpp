@@ -53,6 +53,7 @@
 
 // Must be declared before dragging in the code below.
 static int _ignore_path(const char *);
+static void _ignore_path_init(void);
 static void _thread_mutex_lock(void);
 static void _thread_mutex_unlock(void);
 
@@ -234,6 +235,15 @@ _ignore_path(const char *path)
     return rc;
 }
 
+// The Unix auditor defers compiling the ignore RE until first use
+// and precompiles the rest of its list. There's little enough to
+// check on Windows that the RE is simply compiled here.
+static void
+_ignore_path_init(void)
+{
+    IgnorePathRE = re_init_prop__(P_AUDIT_IGNORE_PATH_RE);
+}
+
 static inline void
 _thread_mutex_lock(void)
 {
@@ -246,6 +256,37 @@ _thread_mutex_unlock(void)
     LeaveCriticalSection(&StaticDataInitCriticalSection);
 }
 
+// PAs are recorded directly into the CA under the critical section
+// rather than staged per thread as on Unix.
+static int
+_thread_buffering(void)
+{
+    return 0;
+}
+
+static pn_cache_o
+_thread_pn_cache(void)
+{
+    return NULL;
+}
+
+static unsigned long
+_thread_count_pa(void)
+{
+    return ++PAsSinceFlush;
+}
+
+static void
+_thread_buffer_pa(pa_o pa)
+{
+    UNUSED(pa);
+}
+
+static void
+_thread_buffers_merge(void)
+{
+}
+
 static void
 _RecordFile(LPCSTR lpCall, LPCSTR lpFileName,
 	    DWORD dwDesiredAccess, DWORD dwCreationDisposition)
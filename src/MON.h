@@ -21,6 +21,9 @@
 /// @file
 /// @brief Declarations for mon.c
 
+#include "CA.h"
+#include "SHOP.h"
+
 /// These are bits which may be set in the return code from mon_record().
 
 /// Line parsed successfully, hit me again.
@@ -41,13 +44,20 @@
 #define MON_ERR				(1<<7)
 /// The top-level monitored process was unable to start.
 #define MON_CANTRUN			(1<<8)
+/// Shopping for this SOA was left to the caller (see mon_shop_verdict).
+#define MON_SHOP			(1<<9)
 
 extern void mon_init(void);
+extern void mon_start_threads(void);
 extern void mon_get_roadmap(void);
 extern int mon_begin_session(void);
 extern void mon_ptx_start(void);
 extern void mon_dump(void);
-extern unsigned mon_record(CS, int *, unsigned long *, CCS *);
+extern unsigned mon_shop_verdict(ca_o, shop_e, CCS *);
+extern unsigned mon_record(CS, int *, unsigned long *, CCS *, ca_o *);
+extern unsigned mon_record_binary(CCS, size_t);
+extern int mon_publish_fd(void);
+extern void mon_publish_reap(void);
 extern void mon_ptx_end(int, CCS);
 extern void mon_fini(void);
 
@@ -31,8 +31,10 @@ typedef struct path_action_s *pa_o;
 extern int pa_cmp_by_pathname(const void *, const void *);
 extern int pa_cmp(const void *, const void *);
 extern pa_o pa_new(void);
+extern pa_o pa_newInArena(arena_o);
 extern pa_o pa_newFromCSVString(CCS);
 extern int pa_has_dcode(pa_o);
+extern int pa_has_stats(pa_o);
 extern int pa_is_member(pa_o);
 extern int pa_is_dir(pa_o);
 extern int pa_is_special(pa_o);
@@ -42,11 +44,15 @@ extern int pa_is_write(pa_o);
 extern int pa_is_link(pa_o);
 extern int pa_is_symlink(pa_o);
 extern int pa_is_unlink(pa_o);
+extern int pa_is_rename(pa_o);
 extern int pa_set_moment_str(pa_o, CCS);
 extern int pa_set_timestamp_str(pa_o, CCS);
 extern int pa_has_timestamp(pa_o);
 extern void pa_set_size_str(pa_o, CCS);
 extern CCS pa_toCSVString(pa_o);
+extern CCS pa_toBinary(pa_o, size_t *);
+extern size_t pa_binary_reclen(CCS, size_t);
+extern pa_o pa_newFromBinary(CCS, size_t);
 extern CCS pa_tostring(pa_o);
 extern int pa_stat(pa_o, int);
 extern CCS pa_diff(pa_o, pa_o);
@@ -21,12 +21,21 @@
 /// @file
 /// @brief Declarations for pn.c
 
+#include "ARENA.h"
+
 /// @cond PN This is an opaque typedef.
 typedef struct path_name_s *pn_o;
+typedef struct pn_cache_s *pn_cache_o;
 
 /// @endcond PN
 
+extern pn_cache_o pn_cache_new(void);
+extern void pn_cache_init(void);
+extern void pn_cache_cwd_changed(void);
+extern void pn_cache_destroy(pn_cache_o);
 extern pn_o pn_new(CCS, int);
+extern pn_o pn_newInArena(arena_o, CCS, int);
+extern pn_o pn_newInCache(arena_o, pn_cache_o, CCS);
 extern int pn_is_member(pn_o);
 extern int pn_exists(pn_o);
 extern CCS pn_get_abs(pn_o);
@@ -47,12 +47,17 @@ typedef enum {
     P_AGGREGATION_STYLE,
     P_AGGRESSIVE_SERVER,
     P_ALLOWED_WRITE_PATH_RE,
+    P_AUDIT_FLUSH_COUNT,
+    P_AUDIT_FLUSH_SECS,
+    P_AUDIT_FORMAT,
     P_AUDIT_IGNORE_PATH_RE,
     P_AUDIT_IGNORE_PROG_RE,
     P_AUDIT_ONLY,
     P_BASE_DIR,
     P_DCODE_ALL,
     P_DCODE_CACHE_SECS,
+    P_DCODE_CLOSE,
+    P_DCODE_WORKERS,
     P_DEPTH,
     P_DOC_PAGER,
     P_DOWNLOAD_ONLY,
@@ -71,6 +76,7 @@ typedef enum {
     P_MMAP_LARGER_THAN,
     P_MONITOR_LISTENERS,
     P_MONITOR_HOST,
+    P_MONITOR_PERSISTENT,
     P_MONITOR_PLATFORM,
     P_MONITOR_PORT,
     P_MONITOR_TIMEOUT_SECS,
@@ -85,8 +91,12 @@ typedef enum {
     P_PROJECT_BASE_GLOB,
     P_PROJECT_NAME,
     P_PTX_STRATEGY,
+    P_PUBLISH_WORKERS,
     P_REUSE_ROADMAP,
+    P_RING_NAME,
+    P_RING_SLOTS,
     P_ROADMAPFILE,
+    P_ROADMAP_FILTER,
     P_SERVER,
     P_SERVER_CONTEXT,
     P_SERVER_LOG_LEVEL,
@@ -94,6 +104,8 @@ typedef enum {
     P_SESSION_TIMEOUT_SECS,
     P_SHOP_IGNORE_PATH_RE,
     P_SHOP_TIME_PRECISION,
+    P_SHOP_WORKERS,
+    P_STAT_URING,
     P_STRICT,
     P_STRICT_AUDIT,
     P_STRICT_DOWNLOAD,
@@ -126,6 +138,7 @@ extern const char *prop_get_str(prop_e);
 extern unsigned long prop_get_ulong(prop_e);
 extern long prop_get_long(prop_e);
 extern void prop_unset(prop_e, int);
+extern unsigned long prop_get_generation(void);
 extern void prop_load(CCS, CCS, int);
 extern prop_e prop_from_name(CCS);
 extern CCS prop_value_from_name(CCS);
@@ -30,9 +30,11 @@ typedef struct path_state_s *ps_o;
 /// @endcond PS
 
 extern ps_o ps_new(void);
+extern ps_o ps_newInArena(arena_o);
 extern ps_o ps_newFromPath(CCS);
 extern ps_o ps_newFromCSVString(CCS);
 extern int ps_has_dcode(ps_o);
+extern int ps_has_stats(ps_o);
 extern int ps_is_member(ps_o);
 extern int ps_is_file(ps_o);
 extern int ps_is_dir(ps_o);
@@ -44,9 +46,13 @@ extern int ps_exists(ps_o);
 extern void ps_dcode_cache_init(void);
 extern void ps_dcode_cache_fini(void);
 extern int ps_stat(ps_o, int);
+extern int ps_fstat(ps_o, int);
+extern int ps_stat_batch(ps_o *, int);
 extern ps_o ps_copy(ps_o);
 extern CCS ps_diff(ps_o, ps_o);
 extern CCS ps_toCSVString(ps_o);
+extern size_t ps_toBinary(ps_o, CS);
+extern ps_o ps_newFromBinary(CCS, CCS);
 extern int ps_format_user(ps_o, int, int, CS, int);
 extern int ps_set_moment_str(ps_o, CCS);
 extern void ps_set_size_str(ps_o, CCS);
@@ -356,6 +356,11 @@ extern "C" {
 
 PUTIL_API CCS putil_builton(void);
 PUTIL_API void putil_strict_error(int);
+#if !defined(PUTIL_DECLARE_FUNCTIONS_STATIC)
+// Defined in putil.c; see Putil_Msg_Stream.
+extern void putil_set_msg_stream(FILE *(*)(void));
+#endif
+PUTIL_API FILE *putil_get_msg_stream(void);
 PUTIL_API void putil_exit_(CCS, int, int);
 PUTIL_API void putil_error_(CCS, int, CCS, ...)
     __attribute__((__format__(__printf__,3,4)));
@@ -429,33 +434,38 @@ PUTIL_API int putil_uname(struct utsname *);
 // We try not to use stdio functions anywhere in this file, because
 // FILEs are limited to (256-3) in most Unix implementations. But of
 // course stderr will have been pre-allocated. If it's been closed
-// since then, not our problem.
+// since then, not our problem. Messages go to stderr unless the
+// program has said otherwise (see putil_set_msg_stream).
 #define _PUTIL_PRINTMSG_(keyword, f, l, fmt)				\
 {									\
     CS srcdbg;								\
+    FILE *strm;								\
     va_list ap;								\
     va_start(ap, fmt);							\
-    fprintf(stderr, "%s: %s: ", putil_prog(), #keyword);		\
+    strm = putil_get_msg_stream();					\
+    fprintf(strm, "%s: %s: ", putil_prog(), #keyword);			\
     if ((srcdbg = getenv("PUTIL_SRCDBG")) && atoi(srcdbg)) {		\
-	fprintf(stderr, "[at %s:%d] ", putil_basename(f), l);		\
+	fprintf(strm, "[at %s:%d] ", putil_basename(f), l);		\
     }									\
-    (void) vfprintf(stderr, fmt, ap);					\
+    (void) vfprintf(strm, fmt, ap);					\
     va_end(ap);								\
-    (void) fputc('\n', stderr);						\
+    (void) fputc('\n', strm);						\
 }
 
 #define _PUTIL_PRINTMSGW_(keyword, f, l, fmt)				\
 {									\
     CS srcdbg;								\
+    FILE *strm;								\
     va_list ap;								\
     va_start(ap, fmt);							\
-    fprintf(stderr, "%s: %s: ", putil_prog(), #keyword);		\
+    strm = putil_get_msg_stream();					\
+    fprintf(strm, "%s: %s: ", putil_prog(), #keyword);			\
     if ((srcdbg = getenv("PUTIL_SRCDBG")) && atoi(srcdbg)) {		\
-	fprintf(stderr, "[at %s:%d] ", putil_basename(f), l);		\
+	fprintf(strm, "[at %s:%d] ", putil_basename(f), l);		\
     }									\
-    (void) vfwprintf(stderr, fmt, ap);					\
+    (void) vfwprintf(strm, fmt, ap);					\
     va_end(ap);								\
-    (void) fputc('\n', stderr);						\
+    (void) fputc('\n', strm);						\
 }
 
 #if defined(_WIN32)
@@ -517,6 +527,11 @@ PUTIL_CLASS char putil_platform[] = "@(#) " PUTIL_BUILTON "/" PUTIL_COMPILER_;
 // that all errors become fatal; 2 means that warnings also become fatal.
 // -1 means to dump core on any error.
 static int Putil_Strict_Error = 0;
+
+// Likewise a function which says where messages should go, which
+// lets a multithreaded program collect each thread's messages and
+// emit them in an order of its own choosing.
+static FILE *(*Putil_Msg_Stream)(void);
 #endif
 
 PUTIL_CLASS CCS
@@ -531,6 +546,17 @@ putil_strict_error(int level)
     Putil_Strict_Error = level;
 }
 
+PUTIL_CLASS FILE *
+putil_get_msg_stream(void)
+{
+    FILE *strm;
+
+    if (Putil_Msg_Stream && (strm = Putil_Msg_Stream())) {
+	return strm;
+    }
+    return stderr;
+}
+
 #undef _PUTIL_STR
 #undef _PUTIL_XSTR
 
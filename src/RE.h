@@ -51,6 +51,23 @@ extern void *re_init__(CCS name, CCS restr);
 /// @return a compiled regular expression or NULL
 extern void *re_init_prop__(prop_e prop);
 
+/// Looks through the regular expression held in the specified
+/// property for top-level alternatives which amount to literal
+/// strings anchored at the start, such as "^/usr/include/" or
+/// "^/etc/passwd$", and passes each to the supplied function along
+/// with a flag which is true if it was anchored at the end too.
+/// This allows callers to test for such literals more cheaply
+/// than by running the regular expression.
+/// NOTE: the extraneous underscores are to prevent conflict with
+/// existing APIs.
+/// @param[in] prop     a property representing a regular expression
+/// @param[in] found    a function to be called with each literal
+/// @param[in] data     passed through to the function
+/// @return true if every alternative was a literal, meaning the
+/// literals are a complete substitute for the regular expression
+extern int re_literals_prop__(prop_e prop,
+			      void (*found)(CCS, int, void *), void *data);
+
 /// Matches the provided regular expression against the provided string.
 /// Returns the matched substring or NULL on no match. If either
 /// parameter is NULL, the result is NULL. 
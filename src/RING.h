@@ -0,0 +1,39 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+/// @file
+/// @brief Declarations for ring.c
+
+/// The signal an auditor uses to tell the monitor a ring needs draining.
+#define RING_SIGNAL			SIGUSR2
+
+// Monitor side.
+extern CCS ring_create(unsigned long);
+extern int ring_drain(void (*) (CS, size_t, void *), void *);
+extern void ring_reap(void);
+extern void ring_destroy(void);
+
+// Auditor side.
+extern int ring_open(void);
+extern int ring_write(int, const void *, size_t);
+extern int ring_close(int);
+extern void ring_abandon(int);
+
+#endif				/*RING_H */
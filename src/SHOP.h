@@ -33,11 +33,15 @@ typedef enum {
     SHOP_MUSTRUN,		///< Cmd found but must be run anyway
     SHOP_MUSTRUN_AGG,		///< As above, but cmd was aggregated
     SHOP_RECYCLED,		///< Cmd successfully matched and recycled
+    SHOP_CANDIDATE,		///< Cmd eligible, path states not yet compared
 } shop_e;
 
 extern void shop_init(void);
+extern CCS shop_filter_create(void);
+extern shop_e shop_precheck(ca_o);
 extern shop_e shop(ca_o, CCS, int);
 extern int shop_get_count(void);
+extern void shop_add_count(int);
 extern void shop_fini(void);
 
 #endif				/*SHOP_H */
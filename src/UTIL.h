@@ -70,6 +70,13 @@ extern void util_print_elapsed(time_t, long, CCS);
 extern void util_debug_from_here(void);
 extern CCS util_format_to_radix(unsigned, CS, size_t, uint64_t);
 extern char *util_strsep(char **, const char *);
+extern CS util_bin_put_uint(CS, uint64_t);
+extern CCS util_bin_get_uint(CCS, CCS, uint64_t *);
+extern CS util_bin_put_int(CS, int64_t);
+extern CCS util_bin_get_int(CCS, CCS, int64_t *);
+extern size_t util_bin_str_size(CCS);
+extern CS util_bin_put_str(CS, CCS);
+extern CCS util_bin_get_str(CCS, CCS, CCS *);
 extern CS util_encode_minimal(CCS);
 extern unsigned char *util_gzip_buffer(CCS name, unsigned const char *, uint64_t, uint64_t *);
 extern char *util_unescape(const char *, int, int *);
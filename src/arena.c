@@ -0,0 +1,207 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// @file
+/// @brief A simple bump allocator for objects which die together.
+/// The auditor records each file access as a handful of small objects
+/// (PA, PS, PN, strings) which all live until the next flush and are
+/// then discarded at once. Taking them from an arena means they cost
+/// a pointer increment apiece rather than a trip through the host
+/// program's malloc, which may be contended or instrumented, and
+/// they're released by resetting the arena rather than individually.
+///
+/// Strings which recur across objects, such as the ccode shared by
+/// every PA in a CA or the name of the system call, may be interned
+/// so that only one copy is kept per arena.
+///
+/// An arena is not thread safe; callers must serialize access.
+
+#include "AO.h"
+
+#include "ARENA.h"
+
+/// @cond static
+#define ARENA_CHUNK_SIZE		(64 * 1024)
+#define ARENA_INTERN_SLOTS		64
+#define ARENA_ALIGN			sizeof(void *)
+/// @endcond static
+
+/// One contiguous block of arena memory. Chunks are chained, most
+/// recent first, and allocations are carved from the head chunk.
+typedef struct arena_chunk_s {
+    struct arena_chunk_s *ac_next;	///< the previous chunk
+    size_t ac_size;			///< usable bytes in ac_data
+    size_t ac_used;			///< bytes handed out so far
+    union {
+	void *ac_align_p;		///< forces pointer alignment
+	int64_t ac_align_i;		///< forces 64-bit alignment
+	char ac_data[1];		///< the memory itself
+    } ac_u;
+} arena_chunk_s;
+
+/// Object structure for an arena.
+struct arena_s {
+    arena_chunk_s *ar_chunks;		///< chunk list, head is current
+    void *ar_last;			///< most recent allocation
+    CCS ar_intern[ARENA_INTERN_SLOTS];	///< interned strings by hash
+};
+
+// Internal service routine. Adds a chunk big enough for the request.
+static arena_chunk_s *
+_arena_grow(arena_o ar, size_t len)
+{
+    arena_chunk_s *ac;
+    size_t size;
+
+    size = len > ARENA_CHUNK_SIZE ? len : ARENA_CHUNK_SIZE;
+    ac = (arena_chunk_s *)putil_malloc(sizeof(*ac) + size);
+    ac->ac_size = size;
+    ac->ac_used = 0;
+    ac->ac_next = ar->ar_chunks;
+    ar->ar_chunks = ac;
+
+    return ac;
+}
+
+/// Constructor.
+/// @return a new, empty arena
+arena_o
+arena_new(void)
+{
+    arena_o ar;
+
+    ar = (arena_o)putil_calloc(1, sizeof(*ar));
+    (void)_arena_grow(ar, ARENA_CHUNK_SIZE);
+
+    return ar;
+}
+
+/// Allocates zero-filled memory from the arena. The memory is
+/// suitably aligned for any of the objects stored there.
+/// @param[in] ar       the object pointer
+/// @param[in] len      the number of bytes required
+/// @return a pointer to the memory, which is never NULL
+void *
+arena_alloc(arena_o ar, size_t len)
+{
+    arena_chunk_s *ac;
+    void *ptr;
+
+    len = (len + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ac = ar->ar_chunks;
+    if (ac->ac_size - ac->ac_used < len) {
+	ac = _arena_grow(ar, len);
+    }
+
+    ptr = ac->ac_u.ac_data + ac->ac_used;
+    ac->ac_used += len;
+    memset(ptr, 0, len);
+
+    ar->ar_last = ptr;
+    return ptr;
+}
+
+/// Gives memory back to the arena. This is only possible for the
+/// most recent allocation; anything else is simply abandoned until
+/// the arena is reset. This suffices for the common case of an
+/// object which is created and immediately found to be unwanted.
+/// @param[in] ar       the object pointer
+/// @param[in] ptr      memory previously returned by arena_alloc()
+void
+arena_free(arena_o ar, void *ptr)
+{
+    arena_chunk_s *ac;
+
+    if (ptr && ptr == ar->ar_last) {
+	ac = ar->ar_chunks;
+	ac->ac_used = (CS)ptr - ac->ac_u.ac_data;
+	ar->ar_last = NULL;
+    }
+}
+
+/// Copies a string into the arena.
+/// @param[in] ar       the object pointer
+/// @param[in] str      the string
+/// @return the arena copy of the string
+CS
+arena_strdup(arena_o ar, CCS str)
+{
+    size_t len;
+
+    len = strlen(str) + 1;
+    return (CS)memcpy(arena_alloc(ar, len), str, len);
+}
+
+/// Returns an arena copy of the string, sharing it with any previous
+/// caller who interned the same string since the last reset.
+/// @param[in] ar       the object pointer
+/// @param[in] str      the string
+/// @return the shared copy of the string
+CCS
+arena_intern(arena_o ar, CCS str)
+{
+    CCS *slot;
+
+    slot = ar->ar_intern + util_hash_fun_default(str) % ARENA_INTERN_SLOTS;
+    if (!*slot || strcmp(*slot, str)) {
+	*slot = arena_strdup(ar, str);
+	// Interned strings are shared so they may not be given back.
+	ar->ar_last = NULL;
+    }
+
+    return *slot;
+}
+
+/// Releases everything allocated from the arena at once. The first
+/// chunk is kept for reuse so a steady state needs no further mallocs.
+/// @param[in] ar       the object pointer
+void
+arena_reset(arena_o ar)
+{
+    arena_chunk_s *ac, *next;
+
+    for (ac = ar->ar_chunks; ac->ac_next; ac = next) {
+	next = ac->ac_next;
+	putil_free(ac);
+    }
+    ac->ac_used = 0;
+    ar->ar_chunks = ac;
+    ar->ar_last = NULL;
+    memset(ar->ar_intern, 0, sizeof(ar->ar_intern));
+}
+
+/// Finalizer - releases the arena and everything allocated from it.
+/// If object is a null pointer, no action occurs.
+/// @param[in] ar       the object pointer
+void
+arena_destroy(arena_o ar)
+{
+    arena_chunk_s *ac, *next;
+
+    if (!ar) {
+	return;
+    }
+
+    for (ac = ar->ar_chunks; ac; ac = next) {
+	next = ac->ac_next;
+	putil_free(ac);
+    }
+
+    memset(ar, 0, sizeof(*ar));
+    putil_free(ar);
+}
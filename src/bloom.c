@@ -0,0 +1,274 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// @file
+/// @brief A Bloom filter published by the monitor in shared memory.
+/// The monitor adds every key in the roadmap to the filter before
+/// starting the build; auditors map it read-only and consult it to
+/// learn, without asking the monitor, that a command line cannot be
+/// in the roadmap and thus cannot be recycled. A Bloom filter can
+/// give false positives but never false negatives, so a "no" is
+/// definitive while a "maybe" simply means doing what we'd have
+/// done without it.
+///
+/// The filter uses about 10 bits and 7 probes per key, for a false
+/// positive rate in the region of 1%. Probe positions are derived
+/// from two halves of a single 64-bit FNV-1a hash (Kirsch and
+/// Mitzenmacher's "double hashing" construction).
+
+#include "AO.h"
+
+#include "BLOOM.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif	/*!_WIN32*/
+
+/// @cond static
+#define BLOOM_MAGIC			0x414f4231UL
+#define BLOOM_BITS_PER_KEY		10
+#define BLOOM_PROBES			7
+/// @endcond static
+
+/// The layout of the shared region.
+typedef struct {
+    unsigned long bh_magic;		///< sanity check
+    unsigned long bh_bits;		///< number of bits in the filter
+    unsigned long bh_probes;		///< number of probes per key
+    unsigned long bh_keys;		///< number of keys added
+    unsigned char bh_map[1];		///< the bits themselves
+} bloom_hdr_s;
+
+#if !defined(_WIN32)
+
+// Both sides.
+static bloom_hdr_s *Bloom;
+static size_t BloomSize;
+
+// Monitor side only.
+static char BloomName[64];
+
+// Internal service routine. Hashes a key into the two values from
+// which all probe positions are generated.
+static void
+_bloom_hash(const void *key, size_t len, uint32_t *h1p, uint32_t *h2p)
+{
+    const unsigned char *p;
+    uint64_t hash;
+
+    hash = 0xcbf29ce484222325ULL;
+    for (p = (const unsigned char *)key; len; len--, p++) {
+	hash ^= *p;
+	hash *= 0x100000001b3ULL;
+    }
+
+    *h1p = (uint32_t)hash;
+    // An even step could cycle through only part of the bit space.
+    *h2p = (uint32_t)(hash >> 32) | 1;
+}
+
+/// Creates an empty filter sized for the given number of keys.
+/// Called by the monitor before starting the top-level command.
+/// @param[in] keys     the number of keys which will be added
+/// @return the name by which auditors may attach, or NULL on failure
+CCS
+bloom_create(unsigned long keys)
+{
+    unsigned long bits;
+    int fd;
+
+    snprintf(BloomName, sizeof(BloomName), "/%s.bloom.%lu",
+	     APPLICATION_NAME, (unsigned long)getpid());
+
+    // Round up to a whole number of 64-bit words.
+    bits = (keys ? keys : 1) * BLOOM_BITS_PER_KEY;
+    bits = (bits + 63) & ~63UL;
+    BloomSize = sizeof(bloom_hdr_s) + bits / CHAR_BIT;
+
+    (void)shm_unlink(BloomName);
+    if ((fd = shm_open(BloomName, O_RDWR | O_CREAT | O_EXCL, 0644)) == -1) {
+	putil_syserr(0, BloomName);
+	return NULL;
+    }
+
+    // The new region is zero-filled, i.e. an empty filter.
+    if (ftruncate(fd, BloomSize) == -1) {
+	putil_syserr(0, BloomName);
+	close(fd);
+	(void)shm_unlink(BloomName);
+	return NULL;
+    }
+
+    Bloom = (bloom_hdr_s *)mmap(NULL, BloomSize,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (Bloom == MAP_FAILED) {
+	putil_syserr(0, BloomName);
+	Bloom = NULL;
+	(void)shm_unlink(BloomName);
+	return NULL;
+    }
+
+    Bloom->bh_bits = bits;
+    Bloom->bh_probes = BLOOM_PROBES;
+
+    // Auditors won't attach until the build starts, by which time
+    // all keys have been added, so the magic number can go in now.
+    Bloom->bh_magic = BLOOM_MAGIC;
+
+    vb_printf(VB_MON, "BLOOM: %s (%lu keys, %lu bits)",
+	      BloomName, keys, bits);
+
+    return BloomName;
+}
+
+/// Adds a key to the filter. Called by the monitor.
+/// @param[in] key      the key
+/// @param[in] len      the length of the key in bytes
+void
+bloom_add(const void *key, size_t len)
+{
+    uint32_t h1, h2, i;
+    unsigned long bit;
+
+    if (!Bloom) {
+	return;
+    }
+
+    _bloom_hash(key, len, &h1, &h2);
+    for (i = 0; i < Bloom->bh_probes; i++) {
+	bit = (h1 + i * h2) % Bloom->bh_bits;
+	Bloom->bh_map[bit / CHAR_BIT] |= 1 << (bit % CHAR_BIT);
+    }
+    Bloom->bh_keys++;
+}
+
+/// Removes the filter.
+void
+bloom_destroy(void)
+{
+    if (Bloom) {
+	munmap((void *)Bloom, BloomSize);
+	Bloom = NULL;
+	(void)shm_unlink(BloomName);
+    }
+}
+
+/// Maps the named filter for reading. Called by the auditor.
+/// @param[in] name     the name of the filter region
+/// @return zero on success, nonzero if the filter cannot be used
+int
+bloom_attach(CCS name)
+{
+    int fd;
+    struct stat stbuf;
+    void *addr;
+
+    if (Bloom) {
+	return 0;
+    }
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1) {
+	return -1;
+    }
+
+    if (fstat(fd, &stbuf) == -1 ||
+	    (size_t)stbuf.st_size < sizeof(bloom_hdr_s)) {
+	close(fd);
+	return -1;
+    }
+
+    addr = mmap(NULL, stbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+	return -1;
+    }
+
+    if (((bloom_hdr_s *)addr)->bh_magic != BLOOM_MAGIC ||
+	    sizeof(bloom_hdr_s) + ((bloom_hdr_s *)addr)->bh_bits / CHAR_BIT >
+	    (size_t)stbuf.st_size) {
+	munmap(addr, stbuf.st_size);
+	return -1;
+    }
+
+    Bloom = (bloom_hdr_s *)addr;
+    BloomSize = stbuf.st_size;
+    return 0;
+}
+
+/// Checks whether a key may have been added to the filter.
+/// @param[in] key      the key
+/// @param[in] len      the length of the key in bytes
+/// @return zero if the key was definitely never added, else nonzero
+int
+bloom_may_contain(const void *key, size_t len)
+{
+    uint32_t h1, h2, i;
+    unsigned long bit;
+
+    if (!Bloom) {
+	return 1;
+    }
+
+    _bloom_hash(key, len, &h1, &h2);
+    for (i = 0; i < Bloom->bh_probes; i++) {
+	bit = (h1 + i * h2) % Bloom->bh_bits;
+	if (!(Bloom->bh_map[bit / CHAR_BIT] & (1 << (bit % CHAR_BIT)))) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+#else	/*_WIN32*/
+
+CCS
+bloom_create(unsigned long keys)
+{
+    UNUSED(keys);
+    return NULL;
+}
+
+void
+bloom_add(const void *key, size_t len)
+{
+    UNUSED(key);
+    UNUSED(len);
+}
+
+void
+bloom_destroy(void)
+{
+}
+
+int
+bloom_attach(CCS name)
+{
+    UNUSED(name);
+    return -1;
+}
+
+int
+bloom_may_contain(const void *key, size_t len)
+{
+    UNUSED(key);
+    UNUSED(len);
+    return 1;
+}
+
+#endif	/*_WIN32*/
@@ -27,6 +27,7 @@
 
 #include "AO.h"
 
+#include "ARENA.h"
 #include "CA.h"
 #include "CODE.h"
 #include "PA.h"
@@ -55,6 +56,18 @@ typedef struct {
     int fp_bufnext;		///< Index of the current buffer end
 } format_palist_s;
 
+/// Structure for passing the PAs which want dcodes out of a callback.
+typedef struct {
+    pa_o *sp_pas;		///< PAs to be dcoded
+    int sp_count;		///< Number of PAs in sp_pas
+    int sp_max;			///< Allocated size of sp_pas
+} sample_palist_s;
+
+/// @cond static
+static void (*CaDcoder) (pa_o *, int);
+static ca_o CaProcessed;
+/// @endcond static
+
 /// Structure to serve as a key into a hash table containing cmd_audits.
 // This carries a subset of CA attrs; specifically it holds
 // those attributes which are common between a CA and a PA, because
@@ -85,12 +98,16 @@ struct cmd_audit_s {
     CCS ca_line;		///< the command line
     dict_t *ca_raw_pa_dict;	///< ptr to path action set
     dict_t *ca_cooked_pa_dict;	///< ptr to path action set
+    dict_t *ca_rename_pa_dict;	///< renames whose sources await coalescing
+    hash_t *ca_raw_read_hash;	///< paths of raw reads, if tracked
+    arena_o ca_arena;		///< holds raw PAs, if in use
     hash_t *ca_group_hash;	///< ptr to aggregation hash
     ca_o ca_leader;		///< ptr to group leader
     int ca_strong;		///< boolean - is aggregation strong?
     int ca_started;		///< boolean - has this CA seen SOA?
     int ca_closed;		///< boolean - has this CA seen EOA?
     int ca_processed;		///< boolean - has this CA been fully handled?
+    ca_o ca_next_processed;	///< next in the queue of processed CAs
     CCS ca_subs;		///< aggregated subcmds
     CCS ca_freetext;		///< free-form text "comment"
 } cmd_audit_s;
@@ -205,9 +222,6 @@ ca_o_hash_cmp(const void *left, const void *right)
 	return ccmp;
     } else if (ck1->ck_depth != ck2->ck_depth) {
 	return ck1->ck_depth - ck2->ck_depth;
-    } else if (ck1->ck_cmdid == 0 || ck2->ck_cmdid == 0) {
-	// In some cases we may need to drop the cmdid out of the comparison.
-	return 0;
     } else if (ck1->ck_cmdid != ck2->ck_cmdid) {
 	return ck1->ck_cmdid - ck2->ck_cmdid;
     } else {
@@ -226,27 +240,52 @@ ca_o_hash_func(const void *key)
 
     ck = (ck_o)key;
     ckhash = util_hash_fun_default(ck->ck_ccode);
+    // The same cmd run over and over (a compiler invoked by a build
+    // script, say) has the same ccode every time, so hashing on the
+    // ccode alone piles all its CAs into one chain and every lookup
+    // in the monitor becomes a walk of that chain. The cmdid is what
+    // tells them apart, so keys must always carry a real cmdid.
+    ckhash ^= (hash_val_t)ck->ck_cmdid;
     return ckhash;
 }
 
-/// Constructor for CmdAction class.
-/// @return a new, empty CmdAction object
-ca_o
-ca_new(void)
+// Internal service routine. Allocates a CA which either holds its
+// PAs raw until ca_coalesce() or coalesces them as they're recorded.
+static ca_o
+_ca_new(int raw)
 {
     ca_o ca;
 
     ca = (ca_o)putil_calloc(1, sizeof(*ca));
 
-    if (!(ca->ca_raw_pa_dict = dict_create(DICTCOUNT_T_MAX, pa_cmp))) {
-	putil_syserr(2, "dict_create()");
+    if (raw) {
+	ca->ca_raw_pa_dict = dict_create(DICTCOUNT_T_MAX, pa_cmp);
+	if (!ca->ca_raw_pa_dict) {
+	    putil_syserr(2, "dict_create()");
+	}
+    } else {
+	ca->ca_cooked_pa_dict =
+	    dict_create(DICTCOUNT_T_MAX, pa_cmp_by_pathname);
+	if (!ca->ca_cooked_pa_dict) {
+	    putil_syserr(2, "dict_create()");
+	}
     }
 
     return ca;
 }
 
+/// Constructor for CmdAction class.
+/// @return a new, empty CmdAction object
+ca_o
+ca_new(void)
+{
+    return _ca_new(1);
+}
+
 /// Constructor for CmdAction class.
 /// Any change to the CSV format requires an equivalent change here.
+/// CAs made this way are the monitor's, and they coalesce PAs as
+/// they're recorded rather than holding a raw set (see ca_record_pa()).
 /// @param[in] csv      a string in the canonical CSV format for CAs
 /// @return a new, complete CmdAction object
 ca_o
@@ -286,7 +325,7 @@ ca_newFromCSVString(CCS csv)
     }
     // *INDENT-ON*
 
-    ca = ca_new();
+    ca = _ca_new(0);
 
     ca_set_cmdid(ca, strtoul(cmdid, NULL, 10));
     ca_set_depth(ca, strtoul(depth, NULL, 10));
@@ -385,15 +424,16 @@ ca_foreach_raw_pa(ca_o ca, int (*process) (pa_o, void *), void *data)
     pa_o pa;
     int rc = 0, pret;
 
-    dict = ca->ca_raw_pa_dict;
-    for (dnp = dict_first(dict); dnp; dnp = dict_next(dict, dnp)) {
-	pa = (pa_o)dnode_getkey(dnp);
-	pret = process(pa, data);
-	if (pret < 0) {
-	    putil_int("error from ca_foreach_raw_pa()");
-	    return -1;
-	} else {
-	    rc += pret;
+    if ((dict = ca->ca_raw_pa_dict)) {
+	for (dnp = dict_first(dict); dnp; dnp = dict_next(dict, dnp)) {
+	    pa = (pa_o)dnode_getkey(dnp);
+	    pret = process(pa, data);
+	    if (pret < 0) {
+		putil_int("error from ca_foreach_raw_pa()");
+		return -1;
+	    } else {
+		rc += pret;
+	    }
 	}
     }
 
@@ -446,147 +486,374 @@ ca_foreach_cooked_pa(ca_o ca, int (*process) (pa_o, void *), void *data)
     return rc;
 }
 
+// Internal service routine. Callback for ca_write().
+static int
+_ca_write_fd(const void *buf, size_t len, void *data)
+{
+    if (write(*(int *)data, buf, len) == -1) {
+	putil_syserr(0, "write()");
+	return -1;
+    }
+
+    return 0;
+}
+
 /// Serializes the CmdAction and writes it to the specified file descriptor.
 /// On Windows this must send to a socket. On Unix it can use any
 /// kind of file descriptor.
 /// @param[in] ca       the object pointer
 /// @param[in] fd       file descriptor to which the serialized form is sent
+/// @param[in] binary   boolean - send PAs as binary records, not CSV
 void
-ca_write(ca_o ca, int fd)
+ca_write(ca_o ca, int fd, int binary)
+{
+    ca_write_to(ca, binary, _ca_write_fd, &fd);
+}
+
+/// Serializes the CmdAction, handing each record to the supplied
+/// function. The PAs are consumed in the process.
+/// @param[in] ca       the object pointer
+/// @param[in] binary   boolean - send PAs as binary records, not CSV
+/// @param[in] writer   a function which delivers a buffer somewhere
+/// @param[in] data     passed through to the writer
+void
+ca_write_to(ca_o ca, int binary,
+	    int (*writer) (const void *, size_t, void *), void *data)
+{
+    ca_write_some_to(ca, binary, NULL, writer, data);
+}
+
+/// Like ca_write_to() but a PA may be held back, in which case it
+/// stays in the CmdAction to be written another time. The hold
+/// function returns NULL to let a PA be written, or else the PA to
+/// keep in its place. That must be a copy if the original came from
+/// the CmdAction's arena, since the arena is reset.
+/// @param[in] ca       the object pointer
+/// @param[in] binary   boolean - send PAs as binary records, not CSV
+/// @param[in] hold     a function which decides what's held back, or NULL
+/// @param[in] writer   a function which delivers a buffer somewhere
+/// @param[in] data     passed through to the writer
+void
+ca_write_some_to(ca_o ca, int binary, pa_o (*hold) (pa_o),
+	    int (*writer) (const void *, size_t, void *), void *data)
 {
     dict_t *dict;
     dnode_t *dnp, *next;
-    pa_o pa;
+    pa_o pa, held;
+    pa_o *heldlist = NULL;
+    int heldcount = 0, i;
     CCS pabuf;
+    size_t len;
 
     dict = ca->ca_raw_pa_dict;
 
-    if (dict_count(dict) <= 0) {
+    if (!dict || dict_count(dict) <= 0) {
 	return;
     }
 
+    // The keys point into PAs which are about to be consumed.
+    if (ca->ca_raw_read_hash) {
+	hash_free_nodes(ca->ca_raw_read_hash);
+    }
+
     // In case buffered files were left open by sloppy audited programs.
     fflush(NULL);
 
+    // Unfortunately it's too early to dcode any written files
+    // since they may still be open. But we should get stats of
+    // non-member read ops since they may differ in the event
+    // of a distributed build. We must assume logical coherence
+    // for all write ops, member and non-member.
+    // In other words, read ops are allowed to be on physically
+    // separate files with the same path (e.g. /usr/include/stdio.h)
+    // but write ops to the same path are assumed to be to a shared file.
+    // This matters in the case of a distributed build.
+    // Reads are usually sampled via the descriptor at open
+    // time, which is both cheaper and immune to the file being
+    // replaced before we get here; this catches the others.
+    // They're gathered up and statted as a batch since there
+    // may be many of them (think compiler and headers).
+    {
+	ps_o *pslist;
+	int count;
+
+	pslist = (ps_o *)putil_malloc(dict_count(dict) * sizeof(*pslist));
+	for (count = 0, dnp = dict_first(dict); dnp;
+		dnp = dict_next(dict, dnp)) {
+	    pa = (pa_o)dnode_getkey(dnp);
+	    if (pa_is_read(pa) && !pa_is_member(pa) && !pa_has_stats(pa)) {
+		pslist[count++] = pa_get_ps(pa);
+	    }
+	}
+	(void)ps_stat_batch(pslist, count);
+	putil_free(pslist);
+    }
+
     for (dnp = dict_first(dict); dnp;) {
 	pa = (pa_o)dnode_getkey(dnp);
 
-	// Unfortunately it's too early to dcode any written files
-	// since they may still be open. But we should get stats of
-	// non-member read ops since they may differ in the event
-	// of a distributed build. We must assume logical coherence
-	// for all write ops, member and non-member.
-	// In other words, read ops are allowed to be on physically
-	// separate files with the same path (e.g. /usr/include/stdio.h)
-	// but write ops to the same path are assumed to be to a shared file.
-	// This matters in the case of a distributed build.
-	if (pa_is_read(pa) && !pa_is_member(pa)) {
-	    (void)pa_stat(pa, 0);
-	}
+	held = hold ? (*hold)(pa) : NULL;
 
-	if ((pabuf = pa_toCSVString(pa))) {
-	    if (write(fd, pabuf, strlen(pabuf)) == -1) {
-		putil_syserr(0, "write()");
+	if (held) {
+	    if (!heldlist) {
+		heldlist = (pa_o *)putil_malloc(dict_count(dict) *
+		    sizeof(*heldlist));
+	    }
+	    heldlist[heldcount++] = held;
+	} else {
+	    if (binary) {
+		pabuf = pa_toBinary(pa, &len);
+	    } else if ((pabuf = pa_toCSVString(pa))) {
+		len = strlen(pabuf);
+	    }
+
+	    if (pabuf) {
+		(void)(*writer)(pabuf, len, data);
+		putil_free(pabuf);
 	    }
-	    putil_free(pabuf);
 	}
 
 	// Dictionary bookkeeping.
 	next = dict_next(dict, dnp);
 
-	dict_delete(dict, dnp);
+	dict_delete_free(dict, dnp);
 	dnp = next;
 
-	pa_destroy(pa);
+	if (pa != held) {
+	    pa_destroy(pa);
+	}
     }
-}
 
-/// Convert all raw PAs in the group into a single set of "cooked" PAs
-/// under the leader.
-/// @param[in] ca       the object pointer
-void
-ca_coalesce(ca_o ca)
-{
-    dict_t *dict_raw, *dict_cooked;
-    dnode_t *dnpr, *dnpc, *next;
+    if (ca->ca_arena) {
+	arena_reset(ca->ca_arena);
+    }
 
-    dict_raw = ca->ca_raw_pa_dict;
+    // Held PAs go back in only now, since their nodes may come
+    // from the arena too.
+    for (i = 0; i < heldcount; i++) {
+	if (!dict_alloc_insert(dict, heldlist[i], NULL)) {
+	    putil_syserr(2, "dict_alloc_insert()");
+	}
+    }
+    putil_free(heldlist);
+}
 
-    assert(!ca->ca_cooked_pa_dict);
-    if ((dict_cooked = dict_create(DICTCOUNT_T_MAX, pa_cmp_by_pathname))) {
-	ca->ca_cooked_pa_dict = dict_cooked;
+// Internal service routine. Compares the times at which two
+// non-read PAs happened.
+static int
+_ca_cmp_write_times(pa_o left, pa_o right)
+{
+    if (pa_has_timestamp(left) && pa_has_timestamp(right)) {
+	// If the PA's have their own timestamps, use them.
+	return moment_cmp(pa_get_timestamp(left),
+			  pa_get_timestamp(right), NULL);
     } else {
-	putil_syserr(2, "dict_create()");
+	// Otherwise key off the file times. This is for
+	// support of "dummy" PAs as used in shopping.
+	return moment_cmp(pa_get_moment(left), pa_get_moment(right), NULL);
     }
+}
+
+// Internal service routine. Deals with the source end of a rename
+// once the rename itself has been coalesced at its destination; dst_pa
+// is the cooked rename if it won out there, else NULL. If the source
+// was created within the group it was a temp file and drops out of
+// the roadmap, passing any dcode it has to the destination so the
+// same data need not be hashed again under the final name (see
+// _ca_sample_palist_callback()). Otherwise it existed beforehand and
+// is recorded as unlinked, unless something was written to it again
+// after the rename.
+static void
+_ca_coalesce_rename(ca_o ca, dict_t *dict_cooked, pa_o raw_pa, pa_o dst_pa)
+{
+    dnode_t *dnpc;
+    pa_o src_pa, tmp_pa;
+    ps_o src_ps;
+
+    // The unlink doubles as the key for finding the source.
+    src_pa = pa_copy(raw_pa);
+    pa_set_op(src_pa, OP_UNLINK);
+    pa_set_uploadable(src_pa, 0);
+    src_ps = ps_newFromPath(pa_get_abs2(raw_pa));
+    ps_set_unlinked(src_ps);
+    ps_destroy(pa_get_ps(src_pa));
+    pa_set_ps(src_pa, src_ps);
+
+    if ((dnpc = dict_lookup(dict_cooked, src_pa))) {
+	tmp_pa = (pa_o)dnode_getkey(dnpc);
+
+	if (!pa_is_read(tmp_pa) && _ca_cmp_write_times(tmp_pa, raw_pa) > 0) {
+	    pa_destroy(src_pa);
+	    return;
+	}
 
-    for (dnpr = dict_first(dict_raw); dnpr;) {
-	pa_o raw_pa, ckd_pa;
+	dict_delete(dict_cooked, dnpc);
+	dnode_destroy(dnpc);
 
-	next = dict_next(dict_raw, dnpr);
+	if (pa_get_op(tmp_pa) == OP_CREAT || pa_is_rename(tmp_pa)) {
+	    if (dst_pa && pa_has_dcode(tmp_pa)) {
+		ps_o dst_ps, tmp_ps;
+
+		dst_ps = pa_get_ps(dst_pa);
+		tmp_ps = pa_get_ps(tmp_pa);
+		ps_set_moment(dst_ps, ps_get_moment(tmp_ps));
+		ps_set_size(dst_ps, ps_get_size(tmp_ps));
+		ps_set_mode(dst_ps, ps_get_mode(tmp_ps));
+		ps_set_dcode(dst_ps, ps_get_dcode(tmp_ps));
+	    }
+	    _ca_verbosity_pa(tmp_pa, ca, "RENAMING");
+	    pa_destroy(tmp_pa);
+	    pa_destroy(src_pa);
+	    return;
+	}
+
+	_ca_verbosity_pa(tmp_pa, ca, "REMOVING");
+	pa_destroy(tmp_pa);
+    }
+
+    if (!(dnpc = dnode_create(NULL))) {
+	putil_syserr(2, "dnode_create()");
+    }
+    dict_insert(dict_cooked, dnpc, src_pa);
+}
 
-	raw_pa = (pa_o)dnode_getkey(dnpr);
+// Internal service routine. Sets a rename aside, taking ownership
+// of it, to have its source dealt with by ca_coalesce(). That must
+// wait because the source may have been created by another member
+// of the group, and meanwhile the rename may lose out at its
+// destination to a later write.
+static void
+_ca_set_aside_rename(ca_o ca, pa_o pa)
+{
+    if (!ca->ca_rename_pa_dict) {
+	ca->ca_rename_pa_dict = dict_create(DICTCOUNT_T_MAX, pa_cmp);
+	if (!ca->ca_rename_pa_dict) {
+	    putil_syserr(2, "dict_create()");
+	}
+    }
 
-	_ca_verbosity_pa(raw_pa, ca, "COALESCING");
+    if (!dict_alloc_insert(ca->ca_rename_pa_dict, pa, NULL)) {
+	putil_syserr(2, "dict_alloc_insert()");
+    }
+}
 
-	// All data is in the key - that's why the value can be null.
-	if ((dnpc = dict_lookup(dict_cooked, raw_pa))) {
-	    int keep_cooked = 0;
+// Internal service routine. Coalesces one PA into the cooked set,
+// which takes ownership of it. A PA which loses out to the one
+// already there is destroyed.
+static void
+_ca_cook_pa(ca_o ca, pa_o pa)
+{
+    dict_t *dict_cooked;
+    dnode_t *dnpc;
 
-	    ckd_pa = (pa_o)dnode_getkey(dnpc);
+    dict_cooked = ca->ca_cooked_pa_dict;
 
-	    if (!pa_is_read(raw_pa) && !pa_is_read(ckd_pa)) {
-		moment_s raw_timestamp, ckd_timestamp;
+    _ca_verbosity_pa(pa, ca, "COALESCING");
 
-		// If they're both destructive ops (non-read) then we
-		// need to consider timestamps and use the later one.
+    // All data is in the key - that's why the value can be null.
+    if ((dnpc = dict_lookup(dict_cooked, pa))) {
+	pa_o ckd_pa;
+	int keep_cooked = 0;
 
-		if (pa_has_timestamp(raw_pa) && pa_has_timestamp(ckd_pa)) {
-		    // If the PA's have their own timestamps, use them.
-		    raw_timestamp = pa_get_timestamp(raw_pa);
-		    ckd_timestamp = pa_get_timestamp(ckd_pa);
-		} else {
-		    // Otherwise key off the file times. This is for
-		    // support of "dummy" PAs as used in shopping.
-		    raw_timestamp = pa_get_moment(raw_pa);
-		    ckd_timestamp = pa_get_moment(ckd_pa);
-		}
+	ckd_pa = (pa_o)dnode_getkey(dnpc);
 
-		if (moment_cmp(raw_timestamp, ckd_timestamp, NULL) <= 0) {
-		    // Cooked write op is newer and can stay.
-		    keep_cooked = 1;
-		}
-	    } else if (pa_is_read(raw_pa)) {
-		// There's no point replacing a read with another read,
-		// so regardless of whether the current cooked PA is a
-		// read or write, it can stay.
+	if (!pa_is_read(pa) && !pa_is_read(ckd_pa)) {
+	    // If they're both destructive ops (non-read) then we
+	    // need to consider timestamps and use the later one.
+	    if (_ca_cmp_write_times(pa, ckd_pa) <= 0) {
+		// Cooked write op is newer and can stay.
 		keep_cooked = 1;
-	    } else {
-		// A write always beats a read.
-	    }
-
-	    if (!keep_cooked) {
-		dict_delete(dict_cooked, dnpc);
-		dnode_destroy(dnpc);
-		_ca_verbosity_pa(ckd_pa, ca, "REMOVING");
-		pa_destroy(ckd_pa);
-		if (!(dnpc = dnode_create(NULL))) {
-		    putil_syserr(2, "dnode_create()");
-		}
-		ckd_pa = pa_copy(raw_pa);
-		dict_insert(dict_cooked, dnpc, ckd_pa);
 	    }
+	} else if (pa_is_read(pa)) {
+	    // There's no point replacing a read with another read,
+	    // so regardless of whether the current cooked PA is a
+	    // read or write, it can stay.
+	    keep_cooked = 1;
 	} else {
-	    if (!(dnpc = dnode_create(NULL))) {
-		putil_syserr(2, "dnode_create()");
+	    // A write always beats a read.
+	}
+
+	if (keep_cooked) {
+	    pa_destroy(pa);
+	    return;
+	}
+
+	dict_delete(dict_cooked, dnpc);
+	dnode_destroy(dnpc);
+	_ca_verbosity_pa(ckd_pa, ca, "REMOVING");
+	pa_destroy(ckd_pa);
+    }
+
+    if (!(dnpc = dnode_create(NULL))) {
+	putil_syserr(2, "dnode_create()");
+    }
+    dict_insert(dict_cooked, dnpc, pa);
+}
+
+/// Finishes coalescing all PAs in the group into a single set of
+/// "cooked" PAs under the leader. Raw PAs, if the CA holds them, are
+/// coalesced now; otherwise that was done as they were recorded.
+/// Either way the sources of renames are dealt with last, in time
+/// order, once every member's PAs have been merged in.
+/// @param[in] ca       the object pointer
+void
+ca_coalesce(ca_o ca)
+{
+    dict_t *dict_cooked, *dict;
+    dnode_t *dnp, *dnpc, *next;
+
+    if ((dict = ca->ca_raw_pa_dict)) {
+	assert(!ca->ca_cooked_pa_dict);
+	ca->ca_cooked_pa_dict =
+	    dict_create(DICTCOUNT_T_MAX, pa_cmp_by_pathname);
+	if (!ca->ca_cooked_pa_dict) {
+	    putil_syserr(2, "dict_create()");
+	}
+
+	for (dnp = dict_first(dict); dnp;) {
+	    pa_o raw_pa;
+
+	    next = dict_next(dict, dnp);
+	    raw_pa = (pa_o)dnode_getkey(dnp);
+	    if (pa_is_rename(raw_pa) && pa_get_abs2(raw_pa)) {
+		_ca_set_aside_rename(ca, pa_copy(raw_pa));
 	    }
-	    ckd_pa = pa_copy(raw_pa);
-	    dict_insert(dict_cooked, dnpc, ckd_pa);
+	    _ca_cook_pa(ca, pa_copy(raw_pa));
+
+	    // Clean up the raw set as we move PAs to the cooked one.
+	    dict_delete(dict, dnp);
+	    dnode_destroy(dnp);
+	    dnp = next;
 	}
+    }
+
+    dict_cooked = ca->ca_cooked_pa_dict;
+
+    // Renames are in time order so anything written to the source
+    // of each before it happened has been coalesced by now.
+    if ((dict = ca->ca_rename_pa_dict)) {
+	for (dnp = dict_first(dict); dnp;) {
+	    pa_o rnm_pa, dst_pa = NULL;
+
+	    next = dict_next(dict, dnp);
+	    rnm_pa = (pa_o)dnode_getkey(dnp);
+
+	    if ((dnpc = dict_lookup(dict_cooked, rnm_pa))) {
+		dst_pa = (pa_o)dnode_getkey(dnpc);
+		if (!pa_is_rename(dst_pa) || !pa_get_abs2(dst_pa) ||
+			_ca_cmp_write_times(dst_pa, rnm_pa) ||
+			util_pathcmp(pa_get_abs2(dst_pa),
+				     pa_get_abs2(rnm_pa))) {
+		    dst_pa = NULL;
+		}
+	    }
 
-	// Clean up the raw set as we move PAs to the cooked one.
-	dict_delete(dict_raw, dnpr);
-	dnode_destroy(dnpr);
-	dnpr = next;
+	    _ca_coalesce_rename(ca, dict_cooked, rnm_pa, dst_pa);
+
+	    dict_delete_free(dict, dnp);
+	    pa_destroy(rnm_pa);
+	    dnp = next;
+	}
     }
 
     return;
@@ -637,33 +904,167 @@ ca_merge(ca_o leader, ca_o donor)
 	dict_destroy(donor->ca_raw_pa_dict);
 	donor->ca_raw_pa_dict = NULL;
     }
+
+    // Or, if the donor has been coalescing as it went, its cooked
+    // PAs along with the renames it has set aside.
+    if ((dict = donor->ca_cooked_pa_dict)) {
+	assert(leader->ca_cooked_pa_dict);
+	for (dnp = dict_first(dict); dnp;) {
+	    next = dict_next(dict, dnp);
+
+	    pa = (pa_o)dnode_getkey(dnp);
+	    dict_delete(dict, dnp);
+	    dnode_destroy(dnp);
+	    _ca_cook_pa(leader, pa);
+	    dnp = next;
+	}
+    }
+    if ((dict = donor->ca_rename_pa_dict)) {
+	for (dnp = dict_first(dict); dnp;) {
+	    next = dict_next(dict, dnp);
+
+	    pa = (pa_o)dnode_getkey(dnp);
+	    dict_delete_free(dict, dnp);
+	    _ca_set_aside_rename(leader, pa);
+	    dnp = next;
+	}
+    }
+}
+
+// Internal service routine. Comparison function for the hash of
+// raw read pathnames.
+static int
+_ca_read_hash_cmp(const void *left, const void *right)
+{
+    return util_pathcmp((CCS)left, (CCS)right);
+}
+
+// Internal service routines. Node allocators for the raw PA set
+// and raw read hash when they live in the CA's arena. Nodes are
+// released along with everything else when the arena is reset.
+static dnode_t *
+_ca_dnode_alloc(void *context)
+{
+    return (dnode_t *)arena_alloc((arena_o)context, sizeof(dnode_t));
+}
+
+static void
+_ca_dnode_free(dnode_t *node, void *context)
+{
+    arena_free((arena_o)context, node);
+}
+
+static hnode_t *
+_ca_hnode_alloc(void *context)
+{
+    return (hnode_t *)arena_alloc((arena_o)context, sizeof(hnode_t));
+}
+
+static void
+_ca_hnode_free(hnode_t *node, void *context)
+{
+    arena_free((arena_o)context, node);
+}
+
+/// Returns an arena from which PAs to be recorded in this CA may be
+/// allocated, creating it on first use. The arena also holds the
+/// bookkeeping for the raw PA set, and everything in it is released
+/// at once when the raw PAs are consumed by ca_write_to() or
+/// ca_clear_pa(). Must first be called while no raw PAs are held.
+/// @param[in] ca       the CA object pointer
+/// @return the arena
+arena_o
+ca_get_arena(ca_o ca)
+{
+    if (!ca->ca_arena) {
+	assert(!dict_count(ca->ca_raw_pa_dict));
+	ca->ca_arena = arena_new();
+	dict_set_allocator(ca->ca_raw_pa_dict,
+	    _ca_dnode_alloc, _ca_dnode_free, ca->ca_arena);
+	if (ca->ca_raw_read_hash) {
+	    hash_set_allocator(ca->ca_raw_read_hash,
+		_ca_hnode_alloc, _ca_hnode_free, ca->ca_arena);
+	}
+    }
+
+    return ca->ca_arena;
+}
+
+/// Boolean - returns true iff the CA already holds a raw read op
+/// on the given path. Since ca_coalesce() keeps only one read per
+/// path, and a read never displaces another op, a further read of
+/// the same path need not be recorded at all. Tracking starts with
+/// the first call so CAs which never ask, e.g. in the monitor,
+/// pay nothing for it.
+/// @param[in] ca       the CA object pointer
+/// @param[in] path     the canonical absolute pathname
+/// @return true or false
+int
+ca_has_raw_read(ca_o ca, CCS path)
+{
+    if (!ca->ca_raw_read_hash) {
+	ca->ca_raw_read_hash = hash_create(HASHCOUNT_T_MAX,
+		_ca_read_hash_cmp, util_hash_fun_default);
+	if (!ca->ca_raw_read_hash) {
+	    putil_syserr(2, "hash_create()");
+	}
+	if (ca->ca_arena) {
+	    hash_set_allocator(ca->ca_raw_read_hash,
+		_ca_hnode_alloc, _ca_hnode_free, ca->ca_arena);
+	}
+	return 0;
+    }
+
+    return hash_lookup(ca->ca_raw_read_hash, path) != NULL;
 }
 
 /// Add a new PathAction into the specified CmdAction.
-/// No coalescing is attempted - PA objects are are always added
-/// here unless they are truly identical (same pointer == same object).
+/// In a CA holding raw PAs no coalescing is attempted - PA objects
+/// are always added here unless they are truly identical (same
+/// pointer == same object). Otherwise the PA is coalesced straight
+/// into the cooked set, so the monitor holds only one PA per path
+/// for each cmd rather than everything it did until it ends.
+/// Either way the CA takes ownership of the PA.
 /// @param[in] ca       the CA object pointer
 /// @param[in] pa       the PA object pointer
 void
 ca_record_pa(ca_o ca, pa_o pa)
 {
-    dnode_t *dnp;
-
     _ca_verbosity_pa(pa, ca, "RECORDING");
 
+    if (!ca->ca_raw_pa_dict) {
+	if (pa_is_rename(pa) && pa_get_abs2(pa)) {
+	    _ca_set_aside_rename(ca, pa_copy(pa));
+	}
+	_ca_cook_pa(ca, pa);
+	return;
+    }
+
     // All data is in the key - that's why the value can be null.
-    if (!(dnp = dnode_create(NULL))) {
-	putil_syserr(2, "dnode_create()");
+    if (!dict_alloc_insert(ca->ca_raw_pa_dict, pa, NULL)) {
+	putil_syserr(2, "dict_alloc_insert()");
+    }
+
+    // Remember plain reads if anyone is asking (see ca_has_raw_read).
+    if (ca->ca_raw_read_hash && pa_get_op(pa) == OP_READ &&
+	    !hash_lookup(ca->ca_raw_read_hash, pa_get_abs(pa))) {
+	if (!hash_alloc_insert(ca->ca_raw_read_hash, pa_get_abs(pa), NULL)) {
+	    putil_syserr(2, "hash_alloc_insert()");
+	}
     }
-    dict_insert(ca->ca_raw_pa_dict, dnp, pa);
 }
 
-/// Returns the number of raw PathActions held in the CmdAction.
+/// Returns the number of raw PathActions held in the CmdAction, or
+/// of cooked ones if it coalesces them as they're recorded.
 /// @param[in] ca       the object pointer
-/// @return the number of raw PathActions
+/// @return the number of PathActions
 int
 ca_get_pa_count(ca_o ca)
 {
+    if (!ca->ca_raw_pa_dict) {
+	return (int)dict_count(ca->ca_cooked_pa_dict);
+    }
+
     return (int)dict_count(ca->ca_raw_pa_dict);
 }
 
@@ -1010,22 +1411,43 @@ ca_format_header(ca_o ca)
     return hdr;
 }
 
-// Internal service routine.
+// Internal service routine. Decides whether the PA needs to be
+// sampled again before it's formatted and does so, unless it wants
+// a dcode and there's a dcoder to leave that to, in which case it's
+// added to the list for the dcoder.
 static int
-_ca_format_palist_callback(pa_o pa, void *data)
+_ca_sample_palist_callback(pa_o pa, void *data)
 {
-    format_palist_s *fps;
+    sample_palist_s *sps;
     long dcode_all;
-    CCS pabuf;
+    int resample;
 
-    fps = (format_palist_s *) data;
+    sps = (sample_palist_s *) data;
 
     dcode_all = prop_is_true(P_DCODE_ALL);
 
+    // A dcode derived by the auditor as the file was closed (see
+    // Dcode.Close) stands if a stat shows the file unchanged since.
+    // Otherwise it was written again, e.g. through a dup-ed descriptor.
     // Use size=0 as an indicator that this path hasn't been statted yet.
     // This may lead to the occasional double stat of a file which is
     // in fact zero length but that should be insignificant.
-    if (!pa_is_unlink(pa) && (pa_get_size(pa) == 0 || dcode_all)) {
+    if (pa_has_dcode(pa) && !pa_is_unlink(pa)) {
+	ps_o ps;
+	moment_s moment;
+	int64_t size;
+
+	ps = pa_get_ps(pa);
+	moment = ps_get_moment(ps);
+	size = ps_get_size(ps);
+	resample = ps_stat(ps, 0) || ps_get_size(ps) != size ||
+	    ps_get_moment(ps).ntv_sec != moment.ntv_sec ||
+	    ps_get_moment(ps).ntv_nsec != moment.ntv_nsec;
+    } else {
+	resample = pa_get_size(pa) == 0 || dcode_all;
+    }
+
+    if (!pa_is_unlink(pa) && resample) {
 	int dcode_path;
 
 	dcode_path = dcode_all || pa_is_member(pa) || pa_get_uploadable(pa);
@@ -1047,9 +1469,30 @@ _ca_format_palist_callback(pa_o pa, void *data)
 	}
 #endif	/*_WIN32*/
 
-	(void)pa_stat(pa, dcode_path);
+	if (dcode_path && CaDcoder) {
+	    if (sps->sp_count == sps->sp_max) {
+		sps->sp_max = sps->sp_max ? sps->sp_max * 2 : 16;
+		sps->sp_pas = (pa_o *)putil_realloc(sps->sp_pas,
+					    sps->sp_max * sizeof(pa_o));
+	    }
+	    sps->sp_pas[sps->sp_count++] = pa;
+	} else {
+	    (void)pa_stat(pa, dcode_path);
+	}
     }
 
+    return 0;
+}
+
+// Internal service routine.
+static int
+_ca_format_palist_callback(pa_o pa, void *data)
+{
+    format_palist_s *fps;
+    CCS pabuf;
+
+    fps = (format_palist_s *) data;
+
     // Skip any record which does not represent a regular file or dir.
     // This is kind of a hack since it happens awfully late -
     // it would be cleaner to keep these entries out of the set
@@ -1084,12 +1527,22 @@ _ca_format_palist_callback(pa_o pa, void *data)
 }
 
 // Internal service routine. Returns an allocated string representing
-// all PAs contained in the CA.
+// all PAs contained in the CA. They're all sampled first, the ones
+// wanting dcodes together, so the order in which the dcodes are
+// derived has no bearing on the result.
 static CCS
 _ca_format_cooked_palist(ca_o ca)
 {
+    sample_palist_s spstruct;
     format_palist_s fpstruct;
 
+    memset(&spstruct, 0, sizeof(spstruct));
+    (void)ca_foreach_cooked_pa(ca, _ca_sample_palist_callback, &spstruct);
+    if (spstruct.sp_count) {
+	CaDcoder(spstruct.sp_pas, spstruct.sp_count);
+	putil_free(spstruct.sp_pas);
+    }
+
     fpstruct.fp_bufsize = AUDIT_BUF_INIT_SIZE;
     fpstruct.fp_buf = (CS)putil_malloc(fpstruct.fp_bufsize);
     fpstruct.fp_buf[0] = '\0';
@@ -1100,6 +1553,18 @@ _ca_format_cooked_palist(ca_o ca)
     return fpstruct.fp_buf;
 }
 
+/// Registers a function to which the PAs of a CA wanting dcodes are
+/// handed together when it's formatted (see ca_toCSVString()). It
+/// must call pa_stat(pa, 1) on each and return only when all are
+/// done, but may do them in any order and on any thread. By default,
+/// and after registering NULL, they're done one by one as found.
+/// @param[in] dcoder   a function pointer, or NULL
+void
+ca_set_dcoder(void (*dcoder) (pa_o *, int))
+{
+    CaDcoder = dcoder;
+}
+
 /// Formats a string representing a human-readable form of the CA.
 /// @param[in] ca       the object pointer
 /// @return a string which should be freed when no longer needed
@@ -1252,6 +1717,40 @@ ca_get_subs(ca_o ca)
     return ca->ca_subs;
 }
 
+/// Marks the CA as fully handled, or not. Once marked it's queued
+/// to be retired (see ca_next_processed()).
+/// @param[in] ca       the object pointer
+/// @param[in] processed        boolean - has this CA been fully handled?
+void
+ca_set_processed(ca_o ca, int processed)
+{
+    if (processed && !ca->ca_processed) {
+	ca->ca_next_processed = CaProcessed;
+	CaProcessed = ca;
+    }
+    ca->ca_processed = processed;
+}
+
+/// Takes a CA off the queue of those marked processed. This lets
+/// the owner of a table of CAs retire the ones which are done
+/// without searching the whole table for them.
+/// @return a processed CA, or NULL if there are no more
+ca_o
+ca_next_processed(void)
+{
+    ca_o ca;
+
+    while ((ca = CaProcessed)) {
+	CaProcessed = ca->ca_next_processed;
+	ca->ca_next_processed = NULL;
+	if (ca->ca_processed) {
+	    break;
+	}
+    }
+
+    return ca;
+}
+
 /// Returns the number of pending (not yet closed) audits in the group.
 /// @param[in] ca       the object pointer
 /// @return the number of pending audits
@@ -1301,12 +1800,14 @@ GEN_SETTER_GETTER_DEFN(ca, leader, ca_o)
 GEN_SETTER_GETTER_DEFN(ca, strong, int)
 GEN_SETTER_GETTER_DEFN(ca, started, int)
 GEN_SETTER_GETTER_DEFN(ca, closed, int)
-GEN_SETTER_GETTER_DEFN(ca, processed, int)
+GEN_GETTER_DEFN(ca, processed, int)
 // *INDENT-ON*
 
 /// Clear out the raw set and cooked sets. Destroy the entire
 /// cooked data structure but leave the raw one present though
 /// empty. This is the same as the initial (post-creation) state.
+/// A CA which coalesces as it goes has no raw set, so its cooked
+/// one is left present though empty instead.
 /// @param[in] ca       the object pointer
 void
 ca_clear_pa(ca_o ca)
@@ -1315,18 +1816,25 @@ ca_clear_pa(ca_o ca)
     dnode_t *dnp, *next;
     pa_o pa;
 
+    if (ca->ca_raw_read_hash) {
+	hash_free_nodes(ca->ca_raw_read_hash);
+    }
+
     if ((dict = ca->ca_raw_pa_dict)) {
 	for (dnp = dict_first(dict); dnp;) {
 	    next = dict_next(dict, dnp);
 
 	    pa = (pa_o)dnode_getkey(dnp);
-	    dict_delete(dict, dnp);
-	    dnode_destroy(dnp);
+	    dict_delete_free(dict, dnp);
 	    pa_destroy(pa);
 	    dnp = next;
 	}
     }
 
+    if (ca->ca_arena) {
+	arena_reset(ca->ca_arena);
+    }
+
     if ((dict = ca->ca_cooked_pa_dict)) {
 	for (dnp = dict_first(dict); dnp;) {
 	    next = dict_next(dict, dnp);
@@ -1337,8 +1845,23 @@ ca_clear_pa(ca_o ca)
 	    pa_destroy(pa);
 	    dnp = next;
 	}
-	dict_destroy(ca->ca_cooked_pa_dict);
-	ca->ca_cooked_pa_dict = NULL;
+	if (ca->ca_raw_pa_dict) {
+	    dict_destroy(ca->ca_cooked_pa_dict);
+	    ca->ca_cooked_pa_dict = NULL;
+	}
+    }
+
+    if ((dict = ca->ca_rename_pa_dict)) {
+	for (dnp = dict_first(dict); dnp;) {
+	    next = dict_next(dict, dnp);
+
+	    pa = (pa_o)dnode_getkey(dnp);
+	    dict_delete_free(dict, dnp);
+	    pa_destroy(pa);
+	    dnp = next;
+	}
+	dict_destroy(ca->ca_rename_pa_dict);
+	ca->ca_rename_pa_dict = NULL;
     }
 }
 
@@ -1365,7 +1888,16 @@ ca_destroy(ca_o ca)
 
     ca_clear_pa(ca);
 
-    dict_destroy(ca->ca_raw_pa_dict);
+    if (ca->ca_raw_pa_dict) {
+	dict_destroy(ca->ca_raw_pa_dict);
+    }
+    if (ca->ca_cooked_pa_dict) {
+	dict_destroy(ca->ca_cooked_pa_dict);
+    }
+    if (ca->ca_raw_read_hash) {
+	hash_destroy(ca->ca_raw_read_hash);
+    }
+    arena_destroy(ca->ca_arena);
 
     putil_free(ca->ca_prog);
     putil_free(ca->ca_host);
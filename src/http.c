@@ -312,6 +312,17 @@ http_init(void)
     }
 }
 
+/// Called in a child process after fork() to abandon, without closing,
+/// any connections inherited from the parent. The parent may still be
+/// using them and a child must not share its conversation with the
+/// server. The child will make its own connections as needed.
+void
+http_fork_child(void)
+{
+    DefaultHandle = NULL;
+    MultiHandle = NULL;
+}
+
 /// Finalizes HTTP-related data structures.
 void
 http_fini(void)
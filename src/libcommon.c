@@ -19,6 +19,9 @@
 /// @brief The part of the auditor library which is common to
 /// both Unix and Windows.
 
+#include "arena.c"
+#include "bloom.c"
+
 #include "ca.c"
 
 #include "code.c"
@@ -37,6 +40,8 @@
 
 #include "re.c"
 
+#include "ring.c"
+
 #include "sha1.c"
 
 #include "util.c"
@@ -51,6 +56,7 @@
 #include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #endif	/*!_WIN32*/
 
@@ -65,12 +71,49 @@ static unsigned long Depth;
 static ca_o CurrentCA;
 static int AuditFD = -1;
 static void *IgnorePathRE;
+#if defined(_WIN32)
 static void *IgnoreProgRE;
+#endif	/*_WIN32*/
 static void *AllowedWritePathRE;
+static int AllowedWritePathREReady;
 
 /// The socket through which all communication to the monitor takes place.
 SOCKET ReportSocket = INVALID_SOCKET;
 
+// Nonzero while ReportSocket is being held open from SOA to EOA.
+static int ReportPersistent;
+
+// Nonzero while the monitor's reply to our SOA remains unread.
+static int SoaAckPending;
+
+// The shared-memory ring claimed for the current delivery, if any.
+static int RingSlot = -1;
+
+// Nonzero if PAs go to the monitor as binary records rather than CSV.
+static int BinaryRecords;
+
+// With Dcode.Close, the member write PA last recorded against each
+// descriptor, so that its file can be dcoded when that's closed.
+static int DcodeAtClose;
+static pa_o *ClosePAs;
+static int ClosePAsMax;
+static unsigned long ClosePAsGen;
+
+/// A file being closed which is to be dcoded (see _pa_closing).
+typedef struct {
+    pa_o cp_pa;			///< its PA, valid only in cp_gen
+    ps_o cp_ps;			///< a scratch PS to sample it into
+    unsigned long cp_gen;	///< ClosePAsGen when taken
+} close_pa_s;
+
+// With Audit.Flush.Count or Audit.Flush.Secs, a long-running process
+// delivers what it has recorded so far whenever either limit is
+// passed rather than holding everything until exit or exec.
+static unsigned long FlushCount;
+static unsigned long FlushSecs;
+static unsigned long PAsSinceFlush;
+static moment_s LastFlush;
+
 // This static flag indicates whether the auditor is active or quiescent.
 // The default kind of activation is when the auditor is turned on from
 // process start to process end. The other activation mode is when a long-
@@ -105,8 +148,17 @@ static enum {
 /// A flag to _audit_end() indicating that we're about to exit.
 #define EXITING			1
 
+static void _audit_flush(CCS);
+static void _audit_flush_early(CCS);
 static void _audit_end(CCS, int, long);
 
+// Per-thread staging of PAs, supplied by the platform layer.
+static int _thread_buffering(void);
+static pn_cache_o _thread_pn_cache(void);
+static unsigned long _thread_count_pa(void);
+static void _thread_buffer_pa(pa_o);
+static void _thread_buffers_merge(void);
+
 /// Un-exported API to ask whether the auditor is globally active.
 /// @return true if so activated
 static int
@@ -152,12 +204,51 @@ auditor_setInactive(void)
     Activated = LIBAO_INACTIVE;
 }
 
+// Internal service routine. Most processes never write so the RE
+// limiting where they may is compiled on first use.
+static void
+_allowed_write_path_re_init(void)
+{
+    if (!AllowedWritePathREReady) {
+	AllowedWritePathRE = re_init_prop__(P_ALLOWED_WRITE_PATH_RE);
+	AllowedWritePathREReady = 1;
+    }
+}
+
+// Internal service routine. Adds a PA to the current CA unless it's
+// a read of a path which the CA has already seen, in which case it's
+// discarded. Compilers may open the same header dozens of times; all
+// but the first would be discarded by the monitor anyway.
+// The caller must hold the lock.
+static void
+_pa_enter(pa_o pa)
+{
+    if (pa_get_op(pa) == OP_READ &&
+	    ca_has_raw_read(CurrentCA, pa_get_abs(pa))) {
+	vb_printf(VB_REC, "duplicate: %c,%s,%s",
+	    pa_get_op(pa), pa_get_call(pa), pa_get_abs(pa));
+	pa_destroy(pa);
+    } else {
+	ca_record_pa(CurrentCA, pa);
+    }
+}
+
 // Internal service routine. Called from intercepted system calls
 // to register a file access (read, write, link, unlink, etc).
+// In a threaded program each thread stages its PAs in a buffer of
+// its own which is merged into the CA at flush time, and has its
+// own pathname and ignore caches, so no lock is taken here. Staged
+// PAs come from the heap since they're consumed by whichever thread
+// flushes. Otherwise they go straight into the CA and are allocated
+// from its arena, which like the shared caches is static data, so
+// the lock is held throughout.
 static void
 _pa_record(CCS call, CCS path, CCS extra, int fd, op_e op)
 {
-    pn_o pn = NULL;
+    arena_o arena = NULL;
+    pn_cache_o pncache = NULL;
+    int buffered, ignored, flush = 0;
+    pn_o pn, pn2 = NULL;
     ps_o ps;
     pa_o pa;
 
@@ -166,12 +257,73 @@ _pa_record(CCS call, CCS path, CCS extra, int fd, op_e op)
 	return;
     }
 
-    pn = pn_new(path, 1);
+    buffered = _thread_buffering();
+
+    if (buffered) {
+	pncache = _thread_pn_cache();
+    } else {
+	_thread_mutex_lock();
+	if (CurrentCA) {
+	    arena = ca_get_arena(CurrentCA);
+	}
+    }
+
+    pn = pn_newInCache(arena, pncache, path);
     path = pn_get_abs(pn);
 
-    if (_ignore_path(path)) {
+    // If this was a link op we may have a 2nd path to remember.
+    if (extra && op != OP_SYMLINK) {
+	pn2 = pn_newInCache(arena, pncache, extra);
+    }
+
+    // The ignore list keeps a cache too.
+    ignored = _ignore_path(path);
+
+    // A rename is recorded at its destination, carrying the source.
+    // If only one end is of interest it's recorded as what it looks
+    // like from there: an unlink of the source or a create of the
+    // destination. Otherwise an ignored path would leak into the
+    // roadmap through the other end.
+    if (op == OP_RENAME && pn2) {
+	if (!ignored && _ignore_path(pn_get_abs(pn2))) {
+	    pn_destroy(pn2);
+	    pn2 = NULL;
+	    op = OP_CREAT;
+	} else if (ignored && !_ignore_path(pn_get_abs(pn2))) {
+	    pn_destroy(pn);
+	    pn = pn2;
+	    pn2 = NULL;
+	    path = pn_get_abs(pn);
+	    op = OP_UNLINK;
+	    ignored = 0;
+	}
+    }
+
+    // A threaded program has this done before its first thread.
+    if (!ignored && op != OP_READ && op != OP_EXEC) {
+	_allowed_write_path_re_init();
+    }
+
+    // Count what may be recorded, which is close enough, and see
+    // whether the time has come to deliver it. Limits are checked
+    // only as PAs arrive; an idle process has nothing to deliver.
+    if (!ignored && CurrentCA && (FlushCount || FlushSecs)) {
+	if (FlushCount && _thread_count_pa() >= FlushCount) {
+	    flush = 1;
+	} else if (FlushSecs) {
+	    moment_s now;
+
+	    moment_get_systime(&now);
+	    flush = now.ntv_sec - LastFlush.ntv_sec >= (int64_t)FlushSecs;
+	}
+    }
+
+    if (ignored) {
 	// We needed to derive a fully qualified path before doing this check.
 	vb_printf(VB_REC, "ignoring: %c,%s,%s", op, call, path);
+	if (pn2) {
+	    pn_destroy(pn2);
+	}
 	pn_destroy(pn);
     } else if (!CurrentCA) {
 	// This was moved down to after _ignore_path() to avoid
@@ -180,10 +332,22 @@ _pa_record(CCS call, CCS path, CCS extra, int fd, op_e op)
 	// during exit processing.
 	putil_int("PA after EOA: call=%s pid=%lu path=%s",
 		  call, (unsigned long)getpid(), path);
+	if (pn2) {
+	    pn_destroy(pn2);
+	}
+	pn_destroy(pn);
+    } else if (!buffered && op == OP_READ &&
+	    ca_has_raw_read(CurrentCA, path)) {
+	// See _pa_enter(); buffered reads are weeded out there.
+	vb_printf(VB_REC, "duplicate: %c,%s,%s", op, call, path);
+	if (pn2) {
+	    pn_destroy(pn2);
+	}
+	pn_destroy(pn);
     } else {
 	vb_printf(VB_REC, "recording: %c,%s,%s", op, call, path);
 
-	pa = pa_new();
+	pa = pa_newInArena(arena);
 	pa_set_op(pa, op);
 	pa_set_call(pa, call);
 	pa_set_pid(pa, ca_get_cmdid(CurrentCA));
@@ -210,20 +374,23 @@ _pa_record(CCS call, CCS path, CCS extra, int fd, op_e op)
 	}
 #endif	/*_WIN32*/
 
-	ps = ps_new();
+	ps = ps_newInArena(arena);
 	ps_set_pn(ps, pn);
 
-	// If this was a link op we may have a 2nd path to remember.
-	if (extra) {
-	    if (op == OP_SYMLINK) {
-		ps_set_target(ps, extra);
-	    } else {
-		ps_set_pn2(ps, pn_new(extra, 1));
-	    }
+	if (op == OP_SYMLINK && extra) {
+	    ps_set_target(ps, extra);
+	} else if (pn2) {
+	    ps_set_pn2(ps, pn2);
 	}
 
 	pa_set_ps(pa, ps);
 
+	// Non-member reads are sampled while we have the file open;
+	// see ca_write_to(). Members are left for the monitor to dcode.
+	if (op == OP_READ && fd >= 0 && !ps_is_member(ps)) {
+	    (void)ps_fstat(ps, fd);
+	}
+
 	if (op == OP_UNLINK) {
 	    ps_set_unlinked(ps);
 	} else if (op == OP_MKDIR) {
@@ -243,16 +410,244 @@ _pa_record(CCS call, CCS path, CCS extra, int fd, op_e op)
 
 	    // User may choose to limit legal pathnames for writes.
 	    if (AllowedWritePathRE && !re_match__(AllowedWritePathRE, path)) {
+		// Exit processing needs the lock.
+		if (!buffered) {
+		    _thread_mutex_unlock();
+		}
 		putil_die("disallowed write to '%s' per /%s/", path,
 		    prop_get_str(P_ALLOWED_WRITE_PATH_RE));
 	    }
 	}
 
 	// Finish by recording this path action.
+	if (buffered) {
+	    _thread_buffer_pa(pa);
+	} else {
+	    ca_record_pa(CurrentCA, pa);
+
+	    // Staged PAs may move or vanish before the close, so only
+	    // those recorded directly are watched.
+	    if (DcodeAtClose && fd >= 0 &&
+		    pa_is_write(pa) && pa_is_member(pa)) {
+		if (fd >= ClosePAsMax) {
+		    int max;
+
+		    max = fd + 64;
+		    ClosePAs = (pa_o *)putil_realloc(ClosePAs,
+			max * sizeof(*ClosePAs));
+		    memset(ClosePAs + ClosePAsMax, 0,
+			(max - ClosePAsMax) * sizeof(*ClosePAs));
+		    ClosePAsMax = max;
+		}
+		ClosePAs[fd] = pa;
+	    }
+	}
+    }
+
+    if (!buffered) {
+	_thread_mutex_unlock();
+    }
+
+    if (flush) {
+	_audit_flush_early(call);
+    }
+}
+
+// Called before the host program closes a descriptor. If a member
+// file was written through it which should be dcoded once it's
+// closed, takes its PA out of the table, fills in the handle with
+// what _pa_closed() will need to find it again, and returns true.
+static int
+_pa_closing(int fd, close_pa_s *cp)
+{
+    if (!DcodeAtClose) {
+	return 0;
+    }
+
+    cp->cp_pa = NULL;
+
+    _thread_mutex_lock();
+    if (fd >= 0 && fd < ClosePAsMax && (cp->cp_pa = ClosePAs[fd])) {
+	ClosePAs[fd] = NULL;
+	cp->cp_ps = ps_newFromPath(pa_get_abs(cp->cp_pa));
+	cp->cp_gen = ClosePAsGen;
+    }
+    _thread_mutex_unlock();
+
+    return cp->cp_pa != NULL;
+}
+
+// Samples and dcodes a file just closed by the host program. This
+// is done here, while its data is likely to be in the page cache
+// and in parallel with the rest of the build, rather than serially
+// by the monitor at the end of the command. The monitor leaves
+// alone any PA which arrives already sampled. The file is hashed
+// into a PS of our own without the lock; the results are then
+// copied to the PA unless it has been consumed meanwhile.
+static void
+_pa_closed(close_pa_s *cp, int closerc)
+{
+    ps_o ps;
+
+    if (!closerc && !ps_stat(cp->cp_ps, 1)) {
 	_thread_mutex_lock();
-	ca_record_pa(CurrentCA, pa);
+	if (cp->cp_gen == ClosePAsGen) {
+	    ps = pa_get_ps(cp->cp_pa);
+	    ps_set_datatype(ps, ps_get_datatype(cp->cp_ps));
+	    ps_set_moment(ps, ps_get_moment(cp->cp_ps));
+	    ps_set_size(ps, ps_get_size(cp->cp_ps));
+	    ps_set_mode(ps, ps_get_mode(cp->cp_ps));
+	    ps_set_dcode(ps, ps_get_dcode(cp->cp_ps));
+	}
 	_thread_mutex_unlock();
     }
+
+    ps_destroy(cp->cp_ps);
+}
+
+// The PAs watched for close are about to be consumed, including any
+// taken out of the table but not yet dcoded.
+static void
+_pa_close_forget(void)
+{
+    if (ClosePAs) {
+	memset(ClosePAs, 0, ClosePAsMax * sizeof(*ClosePAs));
+    }
+    ClosePAsGen++;
+}
+
+// At an early flush, the write PA to be held back for each descriptor
+// (see _pa_hold_open), or NULL.
+static pa_o *HeldPAs;
+static int HeldPAsMax;
+
+// Callback for ca_foreach_raw_pa(). Finds the last write PA recorded
+// against each descriptor.
+static int
+_pa_find_last_write(pa_o pa, void *data)
+{
+    int fd, max;
+
+    UNUSED(data);
+
+    fd = pa_get_fd(pa);
+    if (!pa_is_write(pa) || fd < 0) {
+	return 0;
+    }
+
+    if (fd >= HeldPAsMax) {
+	max = fd + 64;
+	HeldPAs = (pa_o *)putil_realloc(HeldPAs, max * sizeof(*HeldPAs));
+	memset(HeldPAs + HeldPAsMax, 0,
+	    (max - HeldPAsMax) * sizeof(*HeldPAs));
+	HeldPAsMax = max;
+    }
+
+    if (!HeldPAs[fd] || moment_cmp(pa_get_timestamp(pa),
+	    pa_get_timestamp(HeldPAs[fd]), NULL) > 0) {
+	HeldPAs[fd] = pa;
+    }
+
+    return 0;
+}
+
+// An early flush holds back a write to a file which is still open,
+// since it may not be finished yet. That's the last write recorded
+// against a descriptor which still refers to the same file, or the
+// one watched for close if any. Fills in HeldPAs accordingly.
+static void
+_pa_find_open_writes(void)
+{
+    pa_o pa;
+    int fd;
+
+    if (HeldPAs) {
+	memset(HeldPAs, 0, HeldPAsMax * sizeof(*HeldPAs));
+    }
+
+    (void)ca_foreach_raw_pa(CurrentCA, _pa_find_last_write, NULL);
+
+    for (fd = 0; fd < HeldPAsMax; fd++) {
+	if (DcodeAtClose && fd < ClosePAsMax && ClosePAs[fd]) {
+	    HeldPAs[fd] = ClosePAs[fd];
+	} else if ((pa = HeldPAs[fd])) {
+#if defined(_WIN32)
+	    HeldPAs[fd] = NULL;
+#else	/*_WIN32*/
+	    struct __stat64 fdbuf, pathbuf;
+
+	    if (fstat64(fd, &fdbuf) || stat64(pa_get_abs(pa), &pathbuf) ||
+		    fdbuf.st_dev != pathbuf.st_dev ||
+		    fdbuf.st_ino != pathbuf.st_ino) {
+		HeldPAs[fd] = NULL;
+	    }
+#endif	/*_WIN32*/
+	}
+    }
+}
+
+// Callback for ca_write_some_to(). A PA held back is copied out of
+// the arena and kept for a later batch, still watched for close if
+// it was before.
+static pa_o
+_pa_hold_open(pa_o pa)
+{
+    pa_o npa = NULL;
+    int fd;
+
+    fd = pa_get_fd(pa);
+    if (fd < 0) {
+	return NULL;
+    }
+
+    if (fd < HeldPAsMax && HeldPAs[fd] == pa) {
+	npa = pa_copy(pa);
+    }
+
+    if (fd < ClosePAsMax && ClosePAs[fd] == pa) {
+	ClosePAs[fd] = npa;
+    }
+
+    return npa;
+}
+
+// Internal service routine. A persistent connection carries small
+// messages in both directions over its lifetime so Nagle's algorithm
+// is turned off. It also lives alongside the host program, so like
+// the audit descriptor it's moved out of the popular low numbers,
+// and it must not leak into an exec-ed program.
+static void
+_monitor_setopts(SOCKET *sockp)
+{
+    int on = 1;
+
+    if (!prop_is_true(P_MONITOR_PERSISTENT)) {
+	return;
+    }
+
+    if (setsockopt(*sockp, IPPROTO_TCP, TCP_NODELAY,
+		   (const char *)&on, sizeof(on)) == SOCKET_ERROR) {
+	putil_syserr(0, "TCP_NODELAY");
+    }
+
+#if !defined(_WIN32)
+    {
+	int fd, i;
+
+	for (i = 0; i < 10; i++) {
+	    fd = PREFERRED_FD + 16 + i;
+	    if (fcntl(fd, F_GETFD) == -1 && errno == EBADF) {
+		if (dup2(*sockp, fd) != -1) {
+		    close(*sockp);
+		    *sockp = fd;
+		}
+		break;
+	    }
+	}
+
+	fcntl(*sockp, F_SETFD, fcntl(*sockp, F_GETFD) | FD_CLOEXEC);
+    }
+#endif	/*_WIN32*/
 }
 
 // NOTE: The current design opens two sockets per audited command;
@@ -276,6 +671,13 @@ _pa_record(CCS call, CCS path, CCS extra, int fd, op_e op)
 // first? I haven't thought, or tested, it out. However, the auditor
 // code is designed to be easily converted to use a single socket
 // in the event the change is someday made.
+// UPDATE: the Monitor.Persistent property now enables a mode in
+// which the SOA connection is held open and used for all further
+// deliveries through EOA. The ordering question is answered by the
+// monitor, which tags each connection with the cmdid and depth of
+// the SOA it carried and holds back an EOA until the connections
+// of its exec predecessors have drained. Forked children, which
+// send no SOA, still use the temp file and a one-shot connection.
 static void
 _monitor_open(SOCKET *sockp, CCS call)
 {
@@ -320,6 +722,7 @@ _monitor_open(SOCKET *sockp, CCS call)
 
 	if (!connect(*sockp, (struct sockaddr *)&dest_addr, sizeof(struct sockaddr))) {
 	    vb_printf(VB_MON, "OPENED: SOCKET %d", *sockp);
+	    _monitor_setopts(sockp);
 	    return;
 	}
 
@@ -333,6 +736,7 @@ _monitor_open(SOCKET *sockp, CCS call)
 	    continue;
 	} else if (errno == EISCONN) {
 	    vb_printf(VB_MON, "CONNECTED: SOCKET %d", *sockp);
+	    _monitor_setopts(sockp);
 	    return;
 	}
 #endif	/*_WIN32*/
@@ -385,6 +789,78 @@ _monitor_recv_line(SOCKET *sockp, const void *vbuf, size_t len)
     }
 }
 
+// A batch of serialized PAs on its way to a persistent connection,
+// or a copy of a ring delivery in case it must be sent again.
+typedef struct {
+    CS mb_buf;
+    size_t mb_len;
+    size_t mb_size;
+} monitor_batch_s;
+
+// Everything put into the ring claimed for the current delivery.
+static monitor_batch_s RingCopy;
+
+// Callback for ca_write_to() which collects PAs so that each batch
+// goes out over a persistent connection in a single send.
+static int
+_monitor_batch_writer(const void *buf, size_t len, void *data)
+{
+    monitor_batch_s *mbp;
+
+    mbp = (monitor_batch_s *)data;
+    if (mbp->mb_len + len > mbp->mb_size) {
+	mbp->mb_size = (mbp->mb_len + len) * 2;
+	mbp->mb_buf = (CS)putil_realloc(mbp->mb_buf, mbp->mb_size);
+    }
+    memcpy(mbp->mb_buf + mbp->mb_len, buf, len);
+    mbp->mb_len += len;
+    return 0;
+}
+
+// Internal service routine. A ring delivery could not be completed.
+// Tell the monitor to throw away what it has of it and send all of
+// it over the socket instead, which deals with a missing monitor as
+// it would for any other delivery rather than leaving us waiting on
+// a ring nobody will drain.
+static void
+_monitor_ring_abandon(void)
+{
+    putil_warn("monitor went away during ring delivery");
+    ring_abandon(RingSlot);
+    RingSlot = -1;
+    _monitor_open(&ReportSocket, NULL);
+    if (RingCopy.mb_len) {
+	_monitor_send(&ReportSocket, RingCopy.mb_buf, RingCopy.mb_len);
+    }
+    RingCopy.mb_len = 0;
+}
+
+// Internal service routine. Sends to whichever channel is open for
+// the current delivery: a shared-memory ring if one was claimed,
+// otherwise the socket. What goes into a ring is kept until the
+// monitor has it so it can be resent in full.
+static void
+_monitor_deliver(const void *buf, size_t len)
+{
+    if (RingSlot != -1) {
+	(void)_monitor_batch_writer(buf, len, &RingCopy);
+	if (ring_write(RingSlot, buf, len)) {
+	    _monitor_ring_abandon();
+	}
+    } else {
+	_monitor_send(&ReportSocket, buf, len);
+    }
+}
+
+// Callback for ca_write_to() which puts PAs straight into the ring.
+static int
+_monitor_ring_writer(const void *buf, size_t len, void *data)
+{
+    UNUSED(data);
+    _monitor_deliver(buf, len);
+    return 0;
+}
+
 // Internal service routine.
 static void
 _monitor_flush(SOCKET *sockp)
@@ -402,6 +878,11 @@ _monitor_close(SOCKET *sockp, int exiting)
 	return;
     }
 
+    if (sockp == &ReportSocket) {
+	ReportPersistent = 0;
+	SoaAckPending = 0;
+    }
+
 #if defined(_WIN32)
     closesocket(*sockp);
 #else				/*!_WIN32 */
@@ -558,8 +1039,9 @@ _audit_open(void)
 static void
 _audit_start(CCS call)
 {
-    CCS hdr;
+    CCS hdr, filter;
     CS soa_hdr;
+    int no_shop;
 
     if (!_auditor_isActive()) {
 	return;
@@ -579,6 +1061,18 @@ _audit_start(CCS call)
 	soa_hdr[1] = 's';
     }
 
+    // Similarly, a command line the roadmap filter has never seen
+    // can't be recycled so there's no point shopping for it.
+    if (soa_hdr[1] == 'S' && (filter = prop_get_str(P_ROADMAP_FILTER)) &&
+	    !bloom_attach(filter)) {
+	CCS line;
+
+	line = ca_get_line(CurrentCA);
+	if (!bloom_may_contain(line, strlen(line))) {
+	    soa_hdr[1] = 's';
+	}
+    }
+
     // Acquire the descriptor we'll be using for audit reporting.
     AuditFD = _audit_open();
 
@@ -596,18 +1090,38 @@ _audit_start(CCS call)
 	// It's worth thinking this through again to see if there's
 	// way around it, either by keeping the socket open or
 	// allowing SOA to be sent in the same packet as EOA.
+	// In persistent mode the socket is in fact kept open.
+	no_shop = soa_hdr[1] == 's';
 	_monitor_open(&ReportSocket, call);
 	_monitor_send(&ReportSocket, soa_hdr, strlen(soa_hdr));
 	putil_free(soa_hdr);
 
+	// When no shopping is done the reply can only be ACK_OK, so
+	// over a persistent connection there's no need to wait for it
+	// now. It's collected before anything else is sent, by which
+	// time it has usually arrived, which preserves the ordering
+	// guarantees of the blocking exchange at no cost.
+	if (no_shop && prop_is_true(P_MONITOR_PERSISTENT)) {
+	    ReportPersistent = 1;
+	    SoaAckPending = 1;
+	    vb_printf(VB_MON, "CONTINUING [-] WITH %s",
+		ca_get_line(CurrentCA));
+	    return;
+	}
+
 	// Block until monitor acknowledges receipt of SOA.
 	// This is needed to make sure it doesn't see EOA first.
 	// We require the received message to be terminated with a newline;
 	// we don't actually want the newline but it's a good way to
 	// be sure we've read the whole message.
-	_monitor_flush(&ReportSocket);
-	_monitor_recv_line(&ReportSocket, ack_soa, sizeof(ack_soa));
-	_monitor_close(&ReportSocket, 0);
+	if (prop_is_true(P_MONITOR_PERSISTENT)) {
+	    _monitor_recv_line(&ReportSocket, ack_soa, sizeof(ack_soa));
+	    ReportPersistent = 1;
+	} else {
+	    _monitor_flush(&ReportSocket);
+	    _monitor_recv_line(&ReportSocket, ack_soa, sizeof(ack_soa));
+	    _monitor_close(&ReportSocket, 0);
+	}
 
 	vb_printf(VB_MON, "CONTINUING [%s] WITH %s",
 	    ack_soa, ca_get_line(CurrentCA));
@@ -648,9 +1162,29 @@ _audit_start(CCS call)
     return;
 }
 
+// Internal service routine. Reads a pending reply to our SOA.
+// This must precede anything which might let the monitor see data
+// from us, or the SOA of a child of ours, before it has seen the SOA.
+static void
+_audit_soa_ack(void)
+{
+    char ack_soa[ACK_BUFFER_SIZE];
+
+    if (SoaAckPending) {
+	SoaAckPending = 0;
+	ack_soa[0] = '\0';
+	_monitor_recv_line(&ReportSocket, ack_soa, sizeof(ack_soa));
+	if (strcmp(ack_soa, ACK_OK)) {
+	    putil_warn("unexpected SOA ack '%s'", ack_soa);
+	}
+    }
+}
+
 // Dump and flush whatever file data we've acquired. This is done
 // just before the process disappears through either exit or exec.
 // It's also done before fork, in which case it may be partial.
+// Reads seen before a flush may be sent again after it; the monitor
+// drops the duplicates.
 // We must also deal with path accesses collected on the
 // child side of a fork before an exec, if any.
 // Before any child process is created or this process
@@ -676,6 +1210,11 @@ _audit_flush(CCS call)
     // This lock protects writes to both CurrentCA *and* AuditFD.
     _thread_mutex_lock();
 
+    _audit_soa_ack();
+
+    // Collect whatever the threads have recorded since last time.
+    _thread_buffers_merge();
+
     // This is an example of something we might want to do during
     // debugging if a host process is catching SIGSEGV (as Sun's
     // JVM does for instance). Of course a case could be made
@@ -685,14 +1224,94 @@ _audit_flush(CCS call)
 
     // Walk the tree, printing each pa node to the fd.
     // Note - ca_get_recycled is most likely redundant with ca_get_pa_count.
+    // With a persistent connection there's no need to stage the
+    // data in the temp file; it goes straight to the monitor.
     if (!ca_get_recycled(CurrentCA) && ca_get_pa_count(CurrentCA)) {
-	ca_write(CurrentCA, AuditFD);
+	if (ReportPersistent) {
+	    monitor_batch_s batch;
+
+	    memset(&batch, 0, sizeof(batch));
+	    ca_write_to(CurrentCA, BinaryRecords,
+			_monitor_batch_writer, &batch);
+	    if (batch.mb_len) {
+		_monitor_send(&ReportSocket, batch.mb_buf, batch.mb_len);
+	    }
+	    putil_free(batch.mb_buf);
+	} else {
+	    ca_write(CurrentCA, AuditFD, BinaryRecords);
+	}
+	_pa_close_forget();
+    }
+
+    PAsSinceFlush = 0;
+    if (FlushSecs) {
+	moment_get_systime(&LastFlush);
     }
 
     // Let the lock go.
     _thread_mutex_unlock();
 }
 
+// Delivers what a long-running process has recorded so far (see
+// Audit.Flush.Count) rather than holding it until exit or exec.
+// Unlike _audit_flush() the batch goes to the monitor right away,
+// along a persistent connection if there is one or else over a
+// connection opened for the purpose, which we wait for the monitor
+// to close just as at exec time. The monitor files each PA with its
+// CA as it arrives so it takes any number of such batches. Writes to
+// files which are still open are held back for a later batch.
+static void
+_audit_flush_early(CCS call)
+{
+    monitor_batch_s batch;
+    char ack[ACK_BUFFER_SIZE];
+
+    if (!_auditor_isActive()) {
+	return;
+    }
+
+    _thread_mutex_lock();
+
+    _audit_soa_ack();
+
+    _thread_buffers_merge();
+
+    if (!ca_get_recycled(CurrentCA) && ca_get_pa_count(CurrentCA)) {
+	_pa_find_open_writes();
+	memset(&batch, 0, sizeof(batch));
+	ca_write_some_to(CurrentCA, BinaryRecords, _pa_hold_open,
+			 _monitor_batch_writer, &batch);
+
+	if (!batch.mb_len) {
+	    // Everything was held back.
+	} else if (prop_is_true(P_NO_MONITOR)) {
+	    if (write(AuditFD, batch.mb_buf, batch.mb_len) == -1) {
+		putil_syserr(2, "write");
+	    }
+	} else if (ReportPersistent) {
+	    _monitor_send(&ReportSocket, batch.mb_buf, batch.mb_len);
+	} else {
+	    _monitor_open(&ReportSocket, call);
+	    _monitor_send(&ReportSocket, batch.mb_buf, batch.mb_len);
+	    _monitor_flush(&ReportSocket);
+	    _monitor_recv_line(&ReportSocket, ack, sizeof(ack));
+	    _monitor_close(&ReportSocket, 0);
+	}
+	putil_free(batch.mb_buf);
+
+	// Watched PAs were copied if held, but any taken out of the
+	// table for closing are gone.
+	ClosePAsGen++;
+    }
+
+    PAsSinceFlush = 0;
+    if (FlushSecs) {
+	moment_get_systime(&LastFlush);
+    }
+
+    _thread_mutex_unlock();
+}
+
 // This is called when a process is "ending" - either exit()
 // or exec(). The difference is that you never know whether an
 // exec will succeed.
@@ -720,8 +1339,18 @@ _audit_end(CCS call, int exiting, long status)
 	return;
     }
 
-    // This will start and/or flush the audit as required.
-    _audit_flush(call);
+    // If a shared-memory ring can be had, the PAs are serialized
+    // directly into it below and no socket is needed. Otherwise
+    // they're flushed to the temp file here as usual.
+    if (!prop_is_true(P_NO_MONITOR) && AuditFD != -1 && !ReportPersistent &&
+	    CurrentCA && !ca_get_recycled(CurrentCA)) {
+	RingSlot = ring_open();
+    }
+
+    if (RingSlot == -1) {
+	// This will start and/or flush the audit as required.
+	_audit_flush(call);
+    }
 
 #if defined(SIGPIPE) && defined(SIG_IGN)
     // This fixes a subtle problem: on a successful recycling event,
@@ -752,9 +1381,12 @@ _audit_end(CCS call, int exiting, long status)
 	if (AuditFD != -1 && CurrentCA && !ca_get_recycled(CurrentCA)) {
 	    char buf[1024];
 
-	    _monitor_open(&ReportSocket, call);
+	    if (RingSlot == -1) {
+		_monitor_open(&ReportSocket, call);
+	    }
 
 	    // Rewind the temp file and send its contents to the monitor.
+	    // With a ring this is only whatever was flushed at fork time.
 	    if (lseek(AuditFD, 0, SEEK_SET) == (off_t)-1) {
 		putil_syserr(2, "lseek");
 	    }
@@ -768,7 +1400,18 @@ _audit_end(CCS call, int exiting, long status)
 #endif	/*!EINTR*/
 		    putil_syserr(2, "read");
 		}
-		_monitor_send(&ReportSocket, buf, n);
+		_monitor_deliver(buf, n);
+	    }
+
+	    if (RingSlot != -1) {
+		_thread_mutex_lock();
+		_thread_buffers_merge();
+		if (ca_get_pa_count(CurrentCA)) {
+		    ca_write_to(CurrentCA, BinaryRecords,
+				_monitor_ring_writer, NULL);
+		    _pa_close_forget();
+		}
+		_thread_mutex_unlock();
 	    }
 	}
     }
@@ -786,12 +1429,12 @@ _audit_end(CCS call, int exiting, long status)
 	}
 	putil_free(hdr);
 
-	if (ReportSocket == INVALID_SOCKET) {
+	if (ReportSocket == INVALID_SOCKET && RingSlot == -1) {
 	    if (write(AuditFD, eoa_hdr, strlen(eoa_hdr)) == -1) {
 		putil_syserr(2, "write");
 	    }
 	} else {
-	    _monitor_send(&ReportSocket, eoa_hdr, strlen(eoa_hdr));
+	    _monitor_deliver(eoa_hdr, strlen(eoa_hdr));
 	}
 
 	putil_free(eoa_hdr);
@@ -816,11 +1459,29 @@ _audit_end(CCS call, int exiting, long status)
 #endif	/*!_WIN32*/
     }
 
+    // A ring delivery is acknowledged by the monitor releasing the slot.
+    if (RingSlot != -1) {
+	if (!ring_close(RingSlot)) {
+	    RingSlot = -1;
+	    RingCopy.mb_len = 0;
+	    return;
+	}
+	_monitor_ring_abandon();
+    }
+
     // No ACK needed in no-monitor mode ...
     if (ReportSocket == INVALID_SOCKET) {
 	return;
     }
 
+    // ... nor when leaving a persistent connection open across an
+    // exec, since the monitor sequences the data sent so far ahead
+    // of anything from the new program. If the exec succeeds the
+    // socket is closed on exec; if not we simply carry on with it.
+    if (!exiting && ReportPersistent) {
+	return;
+    }
+
     // Block until monitor acknowledges receipt of EOA by closing
     // the other end.
     _monitor_flush(&ReportSocket);
@@ -884,6 +1545,19 @@ _init_auditlib(CCS call, CCS exe, CCS cmdstr)
 	vb_printf(VB_OFF, "running in %s mode", prop_to_name(P_NO_MONITOR));
     }
 
+    // Without a monitor the audit is for human eyes, so keep it CSV.
+    BinaryRecords = !prop_is_true(P_NO_MONITOR) &&
+	prop_has_value(P_AUDIT_FORMAT) &&
+	!strcmp(prop_get_str(P_AUDIT_FORMAT), "binary");
+
+    DcodeAtClose = prop_is_true(P_DCODE_CLOSE);
+
+    FlushCount = prop_get_ulong(P_AUDIT_FLUSH_COUNT);
+    FlushSecs = prop_get_ulong(P_AUDIT_FLUSH_SECS);
+    if (FlushSecs) {
+	moment_get_systime(&LastFlush);
+    }
+
     // Initialize the hash-code generation.
     code_init();
 
@@ -1041,13 +1715,16 @@ _init_auditlib(CCS call, CCS exe, CCS cmdstr)
     _pa_record(call, putil_getexecpath(), NULL, -1, OP_EXEC);
 
     // Potential instruction from the user to ignore certain files.
-    IgnorePathRE = re_init_prop__(P_AUDIT_IGNORE_PATH_RE);
+    // Where possible the RE is not compiled until first needed.
+    _ignore_path_init();
 
+#if defined(_WIN32)
     // Potential instruction from the user to ignore certain programs.
     IgnoreProgRE = re_init_prop__(P_AUDIT_IGNORE_PROG_RE);
+#endif	/*_WIN32*/
 
-    // Potential instruction from the user to limit legal write ops.
-    AllowedWritePathRE = re_init_prop__(P_ALLOWED_WRITE_PATH_RE);
+    // Any instruction limiting legal write ops is left until the first
+    // write (see _pa_record).
 
     return pid;
 }
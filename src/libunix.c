@@ -32,6 +32,8 @@
 #include "AO.h"
 
 static int _ignore_path(const char *);
+static void _ignore_path_init(void);
+static void *_thread_ignore_cache(void);
 static void _thread_mutex_lock(void);
 static void _thread_mutex_unlock(void);
 
@@ -57,6 +59,7 @@ static void _thread_mutex_unlock(void);
 static FILE *(*fopen_real) (const char *, const char *);
 static pid_t(*fork_real) (void);
 static int (*open_real) (const char *, int, ...);
+static int (*open64_real) (const char *, int, ...);
 static int (*close_real) (int);
 static int (*rename_real) (const char *, const char *);
 static int (*link_real) (const char *, const char *);
@@ -67,6 +70,9 @@ static void (*_exit_real) (int);
 static int (*pthread_mutex_lock_real) (pthread_mutex_t *);
 static int (*pthread_mutex_unlock_real) (pthread_mutex_t *);
 static pthread_t(*pthread_self_real) (void);
+static int (*pthread_key_create_real) (pthread_key_t *, void (*)(void *));
+static void *(*pthread_getspecific_real) (pthread_key_t);
+static int (*pthread_setspecific_real) (pthread_key_t, const void *);
 
 // These will be used to synchronize access to this library's
 // static data where required. Most static data is initialized
@@ -76,6 +82,20 @@ static pthread_t(*pthread_self_real) (void);
 static pthread_mutex_t StaticDataAccessMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t ExecFlushMutex = PTHREAD_MUTEX_INITIALIZER;
 
+// The exit status, where it can be learned without extra processes.
+static int ExitStatusKnown;
+static int ExitStatusSeen;
+static int ExitHandlerSet;
+static int FinalizeDeferred;
+
+// The env block last composed for an exec of environ itself,
+// along with a copy of the environ strings it was composed from.
+static char **EnvBlock;
+static size_t EnvBlockSize;
+static char *EnvBlockSource;
+static size_t EnvBlockSourceCount;
+static unsigned long EnvBlockPropGeneration;
+
 #if defined(__CYGWIN__)
 /*
  * An un(der)documented fact about Cygwin is that LD_PRELOAD works as long as you
@@ -131,6 +151,10 @@ int __attribute__((__stdcall__)) DllMain(void *hinstDLL, unsigned long fdwReason
 #define fopen		fopen_real
 #define fork		fork_real
 #define open		open_real
+#if !defined(open64)
+#define open64		open64_real
+#define OPEN64_REAL
+#endif	/*open64*/
 #define close		close_real
 #define rename		rename_real
 #define link(p1,p2)	link_real(p1,p2)
@@ -147,6 +171,9 @@ int __attribute__((__stdcall__)) DllMain(void *hinstDLL, unsigned long fdwReason
 #undef fopen
 #undef fork
 #undef open
+#if defined(OPEN64_REAL)
+#undef open64
+#endif	/*OPEN64_REAL*/
 #undef close
 #undef rename
 #undef link
@@ -154,16 +181,21 @@ int __attribute__((__stdcall__)) DllMain(void *hinstDLL, unsigned long fdwReason
 #undef unlink
 #undef _exit
 
+#include "Interposer/chdir.h"
 #include "Interposer/close.h"
 #include "Interposer/exec.h"
 #include "Interposer/exit.h"
 #include "Interposer/fork.h"
 #include "Interposer/link.h"
 #include "Interposer/open.h"
+#include "Interposer/spawn.h"
+#include "Interposer/syscall.h"
 #include "Interposer/threads.h"
 #include "Interposer/libinterposer.h"
 
-//WRAP(int, chdir, (const char *path), path)
+#if defined(HAVE_OPENAT2)
+#include <linux/openat2.h>
+#endif	/*HAVE_OPENAT2*/
 
 #if defined(BSD)
 #include <sys/mount.h>
@@ -194,6 +226,26 @@ _get_real(const char *fcn)
     return fcnptr;
 }
 
+#if defined(__GLIBC__)
+// Records the exit status, which the library finalizer isn't told.
+// This covers both exit() and a return from main(). Exit handlers
+// run in reverse order of registration and this one is registered
+// at library init time, before the runtime linker registers the
+// handler which runs library finalizers, so in practice it runs
+// after our finalizer, which has left its work to be finished here.
+static void
+_on_exit(int status, void *arg)
+{
+    UNUSED(arg);
+    ExitStatusSeen = status & 0377;
+    ExitStatusKnown = 1;
+    if (FinalizeDeferred) {
+	FinalizeDeferred = 0;
+	interposed_finalize();
+    }
+}
+#endif	/*__GLIBC__*/
+
 /// This function will be called at the <i>earliest possible
 /// opportunity</i> once the audited command is fully initialized
 /// and running. This generally means at the first interposed
@@ -217,6 +269,9 @@ interposed_late_init(const char *call)
     fopen_real	 = (FILE *(*)(const char *, const char *))_get_real("fopen");
     fork_real	 = (pid_t(*)(void))_get_real("fork");
     open_real	 = (int(*)(const char *, int, ...))_get_real("open");
+#if defined(OPEN64_REAL)
+    open64_real	 = (int(*)(const char *, int, ...))_get_real("open64");
+#endif	/*OPEN64_REAL*/
     close_real	 = (int(*)(int))_get_real("close");
     rename_real	 = (int(*)(const char *, const char *))_get_real("rename");
     link_real	 = (int(*)(const char *, const char *))_get_real("link");
@@ -233,48 +288,221 @@ interposed_late_init(const char *call)
 	}
 	// Turn on the auditor and go.
 	interposer_set_active(1);
+
+	// Cache the cwd; chdirs which bypass the wrappers are caught
+	// by pn.c revalidating it against ".".
+	pn_cache_init();
+
+#if defined(__GLIBC__)
+	// Arrange to be told the exit status (see interposed_finalize).
+	if (on_exit(_on_exit, NULL)) {
+	    putil_syserr(0, "on_exit");
+	} else {
+	    ExitHandlerSet = 1;
+	}
+#endif	/*__GLIBC__*/
     } else {
 	interposer_set_active(0);
     }
 }
 
+// Paths which are ignored by prefix, or by exact match, are kept
+// in a trie built at init time. It holds the fixed list below plus
+// any literal alternatives found in Audit.Ignore.Path.RE, so in the
+// common case where that's a list of directories the regex need
+// never be run at all.
+/// @cond static
+#define IGNORE_PREFIX		0x1
+#define IGNORE_EXACT		0x2
+
+#define IGNORE_CACHE_SLOTS	1024
+/// @endcond static
+
+/// A node in the trie of ignorable paths.
+typedef struct ignore_node_s {
+    struct ignore_node_s *in_kids;	///< first child
+    struct ignore_node_s *in_next;	///< next sibling
+    char in_c;				///< the character matched here
+    char in_ends;			///< IGNORE_PREFIX and/or IGNORE_EXACT
+} ignore_node_s;
+
+/// An entry in the cache of verdicts from _ignore_path().
+typedef struct {
+    CS ic_path;				///< the absolute path
+    int ic_ignore;			///< the verdict
+} ignore_cache_s;
+
+static ignore_node_s IgnoreTrie;
+static ignore_cache_s *IgnoreCache;
+static int IgnorePathRELiteral;
+static int IgnorePathArmed;
+
+// Internal service routine. Adds a path or path prefix to the trie.
+static void
+_ignore_trie_add(CCS path, int exact, void *data)
+{
+    ignore_node_s *node, *kid;
+
+    UNUSED(data);
+
+    for (node = &IgnoreTrie; *path; path++, node = kid) {
+	for (kid = node->in_kids; kid; kid = kid->in_next) {
+	    if (kid->in_c == *path) {
+		break;
+	    }
+	}
+	if (!kid) {
+	    kid = (ignore_node_s *)putil_calloc(1, sizeof(*kid));
+	    kid->in_c = *path;
+	    kid->in_next = node->in_kids;
+	    node->in_kids = kid;
+	}
+    }
+    node->in_ends |= exact ? IGNORE_EXACT : IGNORE_PREFIX;
+}
+
+// Internal service routine. Returns true if the path begins with,
+// or is equal to, an entry in the trie as appropriate.
+static int
+_ignore_trie_match(CCS path)
+{
+    ignore_node_s *node, *kid;
+
+    for (node = &IgnoreTrie; *path; path++, node = kid) {
+	if (node->in_ends & IGNORE_PREFIX) {
+	    return 1;
+	}
+	for (kid = node->in_kids; kid; kid = kid->in_next) {
+	    if (kid->in_c == *path) {
+		break;
+	    }
+	}
+	if (!kid) {
+	    return 0;
+	}
+    }
+
+    return node->in_ends != 0;
+}
+
+// Internal service routine. Loads the fixed list into the trie.
+static void
+_ignore_trie_init(void)
+{
+    static CCS prefixes[] = {
+	// Typical "special" Unix file-like items.
+	"/proc/", "/xfn/", "/dev/", "/devices/",
+#if defined(sun)
+	// The Sun Workshop (aka Forte etc) (5.0? 6.0) compiler apparently
+	// creates and does not remove a file beginning like this.
+	"/tmp/workshop",
+#elif defined(__APPLE__)
+	// Vide infra. This is where OS X puts its core files.
+	"/cores/",
+#endif	/*__APPLE__*/
+	NULL
+    };
+    static CCS exacts[] = {
+#if defined(linux) || defined(__CYGWIN__)
+	// On Linux all processes seem to open /etc/mtab.
+	// And we ourselves need to open /proc/mounts.
+	"/etc/mtab", "/proc/mounts",
+#endif	/*linux*/
+	NULL
+    };
+    CCS *pp;
+
+    for (pp = prefixes; *pp; pp++) {
+	_ignore_trie_add(*pp, 0, NULL);
+    }
+    for (pp = exacts; *pp; pp++) {
+	_ignore_trie_add(*pp, 1, NULL);
+    }
+}
+
+// Internal service routine. Compiles the ignore RE, adds its literal
+// parts to the trie, and turns on the cache, which can't be trusted
+// until the RE is known. This is put off until the first path needs
+// checking since many processes (sh -c, echo ...) never open a file.
+static void
+_ignore_path_re_init(void)
+{
+    if ((IgnorePathRE = re_init_prop__(P_AUDIT_IGNORE_PATH_RE))) {
+	IgnorePathRELiteral = re_literals_prop__(P_AUDIT_IGNORE_PATH_RE,
+						 _ignore_trie_add, NULL);
+    }
+
+    IgnoreCache = (ignore_cache_s *)putil_calloc(IGNORE_CACHE_SLOTS,
+						sizeof(*IgnoreCache));
+}
+
+// Internal service routine. Releases a cache of ignore verdicts.
+static void
+_ignore_cache_free(ignore_cache_s *cache)
+{
+    int i;
+
+    if (cache) {
+	for (i = 0; i < IGNORE_CACHE_SLOTS; i++) {
+	    putil_free(cache[i].ic_path);
+	}
+	putil_free(cache);
+    }
+}
+
+// Called from _init_auditlib() to say that the ignore RE applies
+// from here on. See _ignore_path_re_init().
+static void
+_ignore_path_init(void)
+{
+    IgnorePathArmed = 1;
+}
+
 // Internal service routine. There are certain files we truly don't
 // care about and just want to ignore as early as possible.
+// The same paths tend to be seen over and over so verdicts are
+// cached. In a threaded program each thread has a cache of its
+// own and everything else is set up before the first thread is
+// created (see _thread_buffers_init), so no lock is needed.
 static int
 _ignore_path(const char *path)
 {
     int rc = 0;
     const char *pend;
+    ignore_cache_s *ic = NULL;
+
+    if (!IgnoreTrie.in_kids) {
+	_ignore_trie_init();
+    }
+    if (IgnorePathArmed && !IgnoreCache) {
+	_ignore_path_re_init();
+    }
+
+    if (IgnoreCache) {
+	if (!(ic = (ignore_cache_s *)_thread_ignore_cache())) {
+	    ic = IgnoreCache;
+	}
+	ic += util_hash_fun_default(path) % IGNORE_CACHE_SLOTS;
+	if (ic->ic_path && !strcmp(ic->ic_path, path)) {
+	    return ic->ic_ignore;
+	}
+    }
 
     pend = endof(path);
 
-    if (!strncmp(path, "/proc/", 6) || !strncmp(path, "/xfn/", 5) ||
-	!strncmp(path, "/dev/", 5) || !strncmp(path, "/devices/", 9)) {
-	// Typical "special" Unix file-like items.
+    if (_ignore_trie_match(path)) {
+	// See _ignore_trie_init() for the fixed list.
 	rc = 1;
     } else if (strstr(path, "/.ccache/")) {
 	// There's no good reason to use ccache with AO but try to
 	// behave reasonably if it happens anyway.
 	rc = 1;
-#if defined(sun)
-    } else if (!strncmp(path, "/tmp/workshop", 13)) {
-	// The Sun Workshop (aka Forte etc) (5.0? 6.0) compiler apparently
-	// creates and does not remove a file beginning like this.
-	rc = 1;
-#elif defined(linux) || defined(__CYGWIN__)
-    } else if (!strcmp(path, "/etc/mtab") || !strcmp(path, "/proc/mounts")) {
-	// On Linux all processes seem to open /etc/mtab.
-	// And we ourselves need to open /proc/mounts.
-	rc = 1;
-#elif defined(__APPLE__)
+#if defined(__APPLE__)
     } else if (strstr(path, "-Tmp-")) {
 	// There's a lot of screwy stuff going on under /private/var/...
 	// in OS X 10.5. No idea what these files are but they certainly
 	// appear to be temp files based on their names.
 	rc = 1;
-    } else if (!strncmp(path, "/cores/", 7)) {
-	// Vide infra. This is where OS X puts its core files.
-	rc = 1;
 #endif	/*__APPLE__*/
     } else if ((pend - 5) >= path && !strcmp(pend - 5, "/core")) {
 	// Nothing more embarrassing than dumping core (esp. if it's
@@ -296,13 +524,21 @@ _ignore_path(const char *path)
 	// The shell tends to keep here-documents in a file called
 	// "/tmp/shnnnnn" where "nnnnn" is based on the pid.
 	rc = 1;
-    } else if (IgnorePathRE && re_match__(IgnorePathRE, path)) {
-	// User-configurable set of ignorable files. We may
-	// eventually want to shift the hard-wired patterns
-	// above to this model.
+    } else if (IgnorePathRE && !IgnorePathRELiteral &&
+	    re_match__(IgnorePathRE, path)) {
+	// User-configurable set of ignorable files. Any literal
+	// alternatives were already checked via the trie.
 	rc = 1;
     }
 
+    if (ic) {
+	if (ic->ic_path) {
+	    putil_free(ic->ic_path);
+	}
+	ic->ic_path = putil_strdup(path);
+	ic->ic_ignore = rc;
+    }
+
     return rc;
 }
 
@@ -324,6 +560,310 @@ _thread_mutex_unlock(void)
     }
 }
 
+// In a threaded program each thread stages the PAs it records in a
+// buffer of its own, found via thread-specific data, rather than
+// inserting them into the CA under StaticDataAccessMutex. Buffers are
+// chained together as they're created and drained into the CA, with
+// the lock held, just before it's flushed. Since the owning thread
+// pushes onto its buffer and the flusher takes the whole list with a
+// single atomic exchange the two never need to wait for each other.
+// The flusher hands the emptied list nodes back the same way for
+// reuse. The buffer also carries the thread's own pathname and
+// ignore caches so recording a PA takes no lock at all.
+// Without the compiler's atomic builtins we fall back to recording
+// directly into the CA.
+#if defined(__GNUC__)
+
+/// @cond static
+typedef struct thread_pa_s {
+    pa_o tp_pa;
+    struct thread_pa_s *tp_next;
+} thread_pa_s;
+
+typedef struct thread_buffer_s {
+    thread_pa_s *tb_pending;		// newest first
+    thread_pa_s *tb_returned;		// drained nodes, from the flusher
+    thread_pa_s *tb_spare;		// drained nodes, owner only
+    pn_cache_o tb_pn_cache;		// owner only
+    ignore_cache_s *tb_ignore_cache;	// owner only
+    int tb_exited;			// set when the owner is gone
+    struct thread_buffer_s *tb_next;
+} thread_buffer_s;
+/// @endcond static
+
+static thread_buffer_s *ThreadBuffers;
+static pthread_key_t ThreadBufferKey;
+static int ThreadBufferKeyValid;
+
+// Internal service routine. Frees a list of nodes.
+static void
+_thread_pa_list_free(thread_pa_s *tp)
+{
+    thread_pa_s *next;
+
+    for (; tp; tp = next) {
+	next = tp->tp_next;
+	putil_free(tp);
+    }
+}
+
+// Destructor for thread-specific data, run as each thread exits.
+// Nothing more can be added to the buffer so it's freed once drained,
+// but what only the owner used can go now.
+static void
+_thread_buffer_exited(void *data)
+{
+    thread_buffer_s *tb = (thread_buffer_s *)data;
+
+    pn_cache_destroy(tb->tb_pn_cache);
+    tb->tb_pn_cache = NULL;
+    _ignore_cache_free(tb->tb_ignore_cache);
+    tb->tb_ignore_cache = NULL;
+    _thread_pa_list_free(tb->tb_spare);
+    tb->tb_spare = NULL;
+
+    _thread_mutex_lock();
+    _thread_pa_list_free(tb->tb_returned);
+    tb->tb_returned = NULL;
+    tb->tb_exited = 1;
+    _thread_mutex_unlock();
+}
+
+// Called while still single threaded, just before the first thread
+// is created. Anything set up on first use by the unlocked parts of
+// _pa_record() is set up now instead.
+static void
+_thread_buffers_init(void)
+{
+    if (!IgnoreTrie.in_kids) {
+	_ignore_trie_init();
+    }
+    if (IgnorePathArmed && !IgnoreCache) {
+	_ignore_path_re_init();
+    }
+    _allowed_write_path_re_init();
+
+    pthread_key_create_real = _get_real("pthread_key_create");
+    pthread_getspecific_real = _get_real("pthread_getspecific");
+    pthread_setspecific_real = _get_real("pthread_setspecific");
+    if (!pthread_key_create_real(&ThreadBufferKey, _thread_buffer_exited)) {
+	ThreadBufferKeyValid = 1;
+    }
+}
+
+static int
+_thread_buffering(void)
+{
+    return ThreadBufferKeyValid;
+}
+
+// Returns the calling thread's buffer, creating it if need be.
+static thread_buffer_s *
+_thread_buffer(void)
+{
+    thread_buffer_s *tb;
+
+    if (!(tb = (thread_buffer_s *)pthread_getspecific_real(ThreadBufferKey))) {
+	tb = (thread_buffer_s *)putil_calloc(1, sizeof(*tb));
+	tb->tb_pn_cache = pn_cache_new();
+	_thread_mutex_lock();
+	tb->tb_next = ThreadBuffers;
+	ThreadBuffers = tb;
+	_thread_mutex_unlock();
+	(void)pthread_setspecific_real(ThreadBufferKey, tb);
+    }
+
+    return tb;
+}
+
+// Returns the calling thread's pathname cache if buffering.
+static pn_cache_o
+_thread_pn_cache(void)
+{
+    return ThreadBufferKeyValid ? _thread_buffer()->tb_pn_cache : NULL;
+}
+
+// Returns the calling thread's ignore cache if buffering, creating
+// it if need be. See _ignore_path().
+static void *
+_thread_ignore_cache(void)
+{
+    thread_buffer_s *tb;
+
+    if (!ThreadBufferKeyValid) {
+	return NULL;
+    }
+
+    tb = _thread_buffer();
+    if (!tb->tb_ignore_cache) {
+	tb->tb_ignore_cache = (ignore_cache_s *)putil_calloc(
+	    IGNORE_CACHE_SLOTS, sizeof(*tb->tb_ignore_cache));
+    }
+
+    return tb->tb_ignore_cache;
+}
+
+// Counts a PA towards the next flush, returning the new count.
+// Only buffered PAs are counted without the lock.
+static unsigned long
+_thread_count_pa(void)
+{
+    return __atomic_add_fetch(&PAsSinceFlush, 1, __ATOMIC_RELAXED);
+}
+
+// Adds a PA to the calling thread's buffer, creating it if need be.
+static void
+_thread_buffer_pa(pa_o pa)
+{
+    thread_buffer_s *tb;
+    thread_pa_s *tp;
+
+    tb = _thread_buffer();
+
+    if (!tb->tb_spare) {
+	tb->tb_spare = __atomic_exchange_n(&tb->tb_returned, NULL,
+	    __ATOMIC_ACQUIRE);
+    }
+    if ((tp = tb->tb_spare)) {
+	tb->tb_spare = tp->tp_next;
+    } else {
+	tp = (thread_pa_s *)putil_malloc(sizeof(*tp));
+    }
+    tp->tp_pa = pa;
+    tp->tp_next = __atomic_load_n(&tb->tb_pending, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&tb->tb_pending, &tp->tp_next, tp,
+	    0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	continue;
+    }
+}
+
+// Moves every buffered PA into the current CA, in the order each
+// thread recorded them, and gives the nodes back to their owners.
+// The caller must hold the lock.
+static void
+_thread_buffers_merge(void)
+{
+    thread_buffer_s *tb, **tbp;
+    thread_pa_s *tp, *next, *list, *last;
+
+    for (tbp = &ThreadBuffers; (tb = *tbp); ) {
+	tp = __atomic_exchange_n(&tb->tb_pending, NULL, __ATOMIC_ACQUIRE);
+	for (list = NULL; tp; tp = next) {
+	    next = tp->tp_next;
+	    tp->tp_next = list;
+	    list = tp;
+	}
+	for (tp = list, last = NULL; tp; last = tp, tp = tp->tp_next) {
+	    if (CurrentCA) {
+		_pa_enter(tp->tp_pa);
+	    } else {
+		pa_destroy(tp->tp_pa);
+	    }
+	    tp->tp_pa = NULL;
+	}
+	if (tb->tb_exited) {
+	    _thread_pa_list_free(list);
+	    *tbp = tb->tb_next;
+	    putil_free(tb);
+	} else {
+	    if (last) {
+		last->tp_next = __atomic_load_n(&tb->tb_returned,
+		    __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&tb->tb_returned,
+			&last->tp_next, list, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		    continue;
+		}
+	    }
+	    tbp = &tb->tb_next;
+	}
+    }
+}
+
+// On the child side of a fork only the forking thread survives.
+// Anything the others buffered belongs to the parent.
+static void
+_thread_buffers_forked(void)
+{
+    thread_buffer_s *tb, *next;
+    thread_pa_s *tp, *tpnext;
+    void *mine;
+
+    if (!ThreadBufferKeyValid) {
+	return;
+    }
+
+    mine = pthread_getspecific_real(ThreadBufferKey);
+    for (tb = ThreadBuffers, ThreadBuffers = NULL; tb; tb = next) {
+	next = tb->tb_next;
+	for (tp = tb->tb_pending; tp; tp = tpnext) {
+	    tpnext = tp->tp_next;
+	    pa_destroy(tp->tp_pa);
+	    putil_free(tp);
+	}
+	if (tb == mine) {
+	    tb->tb_pending = NULL;
+	    tb->tb_next = NULL;
+	    ThreadBuffers = tb;
+	} else {
+	    pn_cache_destroy(tb->tb_pn_cache);
+	    _ignore_cache_free(tb->tb_ignore_cache);
+	    _thread_pa_list_free(tb->tb_spare);
+	    _thread_pa_list_free(tb->tb_returned);
+	    putil_free(tb);
+	}
+    }
+}
+
+#else	/*__GNUC__*/
+
+static void
+_thread_buffers_init(void)
+{
+}
+
+static int
+_thread_buffering(void)
+{
+    return 0;
+}
+
+static pn_cache_o
+_thread_pn_cache(void)
+{
+    return NULL;
+}
+
+static void *
+_thread_ignore_cache(void)
+{
+    return NULL;
+}
+
+static unsigned long
+_thread_count_pa(void)
+{
+    return ++PAsSinceFlush;
+}
+
+static void
+_thread_buffer_pa(pa_o pa)
+{
+    UNUSED(pa);
+}
+
+static void
+_thread_buffers_merge(void)
+{
+}
+
+static void
+_thread_buffers_forked(void)
+{
+}
+
+#endif	/*__GNUC__*/
+
 // Note that many programs walk through PATH calling exec on
 // each possible executable path. Thus this may be called many
 // times in succession and fail each time but the last.
@@ -365,6 +905,108 @@ _pre_exec(const char *call, const char *path,
     return rc;
 }
 
+// If the host process assembles a custom environment which
+// does not retain LD_PRELOAD, that process branch will be
+// unaudited. This is a hole we ought to plug but it seems
+// unlikely so for now we will just warn about it. If it
+// ever actually happens it should be easy enough to fix.
+static void
+_check_preload(const char *call, char *const *envp)
+{
+    char *const *ep;
+
+    for (ep = envp; *ep; ep++) {
+	if (!strncmp(*ep, PRELOAD_EV, strlen(PRELOAD_EV))) {
+	    return;
+	}
+    }
+
+    putil_warn("%s setting lost in %s() call", PRELOAD_EV, call);
+}
+
+// Internal service routine. Returns true iff environ holds the same
+// strings as when EnvBlock was composed. The caller must hold the lock.
+static int
+_environ_unchanged(void)
+{
+    char *const *ep;
+    const char *sp;
+    size_t count;
+
+    sp = EnvBlockSource;
+    for (ep = environ, count = 0; *ep; ep++, count++) {
+	if (count == EnvBlockSourceCount || strcmp(*ep, sp)) {
+	    return 0;
+	}
+	sp += strlen(sp) + 1;
+    }
+
+    return count == EnvBlockSourceCount;
+}
+
+// Returns the env block for an exec of environ with our properties
+// forced back in, copied into the supplied buffer since another
+// thread may replace the cached one at any time. Composing it means
+// formatting every exported property and sorting the lot, so the
+// result is kept along with a copy of the environ strings it was
+// composed from, until they or the properties change. The strings
+// themselves are compared since programs may edit environ in place
+// as well as through the setenv() family. If the buffer is missing
+// or too small the size needed is stored and NULL returned. Since
+// most execs happen in a child just after fork, the fork wrapper
+// calls this too so the child inherits a current block.
+static char **
+_environ_block(char **buf, size_t *sizep)
+{
+    char **bp;
+
+    if (!environ) {
+	*sizep = 0;
+	return NULL;
+    }
+
+    _thread_mutex_lock();
+
+    if (!EnvBlock || EnvBlockPropGeneration != prop_get_generation() ||
+	    !_environ_unchanged()) {
+	char *const *ep;
+	size_t len;
+	char *sp;
+
+	putil_free(EnvBlock);
+	EnvBlockSize = prop_new_env_block_sizeA(environ);
+	EnvBlock = (char **)putil_calloc(1, EnvBlockSize);
+	(void)prop_custom_envA(EnvBlock, environ);
+
+	for (ep = environ, len = 0; *ep; ep++) {
+	    len += strlen(*ep) + 1;
+	}
+	putil_free(EnvBlockSource);
+	EnvBlockSource = sp = (char *)putil_malloc(len + 1);
+	for (ep = environ; *ep; ep++) {
+	    strcpy(sp, *ep);
+	    sp += strlen(sp) + 1;
+	}
+	EnvBlockSourceCount = ep - environ;
+	EnvBlockPropGeneration = prop_get_generation();
+    }
+
+    if (buf && *sizep >= EnvBlockSize) {
+	// The block holds its own strings, so it's relocatable.
+	memcpy(buf, EnvBlock, EnvBlockSize);
+	for (bp = buf; *bp; bp++) {
+	    *bp = (char *)buf + (*bp - (char *)EnvBlock);
+	}
+    } else {
+	*sizep = EnvBlockSize;
+	buf = NULL;
+    }
+
+    _thread_mutex_unlock();
+
+    return buf;
+}
+
 /// Interposes over the execv() function.
 /// @param[in] call     the name of the interposed function in string form
 /// @param[in] next     a pointer to the interposed function
@@ -420,8 +1062,7 @@ execve_wrapper(const char *call,
 	}
     } else {
 	size_t plen;
-	char **pblock, **ep;
-	int found;
+	char **pblock;
 
 	// If the audited program uses exec[lv]e to compose
 	// its own environment, we need special-case code to force our
@@ -429,25 +1070,22 @@ execve_wrapper(const char *call,
 	// The code below will return a new env block with our
 	// properties re-exported to it. The envp starts at (pblock+1).
 
-	plen = prop_new_env_block_sizeA(envp);
-	pblock = (char **)alloca(plen);
-	memset(pblock, 0, plen);
-	(void)prop_custom_envA(pblock, envp);
-
-	// If the host process assembles a custom environment which
-	// does not retain LD_PRELOAD, that process branch will be
-	// unaudited. This is a hole we ought to plug but it seems
-	// unlikely so for now we will just warn about it. If it
-	// ever actually happens it should be easy enough to fix.
-	for (found = 0, ep = pblock + 1; *ep; ep++) {
-	    if (!strncmp(*ep, PRELOAD_EV, strlen(PRELOAD_EV))) {
-		found = 1;
-		break;
+	if (envp == environ) {
+	    // Usually once round; environ could change in between.
+	    for (plen = 0, pblock = NULL;
+		    !(pblock = _environ_block(pblock, &plen)) && plen; ) {
+		pblock = (char **)alloca(plen);
 	    }
+	} else {
+	    pblock = NULL;
 	}
-	if (!found) {
-	    putil_warn("%s setting lost in exev[lv]e() call", PRELOAD_EV);
+	if (!pblock) {
+	    plen = prop_new_env_block_sizeA(envp);
+	    pblock = (char **)alloca(plen);
+	    memset(pblock, 0, plen);
+	    (void)prop_custom_envA(pblock, envp);
 	}
+	_check_preload(call, pblock + 1);
 
 	if (dbg) {
 	    ret = (*next)(argv[0], argv, pblock + 1);
@@ -567,6 +1205,47 @@ execvp_wrapper(const char *call,
  * corresponding execv*_wrapper() functions.
  **************************************************************/
 
+/// Interposes over the chdir() function.
+/// The pathname cache must learn of any change of directory.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[in] path     the new working directory
+/// @return same as the wrapped function
+/*static*/ int
+chdir_wrapper(const char *call, int (*next) (const char *), const char *path)
+{
+    int ret;
+    WRAPPER_DEBUG("ENTERING chdir_wrapper() => %p [%s]\n", next, path);
+
+    UNUSED(call);
+
+    if (!(ret = (*next)(path))) {
+	pn_cache_cwd_changed();
+    }
+
+    return ret;
+}
+
+/// Interposes over the fchdir() function.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[in] fildes   a descriptor open on the new working directory
+/// @return same as the wrapped function
+/*static*/ int
+fchdir_wrapper(const char *call, int (*next) (int), int fildes)
+{
+    int ret;
+    WRAPPER_DEBUG("ENTERING fchdir_wrapper() => %p [%d]\n", next, fildes);
+
+    UNUSED(call);
+
+    if (!(ret = (*next)(fildes))) {
+	pn_cache_cwd_changed();
+    }
+
+    return ret;
+}
+
 /// Interposes over the fork() function.
 /// @param[in] call     the name of the interposed function in string form
 /// @param[in] next     a pointer to the interposed function
@@ -575,6 +1254,7 @@ execvp_wrapper(const char *call,
 fork_wrapper(const char *call, pid_t(*next) (void))
 {
     pid_t pid;
+    size_t plen;
     WRAPPER_DEBUG("ENTERING fork_wrapper() => %p [%s]\n", next, interposer_get_cmdline());
 
     // A subtlety: try the following command on Solaris:
@@ -599,6 +1279,9 @@ fork_wrapper(const char *call, pid_t(*next) (void))
     // exist at print time and its creat record will precede the rename.
     _audit_flush(call);
 
+    // Children often exec with environ; save them composing its block.
+    (void)_environ_block(NULL, &plen);
+
     pid = (*next)();
 
     // Child side.
@@ -612,6 +1295,15 @@ fork_wrapper(const char *call, pid_t(*next) (void))
 	// the write to this static datum ought to be thread safe.
 	AuditFD = _audit_open();
 
+	// Drop anything buffered by threads which didn't come along.
+	_thread_buffers_forked();
+
+	// A persistent monitor connection belongs to the parent.
+	// Closing this copy of it leaves the parent's undisturbed.
+	if (ReportPersistent) {
+	    _monitor_close(&ReportSocket, 0);
+	}
+
 	// Mark this copy of the CA as not "started" because
 	// no SOA has been, or will be, sent for this pid.
 	// Note that we leave pid and ppid alone. This is a bit
@@ -711,7 +1403,99 @@ popen_wrapper(const char *call,
     return ret;
 }
 
-// We probably should have an interposer for posix_spawn here ...
+// Internal service routine shared by the posix_spawn() wrappers.
+// The new process starts life by exec-ing from within libc so
+// there's no window in which to audit anything on its side. In
+// particular, files opened by 'file_actions' are not seen since
+// the opaque action list can't be examined portably. The parent
+// must flush, for the same ordering reasons given in the fork()
+// wrapper; flushing also collects any outstanding SOA ack. The
+// child's environment needs our properties only if the caller
+// supplied a custom one, since changes to our own are always made
+// in place within environ.
+static int
+_spawn(const char *call,
+       int (*next) (pid_t *, const char *,
+		    const posix_spawn_file_actions_t *,
+		    const posix_spawnattr_t *,
+		    char *const argv[], char *const envp[]),
+       pid_t *pid, const char *path,
+       const posix_spawn_file_actions_t *file_actions,
+       const posix_spawnattr_t *attrp,
+       char *const argv[], char *const envp[])
+{
+    size_t plen;
+    char **pblock;
+
+    _audit_flush(call);
+
+    if (!envp || envp == environ) {
+	return (*next)(pid, path, file_actions, attrp, argv, envp);
+    }
+
+    plen = prop_new_env_block_sizeA(envp);
+    pblock = (char **)alloca(plen);
+    memset(pblock, 0, plen);
+    (void)prop_custom_envA(pblock, envp);
+    _check_preload(call, pblock + 1);
+
+    return (*next)(pid, path, file_actions, attrp, argv, pblock + 1);
+}
+
+/// Interposes over the posix_spawn() function.
+/// Unlike vfork() this can be wrapped without converting it
+/// to a fork, so the caller keeps whatever efficiency
+/// advantage the implementation offers.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[out] pid     same as the wrapped function
+/// @param[in] path     the pathname of the executable file
+/// @param[in] file_actions  same as the wrapped function
+/// @param[in] attrp    same as the wrapped function
+/// @param[in] argv     an argument vector for the new command
+/// @param[in] envp     an environment vector for the new command
+/// @return same as the wrapped function
+/*static*/ int
+posix_spawn_wrapper(const char *call,
+		    int (*next) (pid_t *, const char *,
+				 const posix_spawn_file_actions_t *,
+				 const posix_spawnattr_t *,
+				 char *const argv[], char *const envp[]),
+		    pid_t *pid, const char *path,
+		    const posix_spawn_file_actions_t *file_actions,
+		    const posix_spawnattr_t *attrp,
+		    char *const argv[], char *const envp[])
+{
+    WRAPPER_DEBUG("ENTERING posix_spawn_wrapper() => %p [%s ...]\n", next, path);
+
+    return _spawn(call, next, pid, path, file_actions, attrp, argv, envp);
+}
+
+/// Interposes over the posix_spawnp() function.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[out] pid     same as the wrapped function
+/// @param[in] file     the name of the executable file
+/// @param[in] file_actions  same as the wrapped function
+/// @param[in] attrp    same as the wrapped function
+/// @param[in] argv     an argument vector for the new command
+/// @param[in] envp     an environment vector for the new command
+/// @return same as the wrapped function
+/*static*/ int
+posix_spawnp_wrapper(const char *call,
+		     int (*next) (pid_t *, const char *,
+				  const posix_spawn_file_actions_t *,
+				  const posix_spawnattr_t *,
+				  char *const argv[], char *const envp[]),
+		     pid_t *pid, const char *file,
+		     const posix_spawn_file_actions_t *file_actions,
+		     const posix_spawnattr_t *attrp,
+		     char *const argv[], char *const envp[])
+{
+    WRAPPER_DEBUG("ENTERING posix_spawnp_wrapper() => %p [%s ...]\n", next, file);
+
+    return _spawn(call, next, pid, file, file_actions, attrp, argv, envp);
+}
 
 static void
 _enable_thread_support(const char *call)
@@ -735,6 +1519,7 @@ _enable_thread_support(const char *call)
 	pthread_mutex_lock_real = _get_real("pthread_mutex_lock");
 	pthread_mutex_unlock_real = _get_real("pthread_mutex_unlock");
 	pthread_self_real = _get_real("pthread_self");
+	_thread_buffers_init();
     }
 }
 
@@ -925,8 +1710,67 @@ __open64_2_wrapper(const char *call,
 
 #if defined(AT_FDCWD)
 
-/// Interposes over the openat() function. This is currently a
-/// Solaris-only API but other platforms may imitate it someday.
+// Returns a copy of the path, made absolute if it's relative to a
+// directory descriptor other than AT_FDCWD as in the *at() family,
+// or NULL if that can't be worked out. The result must be freed.
+static CS
+_at_path(int fildes, const char *path)
+{
+    char procbuf[512];
+    CCS lbuf;
+    CS atpath;
+
+    if (fildes == (int)AT_FDCWD || putil_is_absolute(path)) {
+	return putil_strdup(path);
+    }
+
+#if defined(linux)
+    snprintf(procbuf, sizeof(procbuf), "/proc/self/fd/%d", fildes);
+#else	/*linux*/
+    snprintf(procbuf, sizeof(procbuf), "/proc/%ld/path/%d",
+	(long)getpid(), fildes);
+#endif	/*linux*/
+
+    if (!(lbuf = putil_readlink(procbuf))) {
+	putil_warn("can't resolve %s relative to fd=%d", path, fildes);
+	return NULL;
+    }
+
+    if (asprintf(&atpath, "%s/%s", lbuf, path) < 0) {
+	atpath = NULL;
+    }
+    putil_free(lbuf);
+
+    return atpath;
+}
+
+// Records a successful open relative to a directory descriptor,
+// whether by openat() or openat2().
+static void
+_openat_record(const char *call, int fildes, const char *path,
+	       int oflag, int fd)
+{
+    op_e op;
+    CS atpath;
+
+    if (oflag & (O_RDWR | O_APPEND)) {
+	op = OP_APPEND;
+    } else if (oflag & O_WRONLY) {
+	op = OP_CREAT;
+    } else {
+	op = OP_READ;
+    }
+
+    if (fildes == (int)AT_FDCWD || putil_is_absolute(path)) {
+	_pa_record(call, path, NULL, fd, op);
+    } else if ((atpath = _at_path(fildes, path))) {
+	_pa_record(call, atpath, NULL, fd, op);
+	putil_free(atpath);
+    }
+}
+
+/// Interposes over the openat() function. This API began on
+/// Solaris but Linux has it too.
 /// Note: here, 'next' may refer to either openat() or openat64().
 /// Since they have the same signature they can share a wrapper.
 /// @param[in] call     the name of the interposed function in string form
@@ -948,35 +1792,7 @@ openat_wrapper(const char *call,
     saved_errno = errno;
 
     if (ret != -1) {
-	op_e op;
-
-	if (oflag & (O_RDWR | O_APPEND)) {
-	    op = OP_APPEND;
-	} else if (oflag & O_WRONLY) {
-	    op = OP_CREAT;
-	} else {
-	    op = OP_READ;
-	}
-
-	if (fildes == (int)AT_FDCWD || putil_is_absolute(path)) {
-	    _pa_record(call, path, NULL, ret, op);
-	} else {
-	    char procbuf[512];
-	    CCS lbuf;
-	    CS atpath;
-
-	    snprintf(procbuf, sizeof(procbuf), "/proc/%ld/path/%d",
-		(long)getpid(), fildes);
-
-	    if ((lbuf = putil_readlink(procbuf))) {
-		asprintf(&atpath, "%s/%s", lbuf, path);
-		_pa_record(call, atpath, NULL, ret, op);
-		putil_free(atpath);
-		putil_free(lbuf);
-	    } else {
-		putil_warn("can't resolve %s relative to fd=%d", path, fildes);
-	    }
-	}
+	_openat_record(call, fildes, path, oflag, ret);
     }
 
     errno = saved_errno;
@@ -1047,13 +1863,8 @@ creat64_wrapper(const char *call,
 		const char *path, mode_t mode)
 {
     int oflag;
-    static int (*open64_real) (const char *, int, ...);
     WRAPPER_DEBUG("ENTERING creat64_wrapper() => %p [%s ...]\n", next, path);
 
-    if (!open64_real) {
-	open64_real = (int (*)(const char *, int, ...))_get_real("open64");
-    }
-
     UNUSED(next);
     oflag = O_WRONLY | O_CREAT | O_TRUNC;
     return open64_wrapper(call, open64_real, path, oflag, mode);
@@ -1158,9 +1969,9 @@ freopen64_wrapper(const char *call,
     return freopen_wrapper(call, next, path, mode, stream);
 }
 
-/// Interposes over the close() function. We don't actually need
-/// to track closes but we do need to make sure the host program
-/// doesn't inadvertently close the audit descriptor.
+/// Interposes over the close() function. We need to make sure the
+/// host program doesn't inadvertently close the audit descriptor,
+/// and with Dcode.Close a file written through it is dcoded here.
 /// @param[in] call     the name of the interposed function in string form
 /// @param[in] next     a pointer to the interposed function
 /// @param[in] fildes   same as the wrapped function
@@ -1169,14 +1980,18 @@ freopen64_wrapper(const char *call,
 close_wrapper(const char *call, int (*next) (int), int fildes)
 {
     int ret;
+    close_pa_s cp;
 
     UNUSED(call);
 
     // For reasons of their own, some programs like to close all file
     // descriptors before an exec. This causes a problem for our
     // "private" audit descriptor so we protect it.
-    if (fildes == AuditFD) {
+    if (fildes == AuditFD || (ReportPersistent && fildes == ReportSocket)) {
 	ret = 0;
+    } else if (_pa_closing(fildes, &cp)) {
+	ret = (*next)(fildes);
+	_pa_closed(&cp, ret);
     } else {
 	ret = (*next)(fildes);
     }
@@ -1184,6 +1999,30 @@ close_wrapper(const char *call, int (*next) (int), int fildes)
     return ret;
 }
 
+/// Interposes over the fclose() function, which doesn't go through
+/// close(), only so that Dcode.Close sees files written via stdio.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[in] stream   same as the wrapped function
+/// @return same as the wrapped function
+/*static*/ int
+fclose_wrapper(const char *call, int (*next) (FILE *), FILE *stream)
+{
+    int ret;
+    close_pa_s cp;
+
+    UNUSED(call);
+
+    if (_pa_closing(fileno(stream), &cp)) {
+	ret = (*next)(stream);
+	_pa_closed(&cp, ret);
+    } else {
+	ret = (*next)(stream);
+    }
+
+    return ret;
+}
+
 /// Interposes over the mkdir() function.
 /// @param[in] call     the name of the interposed function in string form
 /// @param[in] next     a pointer to the interposed function
@@ -1285,6 +2124,59 @@ symlink_wrapper(const char *call,
     return ret;
 }
 
+// Records a successful rename, or with 'exchange' an atomic swap
+// of the two paths as by renameat2(RENAME_EXCHANGE).
+// A rename is reported as a single op on the new path which carries
+// the old one. Many tools write a temp file and rename it into place,
+// and when both happen within one group the monitor can hand the
+// temp file's known state to the final name and leave the temp path
+// out of the roadmap entirely (see ca_coalesce()). Otherwise it's
+// taken as an unlink of the old path and a create of the new.
+// An exchange leaves both paths in place with new contents, so
+// each is reported as created.
+static void
+_rename_record(const char *call, const char *oldpath, const char *newpath,
+	       int exchange)
+{
+    struct stat64 ostbuf, nstbuf;
+
+    // SUS says "rename(foo, foo)" is a no-op so we ignore that case.
+    // Should be quite rare so not a concern from a performance POV.
+    if (!stat64(oldpath, &ostbuf) && !stat64(newpath, &nstbuf)) {
+	if (ostbuf.st_ino == nstbuf.st_ino &&
+	    ostbuf.st_dev == nstbuf.st_dev && !exchange) {
+	    return;
+	}
+    }
+
+    if (exchange) {
+	_pa_record(call, oldpath, NULL, -1, OP_CREAT);
+	_pa_record(call, newpath, NULL, -1, OP_CREAT);
+    } else {
+	_pa_record(call, newpath, oldpath, -1, OP_RENAME);
+    }
+}
+
+// Like _rename_record() but for paths relative to directory descriptors.
+static void
+_renameat_record(const char *call, int fromfd, const char *oldpath,
+		 int tofd, const char *newpath, int exchange)
+{
+    CS oldat, newat;
+
+    oldat = _at_path(fromfd, oldpath);
+    newat = _at_path(tofd, newpath);
+    if (oldat && newat) {
+	_rename_record(call, oldat, newat, exchange);
+    }
+    if (oldat) {
+	putil_free(oldat);
+    }
+    if (newat) {
+	putil_free(newat);
+    }
+}
+
 /// Interposes over the rename() function.
 /// @param[in] call     the name of the interposed function in string form
 /// @param[in] next     a pointer to the interposed function
@@ -1301,34 +2193,125 @@ rename_wrapper(const char *call,
 
     ret = (*next)(oldpath, newpath);
 
-    // Renames get VERY complicated. Sometimes a file is created by
-    // one cmd and renamed in another, and we can't be sure in
-    // what order the audit records will arrive. Current thinking
-    // is that it's simplest to report a rename as an unlink followed
-    // instantly by a create.  This may seem backward since rename
-    // was invented to provide the atomicity that unlink+create
-    // can't, but atomicity doesn't matter to us at recording time
-    // since by now the operation has already succeeded.
-    // Simplicity of aggregation is the priority.
+    if (ret == 0) {
+	_rename_record(call, oldpath, newpath, 0);
+    }
+
+    return ret;
+}
+
+/// Interposes over the renameat() function.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[in] fromfd   same as the wrapped function
+/// @param[in] oldpath  same as the wrapped function
+/// @param[in] tofd     same as the wrapped function
+/// @param[in] newpath  same as the wrapped function
+/// @return same as the wrapped function
+/*static*/ int
+renameat_wrapper(const char *call,
+		 int (*next) (int, const char *, int, const char *),
+		 int fromfd, const char *oldpath, int tofd, const char *newpath)
+{
+    int ret, saved_errno;
+    WRAPPER_DEBUG("ENTERING renameat_wrapper() => %p [%s >> %s]\n", next, oldpath, newpath);
+
+    ret = (*next)(fromfd, oldpath, tofd, newpath);
+    saved_errno = errno;
 
     if (ret == 0) {
-	struct stat64 ostbuf, nstbuf;
-
-	// SUS says "rename(foo, foo)" is a no-op so we ignore that case.
-	// Should be quite rare so not a concern from a performance POV.
-	if (!stat64(oldpath, &ostbuf) && !stat64(newpath, &nstbuf)) {
-	    if (ostbuf.st_ino == nstbuf.st_ino &&
-		ostbuf.st_dev == nstbuf.st_dev) {
-		return ret;
-	    }
-	}
+	_renameat_record(call, fromfd, oldpath, tofd, newpath, 0);
+    }
 
-	_pa_record(call, oldpath, NULL, -1, OP_UNLINK);
-	_pa_record(call, newpath, NULL, -1, OP_CREAT);
+    errno = saved_errno;
+    return ret;
+}
+
+#if defined(RENAME_NOREPLACE)
+/// Interposes over the renameat2() function.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[in] fromfd   same as the wrapped function
+/// @param[in] oldpath  same as the wrapped function
+/// @param[in] tofd     same as the wrapped function
+/// @param[in] newpath  same as the wrapped function
+/// @param[in] flags    same as the wrapped function
+/// @return same as the wrapped function
+/*static*/ int
+renameat2_wrapper(const char *call,
+		  int (*next) (int, const char *, int, const char *, unsigned),
+		  int fromfd, const char *oldpath, int tofd,
+		  const char *newpath, unsigned int flags)
+{
+    int ret, saved_errno;
+    WRAPPER_DEBUG("ENTERING renameat2_wrapper() => %p [%s >> %s]\n", next, oldpath, newpath);
+
+    ret = (*next)(fromfd, oldpath, tofd, newpath, flags);
+    saved_errno = errno;
+
+    if (ret == 0) {
+	_renameat_record(call, fromfd, oldpath, tofd, newpath,
+			 flags & RENAME_EXCHANGE);
+    }
+
+    errno = saved_errno;
+    return ret;
+}
+#endif	/*RENAME_NOREPLACE*/
+
+#if defined(linux)
+/// Interposes over the syscall() function, for the sake of the
+/// file-access calls which programs can make only through it (see
+/// <Interposer/syscall.h>). These are recorded under their own names.
+/// @param[in] call     the name of the interposed function in string form
+/// @param[in] next     a pointer to the interposed function
+/// @param[in] number   same as the wrapped function
+/// @param[in] a1       the first argument to the system call, and so on
+/// @return same as the wrapped function
+/*static*/ long
+syscall_wrapper(const char *call, long (*next) (long, ...), long number,
+		long a1, long a2, long a3, long a4, long a5, long a6)
+{
+    long ret;
+    int saved_errno;
+
+    UNUSED(call);
+
+    ret = (*next)(number, a1, a2, a3, a4, a5, a6);
+    saved_errno = errno;
+
+    switch (number) {
+#if defined(SYS_openat2) && defined(HAVE_OPENAT2)
+    case SYS_openat2:
+	if (ret != -1) {
+	    _openat_record("openat2", (int)a1, (const char *)a2,
+			   (int)((struct open_how *)a3)->flags, (int)ret);
+	}
+	break;
+#endif	/*SYS_openat2*/
+#if defined(SYS_renameat2) && defined(RENAME_EXCHANGE)
+    case SYS_renameat2:
+	if (ret == 0) {
+	    _renameat_record("renameat2", (int)a1, (const char *)a2,
+			     (int)a3, (const char *)a4,
+			     (unsigned)a5 & RENAME_EXCHANGE);
+	}
+	break;
+#endif	/*SYS_renameat2*/
+    case SYS_chdir:
+    case SYS_fchdir:
+	if (ret == 0) {
+	    pn_cache_cwd_changed();
+	}
+	break;
+    default:
+	break;
     }
 
+    errno = saved_errno;
     return ret;
 }
+#endif	/*linux*/
 
 /// Interposes over the unlink() function.
 /// We try to record all unlinks. Say a build script does a
@@ -1372,9 +2355,20 @@ unlink_wrapper(const char *call, int (*next) (const char *), const char *path)
 /*static*/ void
 interposed_finalize(void)
 {
-    if (_auditor_isActiveByRequest()) {
+    if (ExitStatusKnown && _auditor_isActive()) {
+	// The easy way.
+	_audit_end("exit", EXITING, ExitStatusSeen);
+    } else if (ExitHandlerSet && _auditor_isActive()) {
+	// The status will be along shortly (see _on_exit).
+	FinalizeDeferred = 1;
+	return;
+    } else if (_auditor_isActiveByRequest()) {
 	pid_t pid;
 
+	// Where the status can't be had any other way, it's extracted
+	// from a throwaway child. Since that duplicates the page tables
+	// of what may be a very large process only to exit, it's very
+	// much a fallback.
 	// This is a really cute trick I got from a guy named Nate Eldredge.
 	// The exit status is not given to the library finalizer but we
 	// need it, so what can we do? This is the answer: do a meaningless
@@ -42,12 +42,82 @@
 
 #include <time.h>
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <signal.h>
+#endif	/*_WIN32*/
+
 /// @cond static
 static hash_t *AuditHash;
 static void *line_break_re, *line_strong_re, *line_weak_re;
 static void *prog_break_re, *prog_strong_re, *prog_weak_re;
 /// @endcond static
 
+#if !defined(_WIN32)
+/// A finished CA on its way through the publish pipeline.
+typedef struct pub_job_s {
+    ca_o pj_ca;			///< the CA, no longer in AuditHash
+    CS pj_cabuf;		///< its CSV form, once formatted
+    FILE *pj_fp;		///< the output file, or NULL
+    int pj_done;		///< boolean - has it been formatted?
+    FILE *pj_logfp;		///< collects messages while formatting
+    char *pj_log;		///< those messages, once collected
+    size_t pj_loglen;		///< length of pj_log
+    struct pub_job_s *pj_next;	///< next job in submission order
+} pub_job_s;
+
+// Formatting a finished CA means dcoding its outputs, which can take
+// a while, so it's done by a pool of worker threads while the monitor
+// gets on with reading audits. A single writer thread then takes the
+// jobs in the order they were submitted and appends them to the
+// output file, and hands them back to the monitor through a pipe for
+// the rest: libcurl handles aren't shared between threads so uploads,
+// like the makefile and git work, stay on the monitor's thread.
+// Any messages or verbosity from formatting a job are collected with
+// it and written out by the writer just ahead of the job itself.
+/// @cond static
+static pthread_mutex_t PubLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PubWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t PubProgress = PTHREAD_COND_INITIALIZER;
+static pthread_t *PubThreads;
+static int PubWorkers;
+static int PubQuit;
+static int PubQueued;
+static int PubPipe[2] = { -1, -1 };
+static pub_job_s *PubHead, *PubTail, *PubNext;
+static pub_job_s *PubReapHead, *PubReapTail;
+static pthread_key_t PubJobKey;
+static int PubJobKeyReady;
+/// @endcond static
+
+/// A set of PAs being dcoded together (see _mon_dcode_pas()).
+typedef struct dcode_batch_s {
+    pa_o *db_pas;		///< the PAs
+    int db_count;		///< number of PAs in db_pas
+    int db_claimed;		///< number handed out to be dcoded
+    int db_left;		///< number not yet dcoded
+    struct dcode_batch_s *db_next; ///< next batch in the queue
+} dcode_batch_s;
+
+// Dcoding a CA's outputs one after another leaves a big link output
+// holding up everything behind it, so the PAs wanting dcodes are
+// handed to a pool of hashing threads by way of ca_set_dcoder().
+// Whoever hands over a batch helps with it too, which also means it
+// gets done should there be no threads, as in a shopping worker.
+/// @cond static
+static pthread_mutex_t DcodeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t DcodeWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t DcodeDone = PTHREAD_COND_INITIALIZER;
+static pthread_t *DcodeThreads;
+static int DcodeWorkers;
+static int DcodeQuit;
+static dcode_batch_s *DcodeQueue;
+/// @endcond static
+
+static void _mon_publish_start(void);
+static void _mon_dcode_start(void);
+#endif	/*_WIN32*/
+
 /// Enumeration of the different aggregation types.
 typedef enum {
     AGG_NEUTRAL,		///< Stick with the current aggregation plan
@@ -86,6 +156,18 @@ mon_init(void)
     ps_dcode_cache_init();
 }
 
+/// Starts the monitor's dcode and publishing threads. This is separate
+/// from mon_init() so that anything which must be forked from the
+/// monitor can be while it's still single-threaded.
+void
+mon_start_threads(void)
+{
+#if !defined(_WIN32)
+    _mon_dcode_start();
+    _mon_publish_start();
+#endif	/*_WIN32*/
+}
+
 // Internal utility function to make verbosity easier.
 static void
 _mon_verbosity(ca_o ca, CCS action)
@@ -149,7 +231,27 @@ _mon_no_ptx(void)
     return prop_get_ulong(P_DOWNLOAD_ONLY) == 2;
 }
 
-// Internal service routine. Callback for _mon_process_ca().
+// Internal service routine. Takes the CA out of AuditHash, leaving
+// the CA itself alone.
+static void
+_mon_forget_ca(ca_o ca)
+{
+    hnode_t *hnp;
+    ck_o ck;
+
+    ck = ck_new_from_ca(ca);
+    if ((hnp = hash_lookup(AuditHash, ck)) && hnode_get(hnp) == ca) {
+	ck_o hck;
+
+	hck = (ck_o)hnode_getkey(hnp);
+	hash_delete(AuditHash, hnp);
+	hnode_destroy(hnp);
+	ck_destroy(hck);
+    }
+    ck_destroy(ck);
+}
+
+// Internal service routine. Callback for _mon_deliver_ca().
 static int
 _mon_process_pa(pa_o pa, void *data)
 {
@@ -166,43 +268,45 @@ _mon_process_pa(pa_o pa, void *data)
     return 0;
 }
 
-// Internal service routine.
-static void
-_mon_process_ca(ca_o ca)
+// Internal service routine. Derives what remains to be known about
+// a finished CA, dcoding its outputs along the way, and returns its
+// CSV form. Apart from the dcode cache, which is why the publish
+// pipeline isn't used along with it, this touches nothing beyond
+// the CA itself and may be run by a worker thread.
+static CS
+_mon_format_ca(ca_o ca)
 {
-    CCS ofile;
-    CS cabuf = NULL;
-
     // In the case of a recycled CA the pathcode will have been
     // determined during shopping.
     if (!ca_get_recycled(ca)) {
 	ca_derive_pathcode(ca);
     }
 
-    cabuf = (CS)ca_toCSVString(ca);
-
-    if ((ofile = prop_get_str(P_OUTPUT_FILE))) {
-	if (cabuf && *cabuf) {
-	    FILE *fp;
-
-	    fp = util_open_output_file(ofile);
-
-	    if (fputs(cabuf, fp) == EOF || fputs("\n", fp) == EOF) {
-		putil_syserr(0, "fputs(cabuf)");
-	    }
+    return (CS)ca_toCSVString(ca);
+}
 
-	    fflush(fp);
-	}
+// Internal service routine.
+static void
+_mon_write_ca(FILE *fp, CCS cabuf)
+{
+    if (fputs(cabuf, fp) == EOF || fputs("\n", fp) == EOF) {
+	putil_syserr(0, "fputs(cabuf)");
     }
 
+    fflush(fp);
+}
+
+// Internal service routine. Sends a formatted CA wherever else it's
+// going. This must be done on the monitor's own thread.
+static void
+_mon_deliver_ca(ca_o ca, CCS cabuf)
+{
     if (prop_has_value(P_SERVER) && !_mon_no_ptx()) {
 	up_load_audit(cabuf);
 	// Take each file marked for upload and tell libcurl to send it.
 	(void)ca_foreach_cooked_pa(ca, _mon_process_pa, NULL);
     }
 
-    putil_free(cabuf);
-
     if (prop_has_value(P_MAKE_DEPENDS) || prop_has_value(P_MAKE_FILE)) {
 	make_file(ca);
     }
@@ -210,35 +314,609 @@ _mon_process_ca(ca_o ca)
     if (prop_is_true(P_GIT)) {
 	git_deliver(ca);
     }
+}
+
+#if !defined(_WIN32)
+// Internal service routine. Registered with putil_set_msg_stream().
+// Sends messages from a formatting thread to its current job.
+static FILE *
+_mon_publish_msg_stream(void)
+{
+    pub_job_s *job;
+
+    if ((job = (pub_job_s *)pthread_getspecific(PubJobKey))) {
+	return job->pj_logfp;
+    }
+
+    return NULL;
+}
+
+// Internal service routine. Should a formatting thread exit in the
+// middle of a job, its messages would otherwise be lost, and they
+// probably say why.
+static void
+_mon_publish_exit(void)
+{
+    pub_job_s *job;
+
+    if (PubThreads &&
+	    (job = (pub_job_s *)pthread_getspecific(PubJobKey))) {
+	pthread_setspecific(PubJobKey, NULL);
+	fclose(job->pj_logfp);
+	fwrite(job->pj_log, 1, job->pj_loglen, stderr);
+    }
+}
+
+// Internal service routine. The body of a formatting thread.
+static void *
+_mon_publish_worker(void *arg)
+{
+    pub_job_s *job;
+
+    UNUSED(arg);
+
+    for (;;) {
+	pthread_mutex_lock(&PubLock);
+	while (!PubNext && !PubQuit) {
+	    pthread_cond_wait(&PubWork, &PubLock);
+	}
+	if (!(job = PubNext)) {
+	    pthread_mutex_unlock(&PubLock);
+	    break;
+	}
+	PubNext = job->pj_next;
+	pthread_mutex_unlock(&PubLock);
+
+	if ((job->pj_logfp = open_memstream(&job->pj_log, &job->pj_loglen))) {
+	    pthread_setspecific(PubJobKey, job);
+	}
+
+	job->pj_cabuf = _mon_format_ca(job->pj_ca);
+
+	if (job->pj_logfp) {
+	    pthread_setspecific(PubJobKey, NULL);
+	    fclose(job->pj_logfp);
+	}
+
+	pthread_mutex_lock(&PubLock);
+	job->pj_done = 1;
+	pthread_cond_broadcast(&PubProgress);
+	pthread_mutex_unlock(&PubLock);
+    }
+
+    return NULL;
+}
+
+// Internal service routine. The body of the writer thread, which
+// keeps the output file in submission order however the formatting
+// threads finish.
+static void *
+_mon_publish_writer(void *arg)
+{
+    pub_job_s *job;
+
+    UNUSED(arg);
+
+    for (;;) {
+	pthread_mutex_lock(&PubLock);
+	while (!(PubHead && PubHead->pj_done) && !(PubQuit && !PubHead)) {
+	    pthread_cond_wait(&PubProgress, &PubLock);
+	}
+	if (!(job = PubHead)) {
+	    pthread_mutex_unlock(&PubLock);
+	    break;
+	}
+	pthread_mutex_unlock(&PubLock);
+
+	if (job->pj_log) {
+	    fwrite(job->pj_log, 1, job->pj_loglen, stderr);
+	    fflush(stderr);
+	    free(job->pj_log);
+	    job->pj_log = NULL;
+	}
+
+	if (job->pj_fp && job->pj_cabuf && *job->pj_cabuf) {
+	    _mon_write_ca(job->pj_fp, job->pj_cabuf);
+	}
+
+	pthread_mutex_lock(&PubLock);
+	if (!(PubHead = job->pj_next)) {
+	    PubTail = NULL;
+	}
+	PubQueued--;
+	job->pj_next = NULL;
+	if (PubReapTail) {
+	    PubReapTail->pj_next = job;
+	} else {
+	    PubReapHead = job;
+	}
+	PubReapTail = job;
+	pthread_cond_broadcast(&PubProgress);
+	pthread_mutex_unlock(&PubLock);
+
+	// A full pipe means the monitor has a wakeup pending already.
+	(void)write(PubPipe[1], "x", 1);
+    }
+
+    return NULL;
+}
+
+// Internal service routine. Starts the publish pipeline if so
+// configured.
+static void
+_mon_publish_start(void)
+{
+    sigset_t all, old;
+    long workers;
+    int i;
+
+    if (PubThreads || (workers = prop_get_long(P_PUBLISH_WORKERS)) <= 0) {
+	return;
+    }
+
+    // The dcode cache belongs to one thread.
+    if (prop_get_long(P_DCODE_CACHE_SECS) >= 0) {
+	return;
+    }
+
+    if (pipe(PubPipe) == -1) {
+	putil_syserr(2, "pipe(publish)");
+    }
+    for (i = 0; i < 2; i++) {
+	if (fcntl(PubPipe[i], F_SETFL,
+		  fcntl(PubPipe[i], F_GETFL) | O_NONBLOCK) == -1) {
+	    putil_syserr(2, "fcntl(O_NONBLOCK)");
+	}
+    }
+
+    if (!PubJobKeyReady) {
+	if ((errno = pthread_key_create(&PubJobKey, NULL))) {
+	    putil_syserr(2, "pthread_key_create");
+	}
+	atexit(_mon_publish_exit);
+	PubJobKeyReady = 1;
+    }
+    putil_set_msg_stream(_mon_publish_msg_stream);
+
+    // Signals are for the monitor's thread.
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    PubWorkers = (int)workers;
+    PubThreads = (pthread_t *)putil_calloc(PubWorkers + 1, sizeof(pthread_t));
+    for (i = 0; i <= PubWorkers; i++) {
+	if ((errno = pthread_create(&PubThreads[i], NULL,
+		i ? _mon_publish_worker : _mon_publish_writer, NULL))) {
+	    putil_syserr(2, "pthread_create");
+	}
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    vb_printf(VB_MON, "PUBLISHING WITH %d WORKERS", PubWorkers);
+}
+
+// Internal service routine. Queues a finished CA for publishing,
+// waiting if the pipeline is full. The CA leaves AuditHash now
+// and is destroyed when it comes back out of the pipeline.
+static void
+_mon_publish_submit(ca_o ca)
+{
+    pub_job_s *job;
+    CCS ofile;
+
+    _mon_forget_ca(ca);
+
+    job = (pub_job_s *)putil_calloc(1, sizeof(*job));
+    job->pj_ca = ca;
+
+    // Opening the output file may update P_OUTPUT_FILE.
+    if ((ofile = prop_get_str(P_OUTPUT_FILE))) {
+	job->pj_fp = util_open_output_file(ofile);
+    }
+
+    pthread_mutex_lock(&PubLock);
+    while (PubQueued >= PubWorkers * 8) {
+	pthread_cond_wait(&PubProgress, &PubLock);
+    }
+    if (PubTail) {
+	PubTail->pj_next = job;
+    } else {
+	PubHead = job;
+    }
+    PubTail = job;
+    if (!PubNext) {
+	PubNext = job;
+    }
+    PubQueued++;
+    pthread_cond_signal(&PubWork);
+    pthread_mutex_unlock(&PubLock);
+}
+
+// Internal service routine. Waits for everything submitted so far
+// to be written and delivers it.
+static void
+_mon_publish_drain(void)
+{
+    if (!PubThreads) {
+	return;
+    }
+
+    pthread_mutex_lock(&PubLock);
+    while (PubHead) {
+	pthread_cond_wait(&PubProgress, &PubLock);
+    }
+    pthread_mutex_unlock(&PubLock);
+
+    mon_publish_reap();
+}
+
+// Internal service routine. Drains the publish pipeline and stops it.
+static void
+_mon_publish_stop(void)
+{
+    int i;
+
+    if (!PubThreads) {
+	return;
+    }
+
+    _mon_publish_drain();
+
+    pthread_mutex_lock(&PubLock);
+    PubQuit = 1;
+    pthread_cond_broadcast(&PubWork);
+    pthread_cond_broadcast(&PubProgress);
+    pthread_mutex_unlock(&PubLock);
+
+    for (i = 0; i <= PubWorkers; i++) {
+	(void)pthread_join(PubThreads[i], NULL);
+    }
+    putil_free(PubThreads);
+    PubThreads = NULL;
+    PubWorkers = 0;
+    putil_set_msg_stream(NULL);
+    PubQuit = 0;
+
+    close(PubPipe[0]);
+    close(PubPipe[1]);
+    PubPipe[0] = PubPipe[1] = -1;
+}
+
+// Internal service routine. Hands out the next PA of the given batch,
+// or of the first in the queue, taking the batch out of the queue
+// once all its PAs are handed out. Called with DcodeLock held.
+static pa_o
+_mon_dcode_claim(dcode_batch_s *db)
+{
+    dcode_batch_s **dbp;
+    pa_o pa;
+
+    if (!db && !(db = DcodeQueue)) {
+	return NULL;
+    }
+
+    pa = db->db_pas[db->db_claimed++];
+    if (db->db_claimed == db->db_count) {
+	for (dbp = &DcodeQueue; *dbp != db; dbp = &(*dbp)->db_next);
+	*dbp = db->db_next;
+    }
+
+    return pa;
+}
+
+// Internal service routine. The body of a hashing thread.
+static void *
+_mon_dcode_worker(void *arg)
+{
+    dcode_batch_s *db;
+    pa_o pa;
+
+    UNUSED(arg);
+
+    pthread_mutex_lock(&DcodeLock);
+    for (;;) {
+	while (!DcodeQueue && !DcodeQuit) {
+	    pthread_cond_wait(&DcodeWork, &DcodeLock);
+	}
+	if (!(db = DcodeQueue)) {
+	    break;
+	}
+	pa = _mon_dcode_claim(db);
+	pthread_mutex_unlock(&DcodeLock);
+
+	(void)pa_stat(pa, 1);
+
+	pthread_mutex_lock(&DcodeLock);
+	if (--db->db_left == 0) {
+	    pthread_cond_broadcast(&DcodeDone);
+	}
+    }
+    pthread_mutex_unlock(&DcodeLock);
+
+    return NULL;
+}
+
+// Internal service routine. The dcoder given to ca_set_dcoder().
+static void
+_mon_dcode_pas(pa_o *pas, int count)
+{
+    dcode_batch_s batch, **dbp;
+    pa_o pa;
+
+    if (count == 1) {
+	(void)pa_stat(pas[0], 1);
+	return;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.db_pas = pas;
+    batch.db_count = batch.db_left = count;
+
+    pthread_mutex_lock(&DcodeLock);
+    for (dbp = &DcodeQueue; *dbp; dbp = &(*dbp)->db_next);
+    *dbp = &batch;
+    pthread_cond_broadcast(&DcodeWork);
+
+    while (batch.db_claimed < batch.db_count) {
+	pa = _mon_dcode_claim(&batch);
+	pthread_mutex_unlock(&DcodeLock);
+
+	(void)pa_stat(pa, 1);
+
+	pthread_mutex_lock(&DcodeLock);
+	batch.db_left--;
+    }
+
+    while (batch.db_left) {
+	pthread_cond_wait(&DcodeDone, &DcodeLock);
+    }
+    pthread_mutex_unlock(&DcodeLock);
+}
+
+// Internal service routine. Starts the hashing threads if so
+// configured.
+static void
+_mon_dcode_start(void)
+{
+    sigset_t all, old;
+    long workers;
+    int i;
+
+    if (DcodeThreads || (workers = prop_get_long(P_DCODE_WORKERS)) <= 0) {
+	return;
+    }
+
+    // The dcode cache belongs to one thread.
+    if (prop_get_long(P_DCODE_CACHE_SECS) >= 0) {
+	return;
+    }
+
+    // Signals are for the monitor's thread.
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    DcodeWorkers = (int)workers;
+    DcodeThreads = (pthread_t *)putil_calloc(DcodeWorkers, sizeof(pthread_t));
+    for (i = 0; i < DcodeWorkers; i++) {
+	if ((errno = pthread_create(&DcodeThreads[i], NULL,
+				    _mon_dcode_worker, NULL))) {
+	    putil_syserr(2, "pthread_create");
+	}
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    ca_set_dcoder(_mon_dcode_pas);
+}
+
+// Internal service routine. Stops the hashing threads.
+static void
+_mon_dcode_stop(void)
+{
+    int i;
+
+    if (!DcodeThreads) {
+	return;
+    }
+
+    ca_set_dcoder(NULL);
+
+    pthread_mutex_lock(&DcodeLock);
+    DcodeQuit = 1;
+    pthread_cond_broadcast(&DcodeWork);
+    pthread_mutex_unlock(&DcodeLock);
+
+    for (i = 0; i < DcodeWorkers; i++) {
+	(void)pthread_join(DcodeThreads[i], NULL);
+    }
+    putil_free(DcodeThreads);
+    DcodeThreads = NULL;
+    DcodeWorkers = 0;
+    DcodeQuit = 0;
+}
+#endif	/*_WIN32*/
+
+/// Returns a descriptor which becomes readable when published CAs
+/// are waiting for mon_publish_reap(), or -1 if CAs are published
+/// synchronously.
+/// @return a descriptor to watch, or -1
+int
+mon_publish_fd(void)
+{
+#if !defined(_WIN32)
+    return PubPipe[0];
+#else	/*_WIN32*/
+    return -1;
+#endif	/*_WIN32*/
+}
+
+/// Finishes off CAs which have come through the publish pipeline:
+/// uploads them, does any makefile and git work, and frees them.
+void
+mon_publish_reap(void)
+{
+#if !defined(_WIN32)
+    pub_job_s *job, *next;
+    char junk[256];
+
+    if (!PubThreads) {
+	return;
+    }
+
+    while (read(PubPipe[0], junk, sizeof(junk)) > 0);
+
+    pthread_mutex_lock(&PubLock);
+    job = PubReapHead;
+    PubReapHead = PubReapTail = NULL;
+    pthread_mutex_unlock(&PubLock);
+
+    for (; job; job = next) {
+	next = job->pj_next;
+	_mon_deliver_ca(job->pj_ca, job->pj_cabuf);
+	putil_free(job->pj_cabuf);
+	ca_destroy(job->pj_ca);
+	putil_free(job);
+    }
+#endif	/*_WIN32*/
+}
+
+// Internal service routine. The callback given to ca_publish() and
+// ca_disband(). A CA handed to the publish pipeline is out of our
+// hands; otherwise it's published here and now and marked processed
+// for _mon_clean_up_ca_table().
+static void
+_mon_process_ca(ca_o ca)
+{
+    CCS ofile;
+    CS cabuf;
+
+#if !defined(_WIN32)
+    if (PubThreads) {
+	_mon_publish_submit(ca);
+	return;
+    }
+#endif	/*_WIN32*/
+
+    cabuf = _mon_format_ca(ca);
+
+    if ((ofile = prop_get_str(P_OUTPUT_FILE))) {
+	if (cabuf && *cabuf) {
+	    _mon_write_ca(util_open_output_file(ofile), cabuf);
+	}
+    }
+
+    _mon_deliver_ca(ca, cabuf);
+
+    putil_free(cabuf);
 
     ca_set_processed(ca, 1);
 
     return;
 }
 
-// When an audit group has been destroyed, the references to CAs
-// remain in the main table. This cleans them up.
+// When CAs have been processed, or merged into a group leader which
+// has, the references to them remain in the main table. This cleans
+// them up. Processed CAs are queued as they're marked so only those
+// are visited, not the whole table.
 static void
 _mon_clean_up_ca_table(void)
 {
-    hnode_t *hnp;
-    hscan_t hscan;
+    ca_o ca;
 
-    hash_scan_begin(&hscan, AuditHash);
-    for (hnp = hash_scan_next(&hscan); hnp; hnp = hash_scan_next(&hscan)) {
-	ca_o ca;
+    while ((ca = ca_next_processed())) {
+	_mon_forget_ca(ca);
+	ca_destroy(ca);
+    }
+}
+
+/// Translates the result of shopping for a command into the
+/// MON_* bits which determine how its SOA is acknowledged.
+/// @param[in] ca       the CA which was shopped for
+/// @param[in] shoprc   the result of shopping
+/// @param[out] winner pointer to a place where the winning PTX may be stored
+/// @return a bitmask describing the outcome
+unsigned
+mon_shop_verdict(ca_o ca, shop_e shoprc, CCS *winner)
+{
+    unsigned rc = 0;
 
-	ca = (ca_o)hnode_get(hnp);
-	if (ca_get_processed(ca)) {
-	    ck_o ck;
+    if (shoprc == SHOP_RECYCLED) {
+	rc |= MON_RECYCLED;
+	if (winner) {
+	    *winner = ca_get_recycled(ca);
+	}
+    } else if (shoprc == SHOP_MUSTRUN ||
+	       shoprc == SHOP_MUSTRUN_AGG) {
+	// A "must run" (no download available) condition.
+	if (shoprc == SHOP_MUSTRUN_AGG) {
+	    // Report that nested aggegated cmds can suppress
+	    // shopping since they're guaranteed not to match.
+	    rc |= MON_AGG;
+	}
 
-	    ck = (ck_o)hnode_getkey(hnp);
-	    hash_scan_delete(AuditHash, hnp);
-	    hnode_destroy(hnp);
-	    ck_destroy(ck);
-	    ca_destroy(ca);
+    } else if (shoprc == SHOP_OFF) {
+	// We've deliberately suppressed shopping.
+    } else if (shoprc == SHOP_NOMATCH ||
+	       shoprc == SHOP_NOMATCH_AGG ||
+	       shoprc == SHOP_ERR) {
+	// We tried to find a match but failed. The user
+	// can ask for this to be treated as an error.
+	if (prop_is_true(P_STRICT_DOWNLOAD)) {
+	    putil_error("Failed %s requirement on '%s'",
+		prop_to_name(P_STRICT_DOWNLOAD),
+		ca_get_line(ca));
+	    rc |= MON_STRICT;
+	}
+	if (shoprc == SHOP_NOMATCH_AGG) {
+	    // Report that nested aggegated cmds can suppress
+	    // shopping since they're guaranteed not to match.
+	    rc |= MON_AGG;
 	}
+    } else {
+	putil_int("unknown shopping result: %d", (int)shoprc);
+    }
+
+    return rc;
+}
+
+// Internal service routine. Files a PA received from the auditor,
+// in whichever format, with the CA it belongs to.
+static unsigned
+_mon_record_pa(pa_o pa)
+{
+    ck_o ck;
+    hnode_t *hnp;
+
+    // Any file that's written should be marked for upload.
+    // And optionally files which are only read too.
+    if (pa_is_write(pa) || prop_is_true(P_UPLOAD_READS)) {
+	pa_set_uploadable(pa, 1);
+    }
+
+    // Need a key object for looking up the associated CA.
+    ck = ck_new(pa_get_ccode(pa), pa_get_depth(pa), pa_get_pid(pa));
+    assert(ck);
+
+    // If we can't find the associated CK, something's wrong.
+    if (!AuditHash || !(hnp = hash_lookup(AuditHash, ck))) {
+	CCS str;
+
+	str = pa_tostring(pa);
+	putil_warn("PA skew [%s]", str);
+	putil_free(str);
+	mon_dump();
+	ck_destroy(ck);
+	pa_destroy(pa);
+	return MON_ERR;
     }
+
+    ck_destroy(ck);
+
+    // This is the CA we needed.
+    ca_record_pa((ca_o)hnode_get(hnp), pa);
+
+    return MON_NEXT;
 }
 
 /// Called for each line received from the auditor. Note: the
@@ -248,9 +926,13 @@ _mon_clean_up_ca_table(void)
 /// @param[out] rcp     pointer to a place where a return code may be stored
 /// @param[out] cmdpidp pointer to a place where the ending pid may be stored
 /// @param[out] winner pointer to a place where the winning PTX may be stored
+/// @param[out] shopcap if non-null, shopping which needs to examine path
+///                     states is left to the caller: the CA is stored
+///                     here and MON_SHOP is set in the return value
 /// @return a bitmask describing what was learned from this line
 unsigned
-mon_record(CS buf, int *rcp, unsigned long *cmdpidp, CCS *winner)
+mon_record(CS buf, int *rcp, unsigned long *cmdpidp, CCS *winner,
+	   ca_o *shopcap)
 {
     unsigned rc = 0;
     ck_o ck;
@@ -436,45 +1118,26 @@ mon_record(CS buf, int *rcp, unsigned long *cmdpidp, CCS *winner)
 	    // Here is where recycling takes place. If shopping was
 	    // successful, tell the command it's done. If not, let
 	    // it run unless we're in strict mode.
+	    // Most commands can be ruled out quickly by the precheck.
+	    // Those which can't may take a while to shop for, so if
+	    // the caller is prepared to do that asynchronously it's
+	    // handed back along with the CA.
 	    if (prop_has_value(P_SERVER) && !no_shop) {
 		shop_e shoprc;
 
-		shoprc = shop(ca, NULL, 1);
+		shoprc = shop_precheck(ca);
 
-		if (shoprc == SHOP_RECYCLED) {
-		    rc |= MON_RECYCLED;
-		    if (winner) {
-			*winner = ca_get_recycled(ca);
-		    }
-		} else if (shoprc == SHOP_MUSTRUN ||
-			   shoprc == SHOP_MUSTRUN_AGG) {
-		    // A "must run" (no download available) condition.
-		    if (shoprc == SHOP_MUSTRUN_AGG) {
-			// Report that nested aggegated cmds can suppress
-			// shopping since they're guaranteed not to match.
-			rc |= MON_AGG;
+		if (shoprc == SHOP_CANDIDATE) {
+		    if (shopcap) {
+			*shopcap = ca;
+			rc |= MON_SHOP;
+		    } else {
+			shoprc = shop(ca, NULL, 1);
 		    }
+		}
 
-		} else if (shoprc == SHOP_OFF) {
-		    // We've deliberately suppressed shopping.
-		} else if (shoprc == SHOP_NOMATCH ||
-			   shoprc == SHOP_NOMATCH_AGG ||
-			   shoprc == SHOP_ERR) {
-		    // We tried to find a match but failed. The user
-		    // can ask for this to be treated as an error.
-		    if (prop_is_true(P_STRICT_DOWNLOAD)) {
-			putil_error("Failed %s requirement on '%s'",
-			    prop_to_name(P_STRICT_DOWNLOAD),
-			    ca_get_line(ca));
-			rc |= MON_STRICT;
-		    }
-		    if (shoprc == SHOP_NOMATCH_AGG) {
-			// Report that nested aggegated cmds can suppress
-			// shopping since they're guaranteed not to match.
-			rc |= MON_AGG;
-		    }
-		} else {
-		    putil_int("unknown shopping result: %d", (int)shoprc);
+		if (!(rc & MON_SHOP)) {
+		    rc |= mon_shop_verdict(ca, shoprc, winner);
 		}
 	    }
 	} else if (buf[1] == 'E') {			// EOA
@@ -642,43 +1305,12 @@ mon_record(CS buf, int *rcp, unsigned long *cmdpidp, CCS *winner)
 	}
     } else if (ISALPHA(buf[0])) {
 	pa_o pa;
-	hnode_t *hnp;
-
-	rc = MON_NEXT;
 
 	// De-serialize the PA line into an object.
 	pa = pa_newFromCSVString(buf);
 	assert(pa);
 
-	// Any file that's written should be marked for upload.
-	// And optionally files which are only read too.
-	if (pa_is_write(pa) || prop_is_true(P_UPLOAD_READS)) {
-	    pa_set_uploadable(pa, 1);
-	}
-
-	// Need a key object for looking up the associated CA.
-	ck = ck_new(pa_get_ccode(pa), pa_get_depth(pa), pa_get_pid(pa));
-	assert(ck);
-
-	// If we can't find the associated CK, something's wrong.
-	if (!AuditHash || !(hnp = hash_lookup(AuditHash, ck))) {
-	    CCS str;
-
-	    str = pa_tostring(pa);
-	    putil_warn("PA skew [%s]", str);
-	    putil_free(str);
-	    mon_dump();
-	    ck_destroy(ck);
-	    pa_destroy(pa);
-	    return MON_ERR;
-	}
-
-	ck_destroy(ck);
-
-	// This is the CA we needed.
-	ca = (ca_o)hnode_get(hnp);
-
-	ca_record_pa(ca, pa);
+	rc = _mon_record_pa(pa);
     } else if (buf[0] == '+') {
 	// Verbosity from auditor. Just print it.
 	rc = MON_NEXT;
@@ -699,6 +1331,34 @@ mon_record(CS buf, int *rcp, unsigned long *cmdpidp, CCS *winner)
     return rc;
 }
 
+/// Called for each binary record received from the auditor (see the
+/// Audit.Format property). Only PAs are sent this way; all other
+/// traffic remains line-oriented and goes through mon_record().
+/// @param[in] buf      a complete binary record
+/// @param[in] len      the length of the record
+/// @return a bitmask describing what was learned from this record
+unsigned
+mon_record_binary(CCS buf, size_t len)
+{
+    pa_o pa;
+
+    if (!(pa = pa_newFromBinary(buf, len))) {
+	return MON_ERR;
+    }
+
+    // Show it as it would have looked in CSV form.
+    if (vb_bitmatch(VB_MON)) {
+	CCS str;
+
+	if ((str = pa_toCSVString(pa))) {
+	    vb_printf(VB_MON, "=%.*s", (int)strlen(str) - 1, str);
+	    putil_free(str);
+	}
+    }
+
+    return _mon_record_pa(pa);
+}
+
 /// Communicate with the server to establish a session.
 /// @return nonzero on failure
 int
@@ -890,6 +1550,11 @@ mon_ptx_end(int rc, CCS logfile)
     CURL *curl;
     char numbuf[32];
 
+#if !defined(_WIN32)
+    // Everything published so far belongs to this PTX.
+    _mon_publish_drain();
+#endif	/*_WIN32*/
+
     if (!prop_has_value(P_SESSIONID)) {
 	return;
     }
@@ -951,6 +1616,11 @@ mon_fini(void)
     re_fini__(&line_weak_re);
     re_fini__(&prog_weak_re);
 
+#if !defined(_WIN32)
+    _mon_publish_stop();
+    _mon_dcode_stop();
+#endif	/*_WIN32*/
+
     if (AuditHash) {
 	if (hash_count(AuditHash)) {
 	    putil_warn("%d audits left over:",
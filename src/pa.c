@@ -29,6 +29,7 @@
 
 #include "AO.h"
 
+#include "ARENA.h"
 #include "CA.h"
 #include "PA.h"
 #include "PS.h"
@@ -47,6 +48,7 @@ struct path_action_s {
     int pa_fd;			//!< file descriptor if opened
     int pa_uploadable;		//!< is this file to be uploaded?
     ps_o pa_ps;			//!< intrinsic (stat etc) data
+    arena_o pa_arena;		//!< where it lives, if not the heap
 } path_action_s;
 
 /// Ordering function (NOT method) for placing PAs in a data structure.
@@ -161,6 +163,27 @@ pa_new(void)
     return pa;
 }
 
+/// Constructor for a PA which lives in an arena until it's reset
+/// (see arena.c), along with all the strings set into it.
+/// The call name and cmd codes are interned since they're repeated
+/// from one PA to the next.
+/// @param[in] arena    the arena, or NULL to use the heap
+/// @return a new PathAction object
+pa_o
+pa_newInArena(arena_o arena)
+{
+    pa_o pa;
+
+    if (!arena) {
+	return pa_new();
+    }
+
+    pa = (pa_o)arena_alloc(arena, sizeof(*pa));
+    pa->pa_arena = arena;
+
+    return pa;
+}
+
 /// Converts a stringified path action back to a PA object.
 /// Any change to the CSV format require an equivalent change here.
 /// @param[in] csv      a stringified path action
@@ -274,11 +297,148 @@ pa_toCSVString(pa_o pa)
 	} else {
 	    putil_syserr(0, "ps_toCSVString");
 	}
+	putil_free(pabuf);
     }
 
     return buf;
 }
 
+/// Format a PA in the binary record format, which is an alternative
+/// to CSV for auditor-monitor traffic (see the Audit.Format property).
+/// The record begins with a header carrying its total length, then
+/// the numeric fields in binary form, then the strings, each preceded
+/// by its length. Any change to the layout requires an equivalent
+/// change in pa_newFromBinary() and most likely a new version number.
+/// @param[in] pa       the object pointer
+/// @param[out] lenp    a place to store the length of the record
+/// @return an allocated record
+CCS
+pa_toBinary(pa_o pa, size_t *lenp)
+{
+    size_t len;
+    CS buf, p;
+
+    len = BIN_REC_HDR_SIZE + 7 * BIN_INT_MAX_SIZE +
+	util_bin_str_size(pa->pa_call) +
+	util_bin_str_size(pa_get_pccode(pa)) +
+	util_bin_str_size(pa_get_ccode(pa)) +
+	ps_toBinary(pa->pa_ps, NULL);
+
+    buf = (CS)putil_malloc(len);
+
+    p = buf + BIN_REC_HDR_SIZE;
+    p = util_bin_put_uint(p, (uint64_t)pa->pa_op);
+    p = util_bin_put_int(p, pa->pa_timestamp.ntv_sec);
+    p = util_bin_put_int(p, pa->pa_timestamp.ntv_nsec);
+    p = util_bin_put_uint(p, pa->pa_pid);
+    p = util_bin_put_uint(p, pa->pa_depth);
+    p = util_bin_put_uint(p, pa->pa_ppid);
+    p = util_bin_put_uint(p, pa->pa_tid);
+    p = util_bin_put_str(p, pa->pa_call);
+    p = util_bin_put_str(p, pa_get_pccode(pa));
+    p = util_bin_put_str(p, pa_get_ccode(pa));
+    p += ps_toBinary(pa->pa_ps, p);
+
+    len = p - buf;
+
+    buf[0] = BIN_REC_MARK;
+    buf[1] = BIN_REC_VERSION;
+    buf[2] = (char)len;
+    buf[3] = (char)(len >> 8);
+    buf[4] = (char)(len >> 16);
+    buf[5] = (char)(len >> 24);
+
+    *lenp = len;
+    return buf;
+}
+
+/// Returns the length of the binary record at the start of a buffer
+/// as given in its header. A malformed length is reported as the
+/// size of the header so the caller always makes progress.
+/// @param[in] buf      the start of a record
+/// @param[in] avail    the number of bytes available
+/// @return the record length, or 0 if the header is not all there yet
+size_t
+pa_binary_reclen(CCS buf, size_t avail)
+{
+    const unsigned char *hdr;
+    size_t reclen;
+
+    if (avail < BIN_REC_HDR_SIZE) {
+	return 0;
+    }
+
+    hdr = (const unsigned char *)buf;
+    reclen = hdr[2] | hdr[3] << 8 | hdr[4] << 16 | (size_t)hdr[5] << 24;
+
+    return reclen < BIN_REC_HDR_SIZE ? BIN_REC_HDR_SIZE : reclen;
+}
+
+/// Converts a PA in binary record format back to an object. Unlike
+/// the CSV parser this works directly on the record without making
+/// a scratch copy or converting numbers from text.
+/// @param[in] buf      a complete binary record
+/// @param[in] len      the length of the record
+/// @return a new PathAction object, or NULL if the record is malformed
+pa_o
+pa_newFromBinary(CCS buf, size_t len)
+{
+    uint64_t op, pid, depth, ppid, tid;
+    int64_t sec, nsec;
+    moment_s timestamp;
+    CCS p, end, call, pccode, ccode;
+    pa_o pa;
+    ps_o ps;
+
+    if (len < BIN_REC_HDR_SIZE || buf[0] != BIN_REC_MARK ||
+	    pa_binary_reclen(buf, len) != len) {
+	putil_int("bad binary record (%lu bytes)", (unsigned long)len);
+	return NULL;
+    }
+
+    if (buf[1] != BIN_REC_VERSION) {
+	putil_warn("unsupported binary record version: %d", buf[1]);
+	return NULL;
+    }
+
+    p = buf + BIN_REC_HDR_SIZE;
+    end = buf + len;
+
+    // *INDENT-OFF*
+    if (    !(p = util_bin_get_uint(p, end, &op)) ||
+	    !(p = util_bin_get_int(p, end, &sec)) ||
+	    !(p = util_bin_get_int(p, end, &nsec)) ||
+	    !(p = util_bin_get_uint(p, end, &pid)) ||
+	    !(p = util_bin_get_uint(p, end, &depth)) ||
+	    !(p = util_bin_get_uint(p, end, &ppid)) ||
+	    !(p = util_bin_get_uint(p, end, &tid)) ||
+	    !(p = util_bin_get_str(p, end, &call)) ||
+	    !(p = util_bin_get_str(p, end, &pccode)) ||
+	    !(p = util_bin_get_str(p, end, &ccode)) ||
+	    !(ps = ps_newFromBinary(p, end))) {
+	putil_int("bad binary record (%lu bytes)", (unsigned long)len);
+	return NULL;
+    }
+    // *INDENT-ON*
+
+    timestamp.ntv_sec = sec;
+    timestamp.ntv_nsec = (long)nsec;
+
+    pa = pa_new();
+    pa_set_op(pa, (op_e)op);
+    pa_set_call(pa, call);
+    pa_set_timestamp(pa, timestamp);
+    pa_set_pid(pa, (unsigned long)pid);
+    pa_set_depth(pa, (unsigned long)depth);
+    pa_set_ppid(pa, (unsigned long)ppid);
+    pa_set_tid(pa, (unsigned long)tid);
+    pa_set_pccode(pa, pccode);
+    pa_set_ccode(pa, ccode);
+    pa_set_ps(pa, ps);
+
+    return pa;
+}
+
 /// Format a PathAction for user consumption (typically debugging)
 /// @param[in] pa       the object pointer
 /// @return an allocated string which must be freed by the caller
@@ -337,12 +497,14 @@ pa_is_read(pa_o pa)
 }
 
 /// Boolean - returns true iff the operation was a write.
+/// A rename counts since it puts new data at the destination path.
 /// @param[in] pa       the object pointer
 /// @return true or false
 int
 pa_is_write(pa_o pa)
 {
-    return (pa->pa_op == OP_CREAT) || (pa->pa_op == OP_APPEND);
+    return (pa->pa_op == OP_CREAT) || (pa->pa_op == OP_APPEND) ||
+	(pa->pa_op == OP_RENAME);
 }
 
 /// Boolean - returns true iff the operation was a hard link.
@@ -372,6 +534,16 @@ pa_is_unlink(pa_o pa)
     return pa->pa_op == OP_UNLINK;
 }
 
+/// Boolean - returns true iff the operation was a rename. The PA
+/// describes the destination; the source is available as path2.
+/// @param[in] pa       the object pointer
+/// @return true or false
+int
+pa_is_rename(pa_o pa)
+{
+    return pa->pa_op == OP_RENAME;
+}
+
 /// Delegates to ps_exists().
 int
 pa_exists(pa_o pa)
@@ -433,6 +605,13 @@ pa_has_dcode(pa_o pa)
     return ps_has_dcode(pa_get_ps(pa));
 }
 
+/// Delegates to ps_has_stats().
+int
+pa_has_stats(pa_o pa)
+{
+    return ps_has_stats(pa_get_ps(pa));
+}
+
 /// Delegates to ps_stat().
 /// @param[in] pa               the object pointer
 /// @param[in] want_dcode       boolean - derive dcode iff true
@@ -487,7 +666,7 @@ pa_copy(pa_o cpa)
 // Generally the 'call' is supplied as a literal string (e.g. "open")
 // so it could be used as is. But for consistency and to avoid
 // subtle bugs we malloc and free it like other values.
-GEN_SETTER_GETTER_DEFN_STR(pa, call, CCS, NULL)
+GEN_SETTER_GETTER_DEFN_ARENA_STR(pa, call, CCS, NULL, arena_intern)
 
 GEN_SETTER_GETTER_DEFN(pa,	op,		op_e)
 GEN_SETTER_GETTER_DEFN(pa,	timestamp,	moment_s)
@@ -495,8 +674,8 @@ GEN_SETTER_GETTER_DEFN(pa,	pid,		unsigned long)
 GEN_SETTER_GETTER_DEFN(pa,	ppid,		unsigned long)
 GEN_SETTER_GETTER_DEFN(pa,	tid,		unsigned long)
 GEN_SETTER_GETTER_DEFN(pa,	depth,		unsigned long)
-GEN_SETTER_GETTER_DEFN_STR(pa,	pccode,		CCS, CSV_NULL_FIELD)
-GEN_SETTER_GETTER_DEFN_STR(pa,	ccode,		CCS, CSV_NULL_FIELD)
+GEN_SETTER_GETTER_DEFN_ARENA_STR(pa, pccode, CCS, CSV_NULL_FIELD, arena_intern)
+GEN_SETTER_GETTER_DEFN_ARENA_STR(pa, ccode, CCS, CSV_NULL_FIELD, arena_intern)
 GEN_SETTER_GETTER_DEFN(pa,	fd,		int)
 GEN_SETTER_GETTER_DEFN(pa,	uploadable,	int)
 GEN_SETTER_GETTER_DEFN(pa,	ps,		ps_o)
@@ -525,6 +704,12 @@ pa_destroy(pa_o pa)
     // Free the contained ps object.
     ps_destroy(pa->pa_ps);
 
+    // Everything else in an arena goes when the arena is reset.
+    if (pa->pa_arena) {
+	arena_free(pa->pa_arena, pa);
+	return;
+    }
+
     // Free all string pointers.
     putil_free(pa->pa_call);
     putil_free(pa->pa_pccode);
@@ -74,6 +74,12 @@ sub is_unlink {
     return $op eq 'U';
 }
 
+sub is_rename {
+    my $self = shift;
+    my $op = $self->{PA_OP};
+    return $op eq 'M';
+}
+
 sub is_symlink {
     my $self = shift;
     my $op = $self->{PA_OP};
@@ -25,6 +25,7 @@
 
 #include "AO.h"
 
+#include "ARENA.h"
 #include "PN.h"
 #include "PROP.h"
 
@@ -32,8 +33,45 @@
 struct path_name_s {
     CCS pn_abs;			///< canonicalized absolute path
     int pn_rel;			///< project-relative offset into pn_abs
+    arena_o pn_arena;		///< where it lives, if not the heap
 } path_name_s;
 
+/// @cond static
+#define PN_CACHE_SLOTS		1024
+/// @endcond static
+
+/// An entry in a cache of canonicalized paths.
+typedef struct {
+    CS pce_path;		///< the path as presented
+    CS pce_abs;			///< its canonicalized absolute form
+    int pce_rel;		///< project-relative offset into pce_abs
+    unsigned long pce_gen;	///< cwd generation, or 0 if path was absolute
+} pn_cache_entry_s;
+
+/// Object structure for a cache of canonicalized paths.
+struct pn_cache_s {
+    pn_cache_entry_s *pc_slots;	///< direct-mapped by path hash
+    CS pc_cwd;			///< the cwd, if known
+    unsigned long pc_cwdgen;	///< generation pc_cwd was taken in
+    dev_t pc_cwddev;		///< device of pc_cwd
+    ino_t pc_cwdino;		///< inode of pc_cwd
+};
+
+// The auditor sees the same relative paths (headers, mostly) over
+// and over, so it may turn on a small direct-mapped cache of their
+// canonical forms along with a cached copy of the cwd. Entries for
+// relative paths are tagged with a generation number which changes
+// whenever the cwd may have, so a chdir invalidates them implicitly.
+// Not every chdir passes through a wrapper (raw syscalls, and libc's
+// internal __chdir as used by nftw and fts, do not) so the identity
+// of "." is also remembered and checked before the cached cwd is used.
+// A cache must not be used by two threads at once, so a threaded
+// caller may give each thread its own; the generation is shared by
+// all of them since the cwd belongs to the process, and is therefore
+// only touched atomically.
+static pn_cache_o PnCache;
+static volatile unsigned long PnCwdGen = 1;
+
 static int64_t _pn_path_canon(CCS, CCS, CS, CCS, CCS, int);
 
 static int
@@ -77,19 +115,165 @@ _pn_make_project_relative(CCS path)
     return putil_strdup(path);
 }
 
-/// Constructor.
-/// Accepts either absolute or relative paths as input.
-/// Relative paths may be interpreted vs the current working directory
-/// or the project base directory depending on the boolean parameter.
-/// Note that this does not require the named file to exist; all
-/// path work here is entirely abstract.
-/// @param[in] path     a string representing the path
-/// @param[in] use_cwd  boolean - relative to CWD (true) or RWD (false)
-/// @return a new PathName object
-pn_o
-pn_new(CCS path, int use_cwd)
+// Internal service routine. Allocates a PN for the given absolute
+// path. If "owned" the path was allocated by the caller and now
+// belongs to the PN. Otherwise, and always in an arena, the object
+// and a copy of its path share a single allocation so it can be
+// given back as a unit.
+static pn_o
+_pn_alloc(arena_o arena, CCS abs, int owned)
 {
     pn_o pn;
+    size_t len;
+
+    if (arena) {
+	len = strlen(abs) + 1;
+	pn = (pn_o)arena_alloc(arena, sizeof(*pn) + len);
+	pn->pn_abs = (CCS)memcpy(pn + 1, abs, len);
+	pn->pn_arena = arena;
+	if (owned) {
+	    putil_free(abs);
+	}
+    } else if (owned) {
+	pn = (pn_o)putil_malloc(sizeof(*pn));
+	pn->pn_abs = abs;
+	pn->pn_arena = NULL;
+    } else {
+	len = strlen(abs) + 1;
+	pn = (pn_o)putil_malloc(sizeof(*pn) + len);
+	pn->pn_abs = (CCS)memcpy(pn + 1, abs, len);
+	pn->pn_arena = NULL;
+    }
+
+    return pn;
+}
+
+/// Constructor for a cache of the cwd and of canonicalized paths,
+/// for use with pn_newInCache().
+/// @return a new, empty cache
+pn_cache_o
+pn_cache_new(void)
+{
+    pn_cache_o cache;
+
+    cache = (pn_cache_o)putil_calloc(1, sizeof(*cache));
+    cache->pc_slots = (pn_cache_entry_s *)putil_calloc(PN_CACHE_SLOTS,
+	sizeof(*cache->pc_slots));
+
+    return cache;
+}
+
+/// Turns on caching of the cwd and of canonicalized paths within
+/// this process. Changes of directory should be reported via
+/// pn_cache_cwd_changed(); any which are missed are caught by
+/// checking the identity of "." before the cached cwd is used.
+void
+pn_cache_init(void)
+{
+    if (!PnCache) {
+	PnCache = pn_cache_new();
+    }
+}
+
+/// Notes that the cwd may have changed, invalidating the cached
+/// cwd and every cached relative path in every cache. May be
+/// called from any thread without locking.
+void
+pn_cache_cwd_changed(void)
+{
+#if defined(_WIN32)
+    InterlockedIncrement((LONG volatile *)&PnCwdGen);
+#else	/*_WIN32*/
+    (void)__atomic_add_fetch(&PnCwdGen, 1, __ATOMIC_RELEASE);
+#endif	/*_WIN32*/
+}
+
+// Internal service routine. Returns the current cwd generation.
+static unsigned long
+_pn_cache_cwd_gen(void)
+{
+#if defined(_WIN32)
+    return PnCwdGen;
+#else	/*_WIN32*/
+    return __atomic_load_n(&PnCwdGen, __ATOMIC_ACQUIRE);
+#endif	/*_WIN32*/
+}
+
+// Internal service routine. Returns the cwd as cached, first
+// discarding it if the cwd may have changed or if "." is no longer
+// the directory it was taken from. In the latter case every cached
+// relative path goes with it.
+// The stat of "." can't be dropped in favor of the chdir and fchdir
+// wrappers alone, since libc's nftw and fts change directory
+// internally without going through them, and a stale cwd would
+// silently put the wrong paths in the audit. It's skipped only when
+// the generation has already moved on.
+static CCS
+_pn_cache_cwd(pn_cache_o cache)
+{
+    struct __stat64 stbuf;
+    unsigned long gen;
+
+    gen = _pn_cache_cwd_gen();
+
+    if (cache->pc_cwd && cache->pc_cwdgen != gen) {
+	putil_free(cache->pc_cwd);
+	cache->pc_cwd = NULL;
+    }
+
+    if (stat64(".", &stbuf)) {
+	return NULL;
+    }
+
+    if (cache->pc_cwd && (stbuf.st_dev != cache->pc_cwddev ||
+	    stbuf.st_ino != cache->pc_cwdino)) {
+	pn_cache_cwd_changed();
+	gen = _pn_cache_cwd_gen();
+	putil_free(cache->pc_cwd);
+	cache->pc_cwd = NULL;
+    }
+
+    if (!cache->pc_cwd) {
+	if (!(cache->pc_cwd = (CS)util_get_cwd())) {
+	    return NULL;
+	}
+	cache->pc_cwdgen = gen;
+	cache->pc_cwddev = stbuf.st_dev;
+	cache->pc_cwdino = stbuf.st_ino;
+    }
+
+    return cache->pc_cwd;
+}
+
+/// Finalizer - releases the cache and everything in it.
+/// If object is a null pointer, no action occurs.
+/// @param[in] cache    the object pointer
+void
+pn_cache_destroy(pn_cache_o cache)
+{
+    int i;
+
+    if (!cache) {
+	return;
+    }
+
+    for (i = 0; i < PN_CACHE_SLOTS; i++) {
+	putil_free(cache->pc_slots[i].pce_path);
+	putil_free(cache->pc_slots[i].pce_abs);
+    }
+    putil_free(cache->pc_slots);
+    putil_free(cache->pc_cwd);
+    putil_free(cache);
+}
+
+// Internal service routine. Does the work of the constructors,
+// consulting the cache if one is supplied.
+static pn_o
+_pn_new(arena_o arena, pn_cache_o cache, CCS path, int use_cwd)
+{
+    pn_o pn;
+    pn_cache_entry_s *pce = NULL;
+    unsigned long gen = 0;
 
     assert(path);
 
@@ -97,9 +281,31 @@ pn_new(CCS path, int use_cwd)
 	CCS abspath;
 	CS canonpath;
 
+	if (cache) {
+	    if (putil_is_absolute(path)) {
+		gen = 0;
+	    } else if (_pn_cache_cwd(cache)) {
+		gen = cache->pc_cwdgen;
+	    } else {
+		return NULL;
+	    }
+	    pce = cache->pc_slots +
+		util_hash_fun_default(path) % PN_CACHE_SLOTS;
+	    if (pce->pce_path && pce->pce_gen == gen &&
+		    !strcmp(pce->pce_path, path)) {
+		pn = _pn_alloc(arena, pce->pce_abs, 0);
+		pn->pn_rel = pce->pce_rel;
+		return pn;
+	    }
+	}
+
 	// Start by making sure we have an absolute path.
 	if (putil_is_absolute(path)) {
 	    abspath = putil_strdup(path);
+	} else if (cache) {
+	    if (asprintf((CS *)&abspath, "%s/%s", cache->pc_cwd, path) < 0) {
+		return NULL;
+	    }
 	} else {
 	    CCS cwd;
 
@@ -130,18 +336,69 @@ pn_new(CCS path, int use_cwd)
 	putil_free(abspath);
 	// Finally, set up the object with its canonicalized absolute path
 	// plus the PRP offset if any.
-	pn = (pn_o)putil_malloc(sizeof(*pn));
-	pn->pn_abs = canonpath;
+	pn = _pn_alloc(arena, canonpath, 1);
+    } else if (putil_is_absolute(path)) {
+	pn = _pn_alloc(arena, path, 0);
     } else {
-	pn = (pn_o)putil_malloc(sizeof(*pn));
-	pn->pn_abs = _pn_make_project_relative(path);
+	pn = _pn_alloc(arena, _pn_make_project_relative(path), 1);
     }
 
     pn->pn_rel = _pn_abs_to_project_relative_path(pn->pn_abs);
 
+    if (pce) {
+	if (pce->pce_path) {
+	    putil_free(pce->pce_path);
+	    putil_free(pce->pce_abs);
+	}
+	pce->pce_path = putil_strdup(path);
+	pce->pce_abs = putil_strdup(pn->pn_abs);
+	pce->pce_rel = pn->pn_rel;
+	pce->pce_gen = gen;
+    }
+
     return pn;
 }
 
+/// Constructor.
+/// Accepts either absolute or relative paths as input.
+/// Relative paths may be interpreted vs the current working directory
+/// or the project base directory depending on the boolean parameter.
+/// Note that this does not require the named file to exist; all
+/// path work here is entirely abstract.
+/// @param[in] path     a string representing the path
+/// @param[in] use_cwd  boolean - relative to CWD (true) or RWD (false)
+/// @return a new PathName object
+pn_o
+pn_new(CCS path, int use_cwd)
+{
+    return pn_newInArena(NULL, path, use_cwd);
+}
+
+/// Constructor for a PN which lives in an arena until it's reset
+/// (see arena.c). Otherwise the same as pn_new().
+/// @param[in] arena    the arena, or NULL to use the heap
+/// @param[in] path     a string representing the path
+/// @param[in] use_cwd  boolean - relative to CWD (true) or RWD (false)
+/// @return a new PathName object
+pn_o
+pn_newInArena(arena_o arena, CCS path, int use_cwd)
+{
+    return _pn_new(arena, use_cwd ? PnCache : NULL, path, use_cwd);
+}
+
+/// Constructor for a PN relative to the CWD, consulting and updating
+/// the given cache. Otherwise the same as pn_newInArena().
+/// @param[in] arena    the arena, or NULL to use the heap
+/// @param[in] cache    the cache, or NULL for the one turned on by
+///                     pn_cache_init() if any
+/// @param[in] path     a string representing the path
+/// @return a new PathName object
+pn_o
+pn_newInCache(arena_o arena, pn_cache_o cache, CCS path)
+{
+    return _pn_new(arena, cache ? cache : PnCache, path, 1);
+}
+
 /// Boolean - returns true iff the path is a member of the project.
 /// @param[in] pn       the object pointer
 /// @return true or false
@@ -228,8 +485,16 @@ pn_verbosity(pn_o pn, CCS verb, CCS ext)
 void
 pn_destroy(pn_o pn)
 {
-    // Free the only string pointer.
-    putil_free(pn->pn_abs);
+    // An arena PN and its string are a single allocation.
+    if (pn->pn_arena) {
+	arena_free(pn->pn_arena, pn);
+	return;
+    }
+
+    // Free the only string pointer, unless it came along with the PN.
+    if (pn->pn_abs != (CCS)(pn + 1)) {
+	putil_free(pn->pn_abs);
+    }
 
     // Zero-fill the struct before freeing it - nicer for debugging.
     (void)memset(pn, 0, sizeof(*pn));
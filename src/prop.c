@@ -60,6 +60,9 @@ static WCHAR PropEnvPrefixW[128];
 static char PropEnvPrefix[128];
 static size_t PropEnvPrefixLen;
 
+// Bumped whenever a value or export flag changes; see prop_get_generation().
+static unsigned long PropGeneration;
+
 static void _prop_export(prop_e);
 
 /// @cond static
@@ -234,6 +237,33 @@ static struct {
 	0,
 	P_ALLOWED_WRITE_PATH_RE,
     },
+    {
+	"Audit.Flush.Count",
+	NULL,
+	"Deliver audit records early once this many are held (0 = never)",
+	"10000",
+	PROP_FLAG_PUBLIC | PROP_FLAG_EXPORT,
+	0,
+	P_AUDIT_FLUSH_COUNT,
+    },
+    {
+	"Audit.Flush.Secs",
+	NULL,
+	"Deliver audit records early once held this long (0 = never)",
+	"0",
+	PROP_FLAG_PUBLIC | PROP_FLAG_EXPORT,
+	0,
+	P_AUDIT_FLUSH_SECS,
+    },
+    {
+	"Audit.Format",
+	NULL,
+	"Format of audit records sent to the monitor: csv or binary",
+	"csv",
+	PROP_FLAG_PUBLIC | PROP_FLAG_EXPORT,
+	0,
+	P_AUDIT_FORMAT,
+    },
     {
 	"Audit.Ignore.Path.RE",
 	NULL,
@@ -296,6 +326,24 @@ static struct {
 	0,
 	P_DCODE_CACHE_SECS,
     },
+    {
+	"Dcode.Close",
+	NULL,
+	"Derive the data-code of each written file as it's closed",
+	NULL,
+	PROP_FLAG_PUBLIC | PROP_FLAG_EXPORT,
+	0,
+	P_DCODE_CLOSE,
+    },
+    {
+	"Dcode.Workers",
+	NULL,
+	"Max number of threads deriving the data-codes of a cmd (0 = none)",
+	"4",
+	PROP_FLAG_PRIVATE,
+	0,
+	P_DCODE_WORKERS,
+    },
     {
 	"DEPTH",
 	NULL,
@@ -463,6 +511,15 @@ static struct {
 	0,
 	P_MONITOR_HOST,
     },
+    {
+	"Monitor.Persistent",
+	NULL,
+	"Boolean - keep one monitor connection open from SOA to EOA",
+	PROP_FALSE,
+	PROP_FLAG_PUBLIC | PROP_FLAG_EXPORT,
+	0,
+	P_MONITOR_PERSISTENT,
+    },
     {
 	"Monitor.Platform",
 	NULL,
@@ -589,6 +646,15 @@ static struct {
 	0,
 	P_PTX_STRATEGY,
     },
+    {
+	"Publish.Workers",
+	NULL,
+	"Max number of threads formatting finished audits (0 = none)",
+	"4",
+	PROP_FLAG_PRIVATE,
+	0,
+	P_PUBLISH_WORKERS,
+    },
     {
 	"Reuse.Roadmap",
 	NULL,
@@ -598,6 +664,24 @@ static struct {
 	0,
 	P_REUSE_ROADMAP,
     },
+    {
+	"Ring.Name",
+	NULL,
+	"Name of the shared-memory region used for audit delivery",
+	NULL,
+	PROP_FLAG_INTERNAL | PROP_FLAG_EXPORT,
+	0,
+	P_RING_NAME,
+    },
+    {
+	"Ring.Slots",
+	NULL,
+	"Number of shared-memory ring buffers for audit delivery (0 = off)",
+	"0",
+	PROP_FLAG_PRIVATE,
+	0,
+	P_RING_SLOTS,
+    },
     {
 	"Roadmap.File",
 	NULL,
@@ -607,6 +691,15 @@ static struct {
 	0,
 	P_ROADMAPFILE,
     },
+    {
+	"Roadmap.Filter",
+	NULL,
+	"Name of the shared-memory filter of commands in the roadmap",
+	NULL,
+	PROP_FLAG_INTERNAL | PROP_FLAG_EXPORT,
+	0,
+	P_ROADMAP_FILTER,
+    },
     {
 	"Server",
 	NULL,
@@ -675,6 +768,24 @@ static struct {
 	0,
 	P_SHOP_TIME_PRECISION,
     },
+    {
+	"Shop.Workers",
+	NULL,
+	"Max number of concurrent background shopping processes (0 = none)",
+	"4",
+	PROP_FLAG_PRIVATE,
+	0,
+	P_SHOP_WORKERS,
+    },
+    {
+	"Stat.Uring",
+	NULL,
+	"Stat a CA's non-member reads together via io_uring (Linux only)",
+	PROP_FALSE,
+	PROP_FLAG_PUBLIC | PROP_FLAG_EXPORT,
+	0,
+	P_STAT_URING,
+    },
     {
 	"Strict",
 	NULL,
@@ -1097,6 +1208,7 @@ _prop_put_str(prop_e prop, CCS val)
 {
     if (!_prop_get_value(prop)) {
 	proptab[prop].pr_value = putil_strdup(val);
+	PropGeneration++;
 	if (proptab[prop].pr_flags & PROP_FLAG_EXPORT) {
 	    _prop_export(prop);
 	}
@@ -1192,6 +1304,7 @@ prop_unset(prop_e prop, int unexport)
     if (proptab[prop].pr_value) {
 	putil_free(proptab[prop].pr_value);
 	proptab[prop].pr_value = NULL;
+	PropGeneration++;
 	// If the user sets an unexported property explicitly via an EV
 	// we do NOT want to remove it from the environment here.
 	if (unexport && (proptab[prop].pr_flags & PROP_FLAG_EXPORT)) {
@@ -1200,6 +1313,16 @@ prop_unset(prop_e prop, int unexport)
     }
 }
 
+/// Returns a counter which changes whenever any property is set,
+/// modified, unset, or unexported. Anything derived from the
+/// properties table may be cached until this changes.
+/// @return the current generation of the properties table
+unsigned long
+prop_get_generation(void)
+{
+    return PropGeneration;
+}
+
 /// Returns the name of the current application.
 /// Each Property 'object' has a special "app" property.
 /// This value is prefixed to env vars representing properties.
@@ -1437,6 +1560,7 @@ prop_unexport(prop_e prop, int forever)
 
     if (forever) {
 	proptab[prop].pr_flags &= ~PROP_FLAG_EXPORT;
+	PropGeneration++;
     }
 
     return;
@@ -1596,6 +1720,7 @@ prop_mod_str(prop_e prop, CCS val, char *const *envp)
 
 	ovlen = strlen(proptab[prop].pr_value);
 	snprintf(proptab[prop].pr_value, ovlen + 1, "%*s", ovlen, val);
+	PropGeneration++;
     }
 
     _prop_to_ev(prop, nbuf, charlen(nbuf));
@@ -30,6 +30,7 @@
 
 #include "AO.h"
 
+#include "ARENA.h"
 #include "CODE.h"
 #include "PN.h"
 #include "PROP.h"
@@ -39,8 +40,23 @@
 
 #include "curl/curl.h"
 
+#if defined(HAVE_IO_URING)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#if defined(STATX_BASIC_STATS) && defined(__NR_io_uring_setup)
+#define PS_USE_URING
+#endif
+#endif	/*HAVE_IO_URING*/
+
 /// @cond static
 #define	PS_NO_DCODE			""
+
+// Batches smaller than this are not worth setting up a ring for.
+#define	PS_URING_MIN			16
+#define	PS_URING_ENTRIES		256
 /// @endcond static
 
 /// Related to but subtly different from PA ops. These describe a
@@ -67,6 +83,7 @@ struct path_state_s {
     pn_o ps_pn2;		///< used for some link ops
     CCS ps_target;		///< target text, if symlink
     ps_e ps_datatype;		///< file type: 'f', 's', etc
+    arena_o ps_arena;		///< where it lives, if not the heap
 } path_state_s;
 
 static moment_s Ref_Time;
@@ -87,6 +104,25 @@ ps_new(void)
     return ps;
 }
 
+/// Constructor for a PS which lives in an arena until it's reset
+/// (see arena.c), along with all the strings set into it.
+/// @param[in] arena    the arena, or NULL to use the heap
+/// @return a new PathState object
+ps_o
+ps_newInArena(arena_o arena)
+{
+    ps_o ps;
+
+    if (!arena) {
+	return ps_new();
+    }
+
+    ps = (ps_o)arena_alloc(arena, sizeof(*ps));
+    ps->ps_arena = arena;
+    ps->ps_datatype = PS_FILE;	// default
+    return ps;
+}
+
 /// Constructor.
 /// @param[in] path     a string representing the path
 /// @return a new PathState object
@@ -419,6 +455,118 @@ _ps_set_modtime(CCS path, moment_s *mptr, struct __stat64 *stp)
     return 0;
 }
 
+// Internal service routine. Stores the results of a stat call.
+static int
+_ps_set_stats(ps_o ps, CCS path, struct __stat64 *stp)
+{
+    ps->ps_size = stp->st_size;
+    ps->ps_mode = stp->st_mode;
+
+    if (S_ISDIR(stp->st_mode)) {
+	ps_set_dir(ps);
+    }
+
+    if (_ps_set_modtime(path, &(ps->ps_moment), stp)) {
+	putil_syserr(0, path);
+	return -1;
+    }
+
+    return 0;
+}
+
+// Internal service routine. Does the work of ps_stat() once the
+// path has been successfully lstat-ed.
+static int
+_ps_stat_apply(ps_o ps, CCS path, struct __stat64 *stp, int want_dcode)
+{
+    if (_ps_set_stats(ps, path, stp)) {
+	return -1;
+    }
+#if !defined(_WIN32)
+    if (S_ISLNK(stp->st_mode)) {
+	ps_set_symlinked(ps);
+	if (!ps_get_target(ps)) {
+	    CCS lbuf;
+
+	    if ((lbuf = putil_readlink(path))) {
+		ps_set_target(ps, lbuf);
+		putil_free(lbuf);
+	    } else {
+		putil_syserr(0, path);
+		return -1;
+	    }
+	}
+    }
+#endif	/*_WIN32*/
+
+    if (want_dcode) {
+	CCS dcode;
+
+	char dcbuf[CODE_IDENTITY_HASH_MAX_LEN];
+
+	if (ps_is_file(ps)) {
+	    if ((dcode = _ps_get_cached_dcode(ps, path))) {
+		ps_set_dcode(ps, dcode);
+	    } else if ((dcode = code_from_path(path, dcbuf, sizeof(dcbuf)))) {
+		ps_set_dcode(ps, dcode);
+		_ps_set_cached_dcode(ps, path);
+	    } else {
+		ps_set_dcode(ps, NULL);
+		return -1;
+	    }
+	} else if (ps_is_symlink(ps)) {
+	    CCS tgt;
+
+	    // For symlinks, we use the target as the "file contents".
+	    tgt = ps_get_target(ps);
+	    if ((dcode = code_from_buffer((const unsigned char *)tgt,
+					  strlen(tgt), path, dcbuf,
+					  sizeof(dcbuf)))) {
+		ps_set_dcode(ps, dcode);
+		_ps_set_cached_dcode(ps, path);
+	    } else {
+		ps_set_dcode(ps, NULL);
+		return -1;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/// Samples the file open on the supplied descriptor, which must
+/// refer to the contained pathname, and stores its vital statistics.
+/// Like ps_stat() a symlink is described as itself, since that's how
+/// shopping will see it later. Otherwise the open file is sampled,
+/// which describes what was actually read even if the path has since
+/// been replaced by another regular file.
+/// @param[in] ps               the object pointer
+/// @param[in] fd               a file descriptor
+/// @return 0 on success
+int
+ps_fstat(ps_o ps, int fd)
+{
+    CCS path;
+
+    struct __stat64 stbuf;
+
+    path = ps_get_abs(ps);	// convenience
+
+    if (lstat64(path, &stbuf)) {
+	return -1;
+    }
+
+    if (!S_ISREG(stbuf.st_mode)) {
+	return _ps_stat_apply(ps, path, &stbuf, 0);
+    }
+
+    if (fstat64(fd, &stbuf)) {
+	return -1;
+    }
+
+    return _ps_set_stats(ps, path, &stbuf);
+}
+
 /// Samples the contained pathname and stores its vital statistics.
 /// @param[in] ps               the object pointer
 /// @param[in] want_dcode       boolean - derive dcode iff true
@@ -477,68 +625,228 @@ ps_stat(ps_o ps, int want_dcode)
 	return -1;
     }
 
-    ps->ps_size = stbuf.st_size;
-    ps->ps_mode = stbuf.st_mode;
+    return _ps_stat_apply(ps, path, &stbuf, want_dcode);
+}
 
-    if (S_ISDIR(stbuf.st_mode)) {
-	ps_set_dir(ps);
+#if defined(PS_USE_URING)
+// Internal service routine. Submits an lstat-equivalent statx for each
+// path through an io_uring so the lookups proceed concurrently in the
+// kernel rather than one after another. Results are left in stbufs
+// and rcs as lstat64() would leave them. Returns -1 if no ring could
+// be set up, in which case the caller must do the work itself.
+// Entries the kernel could not handle (e.g. pre-5.6 kernels which know
+// io_uring but not IORING_OP_STATX) are retried with lstat64().
+static int
+_ps_uring_statx(CCS *paths, int count, struct __stat64 *stbufs, int *rcs)
+{
+    struct io_uring_params params;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    struct statx *stxs;
+    unsigned char *sqring, *cqring;
+    size_t sqlen, cqlen, sqelen;
+    unsigned *sqtail, *sqarray, *cqhead, *cqtail;
+    unsigned sqmask, cqmask;
+    int ringfd, done, i;
+
+    memset(&params, 0, sizeof(params));
+    ringfd = (int)syscall(__NR_io_uring_setup, PS_URING_ENTRIES, &params);
+    if (ringfd < 0) {
+	return -1;
     }
 
-    if (_ps_set_modtime(path, &(ps->ps_moment), &stbuf)) {
-	putil_syserr(0, path);
+    sqlen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqlen = params.cq_off.cqes +
+	params.cq_entries * sizeof(struct io_uring_cqe);
+    sqelen = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sqring = (unsigned char *)mmap(NULL, sqlen, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ringfd,
+				   IORING_OFF_SQ_RING);
+    cqring = (unsigned char *)mmap(NULL, cqlen, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ringfd,
+				   IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe *)mmap(NULL, sqelen, PROT_READ | PROT_WRITE,
+				       MAP_SHARED | MAP_POPULATE, ringfd,
+				       IORING_OFF_SQES);
+    if (sqring == MAP_FAILED || cqring == MAP_FAILED || sqes == MAP_FAILED) {
+	if (sqring != MAP_FAILED) {
+	    (void)munmap(sqring, sqlen);
+	}
+	if (cqring != MAP_FAILED) {
+	    (void)munmap(cqring, cqlen);
+	}
+	if ((void *)sqes != MAP_FAILED) {
+	    (void)munmap(sqes, sqelen);
+	}
+	(void)close(ringfd);
 	return -1;
     }
-#if !defined(_WIN32)
-    if (S_ISLNK(stbuf.st_mode)) {
-	ps_set_symlinked(ps);
-	if (!ps_get_target(ps)) {
-	    CCS lbuf;
 
-	    if ((lbuf = putil_readlink(path))) {
-		ps_set_target(ps, lbuf);
-		putil_free(lbuf);
-	    } else {
-		putil_syserr(0, path);
-		return -1;
-	    }
-	}
+    sqtail = (unsigned *)(sqring + params.sq_off.tail);
+    sqmask = *(unsigned *)(sqring + params.sq_off.ring_mask);
+    sqarray = (unsigned *)(sqring + params.sq_off.array);
+    cqhead = (unsigned *)(cqring + params.cq_off.head);
+    cqtail = (unsigned *)(cqring + params.cq_off.tail);
+    cqmask = *(unsigned *)(cqring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cqring + params.cq_off.cqes);
+
+    stxs = (struct statx *)putil_calloc(count, sizeof(*stxs));
+
+    for (i = 0; i < count; i++) {
+	rcs[i] = -1;
     }
-#endif	/*_WIN32*/
 
-    if (want_dcode) {
-	CCS dcode;
+    // Feed the ring a chunk at a time, waiting for each
+    // chunk to complete before queueing the next.
+    for (done = 0; done < count;) {
+	unsigned tail, head;
+	int chunk, reaped;
 
-	char dcbuf[CODE_IDENTITY_HASH_MAX_LEN];
+	chunk = count - done;
+	if (chunk > (int)params.sq_entries) {
+	    chunk = (int)params.sq_entries;
+	}
 
-	if (ps_is_file(ps)) {
-	    if ((dcode = _ps_get_cached_dcode(ps, path))) {
-		ps_set_dcode(ps, dcode);
-	    } else if ((dcode = code_from_path(path, dcbuf, sizeof(dcbuf)))) {
-		ps_set_dcode(ps, dcode);
-		_ps_set_cached_dcode(ps, path);
-	    } else {
-		ps_set_dcode(ps, NULL);
-		return -1;
+	tail = *sqtail;
+	for (i = done; i < done + chunk; i++, tail++) {
+	    struct io_uring_sqe *sqe;
+
+	    sqe = &sqes[tail & sqmask];
+	    memset(sqe, 0, sizeof(*sqe));
+	    sqe->opcode = IORING_OP_STATX;
+	    sqe->fd = AT_FDCWD;
+	    sqe->addr = (unsigned long)paths[i];
+	    sqe->len = STATX_BASIC_STATS;
+	    sqe->off = (unsigned long)&stxs[i];
+	    sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+	    sqe->user_data = (unsigned)i;
+	    sqarray[tail & sqmask] = tail & sqmask;
+	}
+	__atomic_store_n(sqtail, tail, __ATOMIC_RELEASE);
+
+	if (syscall(__NR_io_uring_enter, ringfd, chunk, chunk,
+		    IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+	    // Whatever was queued is abandoned; lstat the rest.
+	    for (i = done; i < count; i++) {
+		rcs[i] = lstat64(paths[i], &stbufs[i]);
 	    }
-	} else if (ps_is_symlink(ps)) {
-	    CCS tgt;
+	    break;
+	}
 
-	    // For symlinks, we use the target as the "file contents".
-	    tgt = ps_get_target(ps);
-	    if ((dcode = code_from_buffer((const unsigned char *)tgt,
-					  strlen(tgt), path, dcbuf,
-					  sizeof(dcbuf)))) {
-		ps_set_dcode(ps, dcode);
-		_ps_set_cached_dcode(ps, path);
-	    } else {
-		ps_set_dcode(ps, NULL);
-		return -1;
+	for (reaped = 0; reaped < chunk;) {
+	    head = *cqhead;
+	    while (head != __atomic_load_n(cqtail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe *cqe;
+		struct __stat64 *stp;
+		struct statx *stx;
+
+		cqe = &cqes[head & cqmask];
+		i = (int)cqe->user_data;
+		stp = &stbufs[i];
+		stx = &stxs[i];
+		if (cqe->res == 0) {
+		    memset(stp, 0, sizeof(*stp));
+		    stp->st_dev = makedev(stx->stx_dev_major,
+					  stx->stx_dev_minor);
+		    stp->st_ino = stx->stx_ino;
+		    stp->st_mode = stx->stx_mode;
+		    stp->st_nlink = stx->stx_nlink;
+		    stp->st_uid = stx->stx_uid;
+		    stp->st_gid = stx->stx_gid;
+		    stp->st_size = stx->stx_size;
+		    stp->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+		    stp->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+		    rcs[i] = 0;
+		} else if (cqe->res == -ENOENT || cqe->res == -ENOTDIR) {
+		    rcs[i] = -1;
+		} else {
+		    rcs[i] = lstat64(paths[i], stp);
+		}
+		head++;
+		reaped++;
+	    }
+	    __atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+
+	    if (reaped < chunk &&
+		    syscall(__NR_io_uring_enter, ringfd, 0, chunk - reaped,
+			    IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+		    errno != EINTR) {
+		// Should never happen. The kernel may still write
+		// into stxs so it's leaked rather than freed; the
+		// unreaped entries are reported as failures.
+		stxs = NULL;
+		done = count;
+		break;
 	    }
 	}
+
+	done += chunk;
+    }
+
+    if (stxs) {
+	putil_free(stxs);
     }
+    (void)munmap(sqes, sqelen);
+    (void)munmap(cqring, cqlen);
+    (void)munmap(sqring, sqlen);
+    (void)close(ringfd);
 
     return 0;
 }
+#endif	/*PS_USE_URING*/
+
+/// Samples a set of PathStates together. The result is the same as
+/// calling ps_stat() on each without dcodes. With Stat.Uring set, and
+/// where the platform allows, the stats are issued as a batch so their
+/// latencies overlap. The kernel hands each one to a worker thread,
+/// so this pays off only where lookups are slow (large sets of files
+/// not recently looked at, network filesystems) and is off by default.
+/// @param[in] pslist           an array of object pointers
+/// @param[in] count            the number of objects in pslist
+/// @return the number of objects which could not be sampled
+int
+ps_stat_batch(ps_o *pslist, int count)
+{
+    CCS *paths;
+    struct __stat64 *stbufs;
+    int *rcs;
+    int i, failures;
+
+    if (count <= 0) {
+	return 0;
+    }
+
+    paths = (CCS *)putil_calloc(count, sizeof(*paths));
+    stbufs = (struct __stat64 *)putil_calloc(count, sizeof(*stbufs));
+    rcs = (int *)putil_calloc(count, sizeof(*rcs));
+
+    for (i = 0; i < count; i++) {
+	paths[i] = ps_get_abs(pslist[i]);
+    }
+
+#if defined(PS_USE_URING)
+    if (count < PS_URING_MIN || !prop_is_true(P_STAT_URING) ||
+	    _ps_uring_statx(paths, count, stbufs, rcs))
+#endif	/*PS_USE_URING*/
+    {
+	for (i = 0; i < count; i++) {
+	    rcs[i] = lstat64(paths[i], &stbufs[i]);
+	}
+    }
+
+    for (failures = i = 0; i < count; i++) {
+	if (rcs[i] || _ps_stat_apply(pslist[i], paths[i], &stbufs[i], 0)) {
+	    failures++;
+	}
+    }
+
+    putil_free(rcs);
+    putil_free(stbufs);
+    putil_free(paths);
+
+    return failures;
+}
 
 /// Boolean - returns true iff the object has a valid dcode.
 /// @param[in] ps               the object pointer
@@ -549,6 +857,16 @@ ps_has_dcode(ps_o ps)
     return ps->ps_dcode != NULL;
 }
 
+/// Boolean - returns true iff the object has been sampled, i.e.
+/// its size, mode, and mtime are known.
+/// @param[in] ps               the object pointer
+/// @return 1 iff the file's statistics are present
+int
+ps_has_stats(ps_o ps)
+{
+    return moment_is_set(ps->ps_moment);
+}
+
 /// Compares two PathState objects. PathState objects are considered
 /// identical if they have the same path, size, type, and dcode. If
 /// no dcode is present, the timestamp is used instead.
@@ -593,7 +911,10 @@ ps_copy(ps_o cps)
     ps_set_size(nps, ps_get_size(cps));
     ps_set_mode(nps, ps_get_mode(cps));
     ps_set_dcode(nps, ps_get_dcode(cps));
-    ps_set_pn2(nps, ps_get_pn2(cps));
+    if (ps_get_pn2(cps)) {
+	// Each PS destroys its own PNs so this one can't be shared.
+	ps_set_pn2(nps, pn_new(ps_get_abs2(cps), 1));
+    }
     ps_set_target(nps, ps_get_target(cps));
 
     return nps;
@@ -654,6 +975,98 @@ ps_toCSVString(ps_o ps)
     return buf;
 }
 
+/// Serializes a PS into the binary record format: the numeric
+/// fields followed by the strings, in an order which must match
+/// ps_newFromBinary().
+/// @param[in] ps       the object pointer
+/// @param[out] buf     where to put it, or NULL to just measure
+/// @return the number of bytes written, or at most required
+size_t
+ps_toBinary(ps_o ps, CS buf)
+{
+    CCS target;
+    CS p;
+
+    // Unlike the CSV format the link target needs no encoding.
+    if (!(target = ps_get_rel2(ps))) {
+	target = ps_get_target(ps);
+    }
+
+    if (!buf) {
+	return 5 * BIN_INT_MAX_SIZE +
+	    util_bin_str_size(ps_get_fsname(ps)) +
+	    util_bin_str_size(ps_get_dcode(ps)) +
+	    util_bin_str_size(target) +
+	    util_bin_str_size(ps_get_rel(ps));
+    }
+
+    p = buf;
+    p = util_bin_put_uint(p, (uint64_t)ps->ps_datatype);
+    p = util_bin_put_int(p, ps->ps_moment.ntv_sec);
+    p = util_bin_put_int(p, ps->ps_moment.ntv_nsec);
+    p = util_bin_put_int(p, ps_get_size(ps));
+    p = util_bin_put_uint(p, (uint64_t)ps_get_mode(ps));
+    p = util_bin_put_str(p, ps_get_fsname(ps));
+    p = util_bin_put_str(p, ps_get_dcode(ps));
+    p = util_bin_put_str(p, target);
+    p = util_bin_put_str(p, ps_get_rel(ps));
+
+    return p - buf;
+}
+
+/// Converts a PS in binary record format back to an object.
+/// Strings are used in place rather than parsed out into copies.
+/// @param[in] buf      the start of the PS within the record
+/// @param[in] end      the end of the record
+/// @return a new PathState object, or NULL if the data is malformed
+ps_o
+ps_newFromBinary(CCS buf, CCS end)
+{
+    uint64_t datatype, mode;
+    int64_t sec, nsec, size;
+    CCS fsname, dcode, target, path;
+    moment_s moment;
+    ps_o ps;
+
+    // *INDENT-OFF*
+    if (    !(buf = util_bin_get_uint(buf, end, &datatype)) ||
+	    !(buf = util_bin_get_int(buf, end, &sec)) ||
+	    !(buf = util_bin_get_int(buf, end, &nsec)) ||
+	    !(buf = util_bin_get_int(buf, end, &size)) ||
+	    !(buf = util_bin_get_uint(buf, end, &mode)) ||
+	    !(buf = util_bin_get_str(buf, end, &fsname)) ||
+	    !(buf = util_bin_get_str(buf, end, &dcode)) ||
+	    !(buf = util_bin_get_str(buf, end, &target)) ||
+	    !(buf = util_bin_get_str(buf, end, &path))) {
+	return NULL;
+    }
+    // *INDENT-ON*
+
+    ps = ps_new();
+
+    moment.ntv_sec = sec;
+    moment.ntv_nsec = (long)nsec;
+
+    ps_set_datatype(ps, (int)datatype);
+    ps_set_fsname(ps, *fsname ? fsname : NULL);
+    ps_set_moment(ps, moment);
+    ps_set_size(ps, size);
+    ps_set_mode(ps, (mode_t)mode);
+    ps_set_dcode(ps, dcode);
+
+    if (*target) {
+	if (datatype == PS_SYMLINK) {
+	    ps_set_target(ps, target);
+	} else {
+	    ps_set_pn2(ps, pn_new(target, 0));
+	}
+    }
+
+    ps_set_pn(ps, pn_new(path, 0));
+
+    return ps;
+}
+
 /// Format a PS for human consumption.
 /// The resulting string contains a trailing newline.
 /// @param[in] ps       the object pointer
@@ -807,13 +1220,13 @@ ps_get_datatype(ps_o ps)
 // *INDENT-OFF*
 GEN_SETTER_GETTER_DEFN(ps, moment, moment_s)
 GEN_SETTER_GETTER_DEFN(ps, size, int64_t)
-GEN_SETTER_GETTER_DEFN_STR(ps, dcode, CCS, PS_NO_DCODE)
+GEN_SETTER_GETTER_DEFN_ARENA_STR(ps, dcode, CCS, PS_NO_DCODE, arena_strdup)
 GEN_SETTER_GETTER_DEFN(ps, mode, mode_t)
 
-GEN_SETTER_GETTER_DEFN_STR(ps, fsname, CCS, NULL)
+GEN_SETTER_GETTER_DEFN_ARENA_STR(ps, fsname, CCS, NULL, arena_intern)
 GEN_SETTER_GETTER_DEFN(ps, pn,  pn_o)
 GEN_SETTER_GETTER_DEFN(ps, pn2, pn_o)
-GEN_SETTER_GETTER_DEFN_STR(ps, target, CCS, NULL)
+GEN_SETTER_GETTER_DEFN_ARENA_STR(ps, target, CCS, NULL, arena_strdup)
 
 GEN_DELEGATE_GETTER_DEFN(ps, pn, abs, CCS)
 GEN_DELEGATE_GETTER_DEFN(ps, pn, rel, CCS)
@@ -835,6 +1248,11 @@ ps_destroy(ps_o ps)
     if (ps->ps_pn2) {
 	pn_destroy(ps->ps_pn2);
     }
+    // Everything else in an arena goes when the arena is reset.
+    if (ps->ps_arena) {
+	arena_free(ps->ps_arena, ps);
+	return;
+    }
     // Free all string pointers.
     putil_free(ps->ps_dcode);
     putil_free(ps->ps_fsname);
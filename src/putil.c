@@ -19,3 +19,14 @@
 // to be exported for use by other object modules.
 #define PUTIL_DECLARE_FUNCTIONS_GLOBAL
 #include "Putil/putil.h"
+
+/// Registers a function which says where messages should go, or
+/// NULL to send them to stderr again. This is the one piece of putil
+/// which lives here: it's only of use to a multithreaded program, and
+/// as a static function in the header it would go unused elsewhere.
+/// @param[in] func     returns the stream for the calling thread, or NULL
+void
+putil_set_msg_stream(FILE *(*func)(void))
+{
+    Putil_Msg_Stream = func;
+}
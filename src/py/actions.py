@@ -129,6 +129,11 @@ class PathAction(object):
         """Report whether this path action represents a file removal."""
         return self.op == 'U'
 
+    @property
+    def is_rename(self):
+        """Report whether this path action represents a rename into place."""
+        return self.op == 'M'
+
     @property
     def is_dir(self):
         """Report whether this path action represents a mkdir."""
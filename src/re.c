@@ -64,36 +64,125 @@ re_init__(CCS name, CCS restr)
     return re;
 }
 
+/*
+ * Internal service routine. Returns an allocated copy of the regular
+ * expression held in the specified property, or NULL if none.
+ * Allow REs to be specified as e.g. m%regexp%, partly because
+ * it looks natural to Perl users and partly to make leading and
+ * trailing whitespace possible. However, do NOT treat /regexp/
+ * specially because that could confuse users trying to match
+ * paths containing (say) the 5 characters "/tmp/".
+ */
+static char *
+_re_prop_pattern(prop_e prop)
+{
+    const char *restr;
+    const char *start, *end;
+    char *pattern;
+
+    if ((restr = prop_get_str(prop)) && *restr && !ISSPACE(*restr)) {
+	if (*restr == 'm' && (start = restr + 1) && *start) {
+	    end = strchr(restr, '\0') - 1;
+	    if (end > start && *start == *end && !ISALPHA(*end)) {
+		pattern = putil_strdup(start + 1);
+		pattern[end - start - 1] = '\0';
+		return pattern;
+	    }
+	}
+	return putil_strdup(restr);
+    } else {
+	return NULL;
+    }
+}
+
 /* Documented in the header to avoid triggering some doxygen problem. */
 void *
 re_init_prop__(prop_e prop)
 {
     char *restr;
+    void *re;
+
+    if ((restr = _re_prop_pattern(prop))) {
+	re = re_init__(prop_to_name(prop), restr);
+	putil_free(restr);
+	return re;
+    } else {
+	return NULL;
+    }
+}
+
+/* Documented in the header to avoid triggering some doxygen problem. */
+int
+re_literals_prop__(prop_e prop, void (*found)(CCS, int, void *), void *data)
+{
+    char *restr, *alt, *lit, *p, *q;
+    int depth = 0, inclass = 0, all = 1, exact;
 
-    if ((restr = (char *)prop_get_str(prop)) && *restr && !ISSPACE(*restr)) {
+    if (!(restr = _re_prop_pattern(prop))) {
+	return 0;
+    }
+
+    lit = (char *)putil_malloc(strlen(restr) + 1);
+
+    for (alt = p = restr; ; p++) {
+	/* Find the end of this top-level alternative. */
+	if (*p == '\\' && p[1]) {
+	    p++;
+	    continue;
+	} else if (inclass) {
+	    inclass = *p != ']';
+	    continue;
+	} else if (*p == '[') {
+	    inclass = 1;
+	    continue;
+	} else if (*p == '(') {
+	    depth++;
+	    continue;
+	} else if (*p == ')') {
+	    depth--;
+	    continue;
+	} else if (*p && (*p != '|' || depth)) {
+	    continue;
+	}
 
 	/*
-	 * Allow REs to be specified as e.g. m%regexp%, partly because
-	 * it looks natural to Perl users and partly to make leading and
-	 * trailing whitespace possible. However, do NOT treat /regexp/
-	 * specially because that could confuse users trying to match
-	 * paths containing (say) the 5 characters "/tmp/".
+	 * The alternative lies between alt and p. It qualifies only
+	 * if it's anchored at the start and, apart from an optional
+	 * '$' at the end, consists of ordinary characters or escaped
+	 * punctuation.
 	 */
-	if (*restr == 'm') {
-	    char *start, *end;
-
-	    if ((start = restr + 1) && (end = strchr(restr, '\0'))) {
-		if (--end > start && *start == *end && !ISALPHA(*end)) {
-		    *end = '\0';
-		    restr += 2;
+	exact = 0;
+	q = lit;
+	if (*alt == '^') {
+	    for (alt++; alt < p; alt++) {
+		if (*alt == '\\' && alt + 1 < p && ispunct((int)alt[1])) {
+		    *q++ = *++alt;
+		} else if (*alt == '$' && alt + 1 == p) {
+		    exact = 1;
+		} else if (strchr("\\.[]()*+?{}|^$", *alt)) {
+		    break;
+		} else {
+		    *q++ = *alt;
 		}
 	    }
 	}
+	*q = '\0';
 
-	return re_init__(prop_to_name(prop), restr);
-    } else {
-	return NULL;
+	if (alt == p && *lit) {
+	    found(lit, exact, data);
+	} else {
+	    all = 0;
+	}
+
+	if (!*p) {
+	    break;
+	}
+	alt = p + 1;
     }
+
+    putil_free(lit);
+    putil_free(restr);
+    return all;
 }
 
 /* Documented in the header to avoid triggering some doxygen problem. */
@@ -0,0 +1,573 @@
+// Copyright (c) 2002-2011 David Boyce.  All rights reserved.
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// @file
+/// @brief Shared-memory delivery of audit data from auditor to monitor.
+/// The monitor creates a region containing a fixed number of "slots",
+/// each of which is a single-producer/single-consumer byte ring.
+/// An auditor with something to deliver claims a free slot with an
+/// atomic compare-and-swap, streams its records into it, seals it,
+/// and then waits for the monitor to release the slot. The monitor
+/// copies bytes out as they appear and processes the delivery as
+/// a unit once it's sealed, exactly as if it had arrived on a socket
+/// which was then closed.
+///
+/// Ordering: the SOA still travels synchronously over a socket since
+/// it needs a reply, so it's always seen before any data from the
+/// command or its children. And since an auditor does not proceed
+/// until its slot has been drained and released, a delivery through
+/// the ring is complete before the process can exit or exec, which
+/// is the same guarantee the blocking EOA acknowledgement provides.
+///
+/// If no slot is free, or the ring is unusable for any reason,
+/// the caller falls back to the socket path.
+
+#include "AO.h"
+
+#include "PROP.h"
+#include "RING.h"
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/mman.h>
+#endif	/*!_WIN32*/
+
+/// @cond static
+#define RING_MAGIC			0x414f5231UL
+#define RING_SLOT_BYTES			(64 * 1024)
+#define RING_WAIT_MIN_NSECS		20000L
+#define RING_WAIT_MAX_NSECS		5000000L
+#define RING_SEALED			1UL
+#define RING_ABANDONED			2UL
+/// @endcond static
+
+/// One ring. The head and tail are running byte counts; the
+/// difference between them is the number of unread bytes.
+typedef struct {
+    volatile unsigned long rs_owner;	///< pid of the writer or 0 if free
+    volatile unsigned long rs_sealed;	///< RING_SEALED or RING_ABANDONED
+    volatile unsigned long rs_head;	///< bytes written so far
+    volatile unsigned long rs_tail;	///< bytes consumed so far
+    char rs_data[RING_SLOT_BYTES];	///< the ring itself
+} ring_slot_s;
+
+/// The layout of the shared region.
+typedef struct {
+    unsigned long rh_magic;		///< sanity check
+    unsigned long rh_monitor;		///< pid to signal for a drain
+    unsigned long rh_slots;		///< number of slots following
+    unsigned long rh_pad;		///< keep slots aligned
+    ring_slot_s rh_slot[1];		///< the slots
+} ring_hdr_s;
+
+#if !defined(_WIN32)
+
+// Both sides.
+static ring_hdr_s *Ring;
+static size_t RingSize;
+
+// Monitor side only: a buffer per slot in which deliveries accumulate.
+static char RingName[64];
+static CS *RingBufs;
+static size_t *RingLens;
+
+static size_t
+_ring_size(unsigned long slots)
+{
+    return sizeof(ring_hdr_s) + (slots - 1) * sizeof(ring_slot_s);
+}
+
+// Internal service routine. Sleep briefly with exponential backoff.
+static void
+_ring_backoff(long *nsecsp)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = *nsecsp;
+    (void)nanosleep(&ts, NULL);
+    if (*nsecsp < RING_WAIT_MAX_NSECS) {
+	*nsecsp *= 2;
+    }
+}
+
+// Internal service routine. Ask the monitor to drain.
+static void
+_ring_poke(void)
+{
+    (void)kill((pid_t)Ring->rh_monitor, RING_SIGNAL);
+}
+
+// Internal service routine. Boolean - true if the monitor has died,
+// in which case nobody will ever drain the ring.
+static int
+_ring_monitor_gone(void)
+{
+    return kill((pid_t)Ring->rh_monitor, 0) == -1 && errno == ESRCH;
+}
+
+/// Creates the shared ring region. Called by the monitor before
+/// starting the top-level command.
+/// @param[in] slots    the number of rings to create
+/// @return the name by which auditors may attach, or NULL on failure
+CCS
+ring_create(unsigned long slots)
+{
+    int fd;
+    unsigned long i;
+
+    snprintf(RingName, sizeof(RingName), "/%s.%lu",
+	     APPLICATION_NAME, (unsigned long)getpid());
+
+    RingSize = _ring_size(slots);
+
+    (void)shm_unlink(RingName);
+    if ((fd = shm_open(RingName, O_RDWR | O_CREAT | O_EXCL, 0600)) == -1) {
+	putil_syserr(0, RingName);
+	return NULL;
+    }
+
+    if (ftruncate(fd, RingSize) == -1) {
+	putil_syserr(0, RingName);
+	close(fd);
+	(void)shm_unlink(RingName);
+	return NULL;
+    }
+
+    Ring = (ring_hdr_s *)mmap(NULL, RingSize,
+			      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (Ring == MAP_FAILED) {
+	putil_syserr(0, RingName);
+	Ring = NULL;
+	(void)shm_unlink(RingName);
+	return NULL;
+    }
+
+    Ring->rh_monitor = (unsigned long)getpid();
+    Ring->rh_slots = slots;
+    for (i = 0; i < slots; i++) {
+	Ring->rh_slot[i].rs_owner = 0;
+	Ring->rh_slot[i].rs_sealed = 0;
+	Ring->rh_slot[i].rs_head = 0;
+	Ring->rh_slot[i].rs_tail = 0;
+    }
+
+    RingBufs = (CS *)putil_calloc(slots, sizeof(*RingBufs));
+    RingLens = (size_t *)putil_calloc(slots, sizeof(*RingLens));
+
+    // Publish the magic number last so nobody attaches too early.
+    __sync_synchronize();
+    Ring->rh_magic = RING_MAGIC;
+
+    vb_printf(VB_MON, "RING: %s (%lu slots)", RingName, slots);
+
+    return RingName;
+}
+
+// Internal service routine. Copy whatever is unread in the
+// specified slot into its accumulation buffer.
+static void
+_ring_copy_out(unsigned long i)
+{
+    ring_slot_s *rsp;
+    unsigned long head, tail, n, off, chunk;
+
+    rsp = &Ring->rh_slot[i];
+
+    head = rsp->rs_head;
+    __sync_synchronize();
+    tail = rsp->rs_tail;
+
+    if ((n = head - tail) == 0) {
+	return;
+    }
+
+    RingBufs[i] = (CS)putil_realloc(RingBufs[i], RingLens[i] + n + 1);
+
+    while (tail != head) {
+	off = tail % RING_SLOT_BYTES;
+	chunk = RING_SLOT_BYTES - off;
+	if (chunk > head - tail) {
+	    chunk = head - tail;
+	}
+	memcpy(RingBufs[i] + RingLens[i], rsp->rs_data + off, chunk);
+	RingLens[i] += chunk;
+	tail += chunk;
+    }
+    RingBufs[i][RingLens[i]] = '\0';
+
+    // Hand the space back to the writer.
+    __sync_synchronize();
+    rsp->rs_tail = tail;
+}
+
+// Internal service routine. Return a slot to the free pool.
+static void
+_ring_release(unsigned long i)
+{
+    ring_slot_s *rsp;
+
+    rsp = &Ring->rh_slot[i];
+
+    putil_free(RingBufs[i]);
+    RingBufs[i] = NULL;
+    RingLens[i] = 0;
+
+    rsp->rs_sealed = 0;
+    rsp->rs_head = 0;
+    rsp->rs_tail = 0;
+    __sync_synchronize();
+    rsp->rs_owner = 0;
+}
+
+/// Drains all rings, handing each completed delivery to the supplied
+/// function along with its length, since a delivery of binary records
+/// may contain null bytes. The delivery buffer is null-terminated and
+/// owned by the callee, which must free it. Partial deliveries are
+/// buffered until complete.
+/// @param[in] process  called with each complete delivery
+/// @param[in] data     passed through to the callback
+/// @return the number of complete deliveries processed
+int
+ring_drain(void (*process) (CS, size_t, void *), void *data)
+{
+    unsigned long i;
+    int count = 0;
+
+    if (!Ring) {
+	return 0;
+    }
+
+    for (i = 0; i < Ring->rh_slots; i++) {
+	ring_slot_s *rsp;
+	unsigned long sealed;
+	CS buf;
+	size_t len;
+
+	rsp = &Ring->rh_slot[i];
+
+	if (!rsp->rs_owner) {
+	    continue;
+	}
+
+	// Read the seal before the data so that a sealed slot is
+	// known to be complete after the copy.
+	sealed = rsp->rs_sealed;
+	__sync_synchronize();
+
+	_ring_copy_out(i);
+
+	if (!sealed) {
+	    continue;
+	}
+
+	// The writer has sent this delivery another way.
+	if (sealed == RING_ABANDONED) {
+	    vb_printf(VB_MON, "ABANDONED: RING %lu", i);
+	    _ring_release(i);
+	    continue;
+	}
+
+	if ((buf = RingBufs[i])) {
+	    len = RingLens[i];
+	    RingBufs[i] = NULL;
+	} else {
+	    len = 0;
+	    buf = putil_strdup("");
+	}
+
+	// The writer is blocked until the slot is released, which
+	// mirrors the socket case where it waits for an ACK.
+	(*process)(buf, len, data);
+	_ring_release(i);
+	count++;
+    }
+
+    return count;
+}
+
+/// Recovers slots whose writers died before sealing them.
+void
+ring_reap(void)
+{
+    unsigned long i;
+
+    if (!Ring) {
+	return;
+    }
+
+    for (i = 0; i < Ring->rh_slots; i++) {
+	unsigned long owner;
+
+	if ((owner = Ring->rh_slot[i].rs_owner) &&
+		!Ring->rh_slot[i].rs_sealed &&
+		kill((pid_t)owner, 0) == -1 && errno == ESRCH) {
+	    putil_warn("discarding partial delivery from pid %lu", owner);
+	    _ring_release(i);
+	}
+    }
+}
+
+/// Removes the shared ring region.
+void
+ring_destroy(void)
+{
+    if (Ring) {
+	munmap((void *)Ring, RingSize);
+	Ring = NULL;
+	(void)shm_unlink(RingName);
+	putil_free(RingBufs);
+	putil_free(RingLens);
+	RingBufs = NULL;
+	RingLens = NULL;
+    }
+}
+
+// Internal service routine. Map the monitor's ring region, if any.
+static int
+_ring_attach(void)
+{
+    static int failed;
+    CCS name;
+    int fd;
+    struct stat stbuf;
+    void *addr;
+
+    if (Ring) {
+	return 0;
+    } else if (failed || !(name = prop_get_str(P_RING_NAME))) {
+	return -1;
+    }
+
+    failed = 1;
+
+    if ((fd = shm_open(name, O_RDWR, 0)) == -1) {
+	putil_syserr(0, name);
+	return -1;
+    }
+
+    if (fstat(fd, &stbuf) == -1 || (size_t)stbuf.st_size < sizeof(ring_hdr_s)) {
+	close(fd);
+	return -1;
+    }
+
+    addr = mmap(NULL, stbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+	putil_syserr(0, name);
+	return -1;
+    }
+
+    if (((ring_hdr_s *)addr)->rh_magic != RING_MAGIC) {
+	munmap(addr, stbuf.st_size);
+	return -1;
+    }
+
+    Ring = (ring_hdr_s *)addr;
+    RingSize = stbuf.st_size;
+    failed = 0;
+    return 0;
+}
+
+/// Claims a free ring for a delivery. Called by the auditor.
+/// @return a slot number, or -1 if the ring cannot be used
+int
+ring_open(void)
+{
+    unsigned long i, pid;
+
+    if (_ring_attach()) {
+	return -1;
+    }
+
+    // No point writing into a ring nobody will drain.
+    if (kill((pid_t)Ring->rh_monitor, 0) == -1) {
+	return -1;
+    }
+
+    pid = (unsigned long)getpid();
+
+    for (i = 0; i < Ring->rh_slots; i++) {
+	if (!Ring->rh_slot[i].rs_owner &&
+		__sync_bool_compare_and_swap(&Ring->rh_slot[i].rs_owner,
+		0UL, pid)) {
+	    vb_printf(VB_MON, "OPENED: RING %lu", i);
+	    return (int)i;
+	}
+    }
+
+    vb_printf(VB_MON, "NO FREE RING");
+    return -1;
+}
+
+/// Appends data to a claimed ring, waiting for the monitor to make
+/// room as necessary. Gives up if the monitor dies meanwhile.
+/// @param[in] slot     a slot number returned by ring_open()
+/// @param[in] buf      the data
+/// @param[in] len      the number of bytes
+/// @return 0 on success, -1 if the monitor has gone away
+int
+ring_write(int slot, const void *buf, size_t len)
+{
+    ring_slot_s *rsp;
+    const char *src;
+    unsigned long head, off, chunk, room;
+    long nsecs;
+
+    rsp = &Ring->rh_slot[slot];
+    src = (const char *)buf;
+    nsecs = RING_WAIT_MIN_NSECS;
+
+    while (len > 0) {
+	head = rsp->rs_head;
+	room = RING_SLOT_BYTES - (head - rsp->rs_tail);
+
+	if (room == 0) {
+	    if (nsecs >= RING_WAIT_MAX_NSECS && _ring_monitor_gone()) {
+		return -1;
+	    }
+	    _ring_poke();
+	    _ring_backoff(&nsecs);
+	    continue;
+	}
+
+	off = head % RING_SLOT_BYTES;
+	chunk = RING_SLOT_BYTES - off;
+	if (chunk > room) {
+	    chunk = room;
+	}
+	if (chunk > len) {
+	    chunk = len;
+	}
+
+	memcpy(rsp->rs_data + off, src, chunk);
+
+	// Make sure the data is visible before the new head.
+	__sync_synchronize();
+	rsp->rs_head = head + chunk;
+
+	src += chunk;
+	len -= chunk;
+	nsecs = RING_WAIT_MIN_NSECS;
+    }
+
+    return 0;
+}
+
+/// Seals a ring and blocks until the monitor has consumed the
+/// delivery and released the slot, or has died.
+/// @param[in] slot     a slot number returned by ring_open()
+/// @return 0 on success, -1 if the monitor has gone away
+int
+ring_close(int slot)
+{
+    ring_slot_s *rsp;
+    unsigned long pid;
+    long nsecs;
+
+    rsp = &Ring->rh_slot[slot];
+    pid = (unsigned long)getpid();
+
+    __sync_synchronize();
+    rsp->rs_sealed = RING_SEALED;
+    _ring_poke();
+
+    for (nsecs = RING_WAIT_MIN_NSECS; rsp->rs_owner == pid;) {
+	_ring_backoff(&nsecs);
+	if (nsecs >= RING_WAIT_MAX_NSECS) {
+	    if (_ring_monitor_gone()) {
+		return -1;
+	    }
+	    // In case the first signal was coalesced or lost.
+	    _ring_poke();
+	}
+    }
+
+    vb_printf(VB_MON, "CLOSED: RING %d", slot);
+    return 0;
+}
+
+/// Gives up on a claimed ring without waiting. The monitor discards
+/// whatever was written to it and frees the slot, so the caller may
+/// then send the whole delivery by some other means.
+/// @param[in] slot     a slot number returned by ring_open()
+void
+ring_abandon(int slot)
+{
+    __sync_synchronize();
+    Ring->rh_slot[slot].rs_sealed = RING_ABANDONED;
+    _ring_poke();
+    vb_printf(VB_MON, "ABANDONING: RING %d", slot);
+}
+
+#else	/*_WIN32*/
+
+CCS
+ring_create(unsigned long slots)
+{
+    UNUSED(slots);
+    return NULL;
+}
+
+int
+ring_drain(void (*process) (CS, size_t, void *), void *data)
+{
+    UNUSED(process);
+    UNUSED(data);
+    return 0;
+}
+
+void
+ring_reap(void)
+{
+}
+
+void
+ring_destroy(void)
+{
+}
+
+int
+ring_open(void)
+{
+    return -1;
+}
+
+int
+ring_write(int slot, const void *buf, size_t len)
+{
+    UNUSED(slot);
+    UNUSED(buf);
+    UNUSED(len);
+    return -1;
+}
+
+int
+ring_close(int slot)
+{
+    UNUSED(slot);
+    return -1;
+}
+
+void
+ring_abandon(int slot)
+{
+    UNUSED(slot);
+}
+
+#endif	/*_WIN32*/
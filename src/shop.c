@@ -20,6 +20,7 @@
 
 #include "AO.h"
 
+#include "BLOOM.h"
 #include "CA.h"
 #include "DOWN.h"
 #include "PA.h"
@@ -54,6 +55,7 @@ typedef struct {
     struct cdb *cdbp;		///< Holds current CDB state
     ca_o ca;			///< Describes the cmd we want to match
     int getfiles;		///< Boolean - really get files?
+    int precheck;		///< Boolean - stop before comparing path states
     dict_t *ptx_dict;		///< Holds PTX table
     void *ignore_path_re;	///< RE describing paths to skip
     char winner[32];		///< Will hold the winning PTX id
@@ -770,8 +772,11 @@ _shop_for_cmd(shopping_state_s *ssp, CCS cmdix)
 
     aggregated = IS_TRUE(agg);
 
-    vb_printf(VB_SHOP, "%sCMD MATCH: [%s] (%s) %s",
-	      aggregated ? "AGGREGATED " : "", cmdix, rwd ? rwd : "", line);
+    // A command which passes the precheck is matched again by shop().
+    if (!ssp->precheck) {
+	vb_printf(VB_SHOP, "%sCMD MATCH: [%s] (%s) %s",
+		  aggregated ? "AGGREGATED " : "", cmdix, rwd ? rwd : "", line);
+    }
 
     // If a command has no targets it is ineligible for
     // shopping and must run. Typically this would be
@@ -806,6 +811,12 @@ _shop_for_cmd(shopping_state_s *ssp, CCS cmdix)
 	return SHOP_MUSTRUN;
     }
 
+    // This is as far as a precheck goes; everything from here on
+    // involves looking at path states.
+    if (ssp->precheck) {
+	return SHOP_CANDIDATE;
+    }
+
     // Removed pccode chck here - could't see its value.
 
     // There is no current use for this ...
@@ -878,6 +889,55 @@ shop_init(void)
     }
 }
 
+/// Publishes a filter of all keys in the roadmap, command lines
+/// among them, which lets auditors see for themselves that a command
+/// can't be recycled without waiting to hear it from the monitor.
+/// Must be called before the roadmap is opened by shop_init().
+/// @return the name of the filter, or NULL if there isn't one
+CCS
+shop_filter_create(void)
+{
+    CCS rmap, name;
+    struct cdb cdb;
+    unsigned pos;
+    unsigned long keys;
+    int fd;
+
+    if (!(rmap = prop_get_str(P_ROADMAPFILE))) {
+	return NULL;
+    }
+
+    if ((fd = open64(rmap, O_RDONLY, 0)) == -1) {
+	return NULL;
+    }
+
+    if (cdb_init(&cdb, fd)) {
+	close(fd);
+	return NULL;
+    }
+
+    // Two passes, the first only to size the filter.
+    keys = 0;
+    cdb_seqinit(&pos, &cdb);
+    while (cdb_seqnext(&pos, &cdb) > 0) {
+	keys++;
+    }
+
+    if (keys && (name = bloom_create(keys))) {
+	cdb_seqinit(&pos, &cdb);
+	while (cdb_seqnext(&pos, &cdb) > 0) {
+	    bloom_add(cdb_getkey(&cdb), cdb_keylen(&cdb));
+	}
+    } else {
+	name = NULL;
+    }
+
+    cdb_free(&cdb);
+    close(fd);
+
+    return name;
+}
+
 /// Finalizes shopping data structures.
 void
 shop_fini(void)
@@ -911,6 +971,60 @@ shop_get_count(void)
     return RecycledCount;
 }
 
+/// Accounts for files recycled by a shop() done elsewhere, i.e.
+/// in a worker process.
+/// @param[in] count            the number of files recycled
+void
+shop_add_count(int count)
+{
+    RecycledCount += count;
+}
+
+/// Does the cheap part of shopping: looks the command line up in
+/// the roadmap and checks whether a match is eligible for recycling
+/// at all, without examining any path states. Most commands fail
+/// here (not in the roadmap, no targets, has children, etc.), and
+/// the sooner that's known the sooner the command can proceed.
+/// @param[in] ca               the CA being shopped for
+/// @return SHOP_CANDIDATE if shop() is required, else its verdict
+shop_e
+shop_precheck(ca_o ca)
+{
+    shop_e rc;
+    shopping_state_s shop_state, *ssp = &shop_state;
+    struct cdb_find cdbf;
+    CCS line;
+    char cmdix[64];
+
+    if (!ShopCDB) {
+	return SHOP_OFF;
+    }
+
+    memset(ssp, 0, sizeof(*ssp));
+    ssp->cdbp = ShopCDB;
+    ssp->ca = ca;
+    ssp->precheck = 1;
+
+    line = ca_get_line(ssp->ca);
+
+    if (cdb_findinit(&cdbf, ssp->cdbp, line, strlen(line)) < 0) {
+	putil_die("cdb_findinit (%s)", line);
+    }
+
+    // As in shop(), there may be more than one instance of the line.
+    for (rc = SHOP_NOMATCH; rc != SHOP_CANDIDATE && cdb_findnext(&cdbf) > 0;) {
+	unsigned len;
+
+	len = cdb_datalen(ssp->cdbp);
+	cdb_read(ssp->cdbp, cmdix, len, cdb_datapos(ssp->cdbp));
+	cmdix[len] = '\0';
+
+	rc = _shop_for_cmd(ssp, cmdix);
+    }
+
+    return rc;
+}
+
 /// Traverses the roadmap file, attempting to find build-avoidance
 /// opportunities for the current command. Any files eligible for
 /// recycling are compared to the current state and downloaded
@@ -24,31 +24,48 @@
 #include "AO.h"
 
 #include "ACK.h"
+#include "BLOOM.h"
 #include "CA.h"
 #include "HTTP.h"
 #include "MON.h"
 #include "PROP.h"
+#include "RING.h"
 #include "UW.h"
 
+#include <poll.h>
 #include <signal.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#if defined(linux)
+#include <sys/epoll.h>
+#endif	/*linux*/
+
 #include "Interposer/libinterposer.h"
 
 // This is a "self-pipe" - the monitor process uses it so we can
 // handle "asynchronous-end conditions" - core dumps and the like -
-// via the normal select loop. When the top-level build process
+// via the normal event loop. When the top-level build process
 // ends for any reason, the read end of this pipe becomes ready
 // and the monitor is alerted to that fact. Without this the
-// monitor would hang until the select() timeout.
+// monitor would hang until its wait timed out.
 static int done_pipe[2];
 
+// Another self-pipe, this one written from a signal handler when an
+// auditor wants the shared-memory rings drained.
+static int ring_pipe[2] = {-1, -1};
+
+// The publish pipeline's wakeup pipe, once it's running.
+static int PubFd = -1;
+
 static int doneflag = 0;
 static int ExitStatus = 0;
 static int Started = 0;
+static pid_t ChildPid;
+static int ChildWstat;
+static volatile sig_atomic_t ChildReaped;
 
 // Request the maximum number of file descriptors allowed by the kernel.
 static void
@@ -75,10 +92,22 @@ _maximize_fds(void)
 }
 
 // Used to alert the monitor that the top-level child has ended.
+// Other children (shopping workers) may come and go meanwhile so
+// the top-level one is reaped here to find out which it was.
 static void
 _sigchld(int signum)
 {
+    int saved_errno;
+    pid_t pid;
+
     UNUSED(signum);
+    saved_errno = errno;
+    pid = waitpid(ChildPid, &ChildWstat, WNOHANG);
+    errno = saved_errno;
+    if (pid != ChildPid) {
+	return;
+    }
+    ChildReaped = 1;
     doneflag = 1;
     if (write(done_pipe[1], DONE_TOKEN, strlen(DONE_TOKEN)) == -1) {
 	putil_syserr(2, "write(done_pipe[1])");
@@ -89,6 +118,18 @@ _sigchld(int signum)
     close(done_pipe[1]);
 }
 
+// Used to alert the monitor that an auditor has written to a ring.
+static void
+_sigring(int signum)
+{
+    int saved_errno;
+
+    UNUSED(signum);
+    saved_errno = errno;
+    (void)write(ring_pipe[1], "\n", 1);
+    errno = saved_errno;
+}
+
 // Used to dump debug data from a signal.
 static volatile sig_atomic_t dumpflag;
 static void
@@ -106,7 +147,7 @@ _sig_setup(void)
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = _sigchld;
     sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP | SA_RESETHAND;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
     if (sigaction(SIGCHLD, &sa, NULL) == -1) {
 	putil_syserr(2, "sigaction(SIGCHLD)");
     }
@@ -119,38 +160,1041 @@ _sig_setup(void)
     if (sigaction(SIGUSR1, &sa, NULL) == -1) {
 	putil_syserr(2, "sigaction(SIGUSR1)");
     }
+
+    // Auditors delivering through the shared-memory ring poke us this way.
+    if (ring_pipe[1] != -1) {
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = _sigring;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(RING_SIGNAL, &sa, NULL) == -1) {
+	    putil_syserr(2, "sigaction(RING_SIGNAL)");
+	}
+    }
 }
 
-static CS
-_read_available(int fd)
+// The set of descriptors the monitor waits on: listeners, auditor
+// connections, the self-pipes and the shop server's verdicts. On
+// Linux this is an epoll instance, so the cost of a wait doesn't grow
+// with the number of connections and there's no FD_SETSIZE limit on
+// them. Elsewhere select() is used. Either way Watched[] records
+// what's in the set.
+static char *Watched;
+static int WatchedSize;
+static int WatchMax = -1;
+#if defined(linux)
+static int EpollFd = -1;
+#define WATCH_WAIT		"epoll_wait"
+#else	/*linux*/
+static fd_set WatchFds;
+#define WATCH_WAIT		"select"
+#endif	/*linux*/
+
+// The most descriptors reported ready by a single wait. Any more
+// are simply reported by the next one.
+#define WATCH_EVENTS		256
+
+// How often, in seconds, to look for rings left behind by dead auditors.
+#define RING_REAP_SECS		1
+
+// Internal service routine. Creates the (empty) watch set.
+static void
+_watch_init(void)
 {
-    CS buf;
-    ssize_t bufsize = 1024, len, num;
+#if defined(linux)
+    if ((EpollFd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+	putil_syserr(2, "epoll_create1");
+    }
+#else	/*linux*/
+    FD_ZERO(&WatchFds);
+#endif	/*linux*/
+}
+
+// Internal service routine. Adds a descriptor to the watch set.
+static void
+_watch_add(int fd)
+{
+#if defined(linux)
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+	putil_syserr(2, "epoll_ctl(EPOLL_CTL_ADD)");
+    }
+#else	/*linux*/
+    if (fd >= FD_SETSIZE) {
+	putil_die("too many connections (%d)", fd);
+    }
+    FD_SET(fd, &WatchFds);
+#endif	/*linux*/
 
-    buf = putil_malloc(bufsize);
+    if (fd >= WatchedSize) {
+	int size;
 
-    for (len = 0, buf[0] = '\0'; ;) {
-	num = read(fd, buf + len, bufsize - len - 1);
-	if (num < 0) {
-	    if (errno != EAGAIN) {
-		putil_syserr(2, "read");
+	size = fd + 256;
+	Watched = (char *)putil_realloc(Watched, size);
+	memset(Watched + WatchedSize, 0, size - WatchedSize);
+	WatchedSize = size;
+    }
+    Watched[fd] = 1;
+    if (fd > WatchMax) {
+	WatchMax = fd;
+    }
+}
+
+// Internal service routine. Removes a descriptor from the watch
+// set. This must be done before it's closed.
+static void
+_watch_del(int fd)
+{
+    if (fd >= WatchedSize || !Watched[fd]) {
+	return;
+    }
+    Watched[fd] = 0;
+
+#if defined(linux)
+    if (epoll_ctl(EpollFd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+	putil_syserr(0, "epoll_ctl(EPOLL_CTL_DEL)");
+    }
+#else	/*linux*/
+    FD_CLR(fd, &WatchFds);
+#endif	/*linux*/
+}
+
+// Internal service routine. Returns true if the descriptor is in
+// the watch set. Handling one ready descriptor may close or set
+// aside another reported by the same wait, which must then be
+// left alone.
+static int
+_watch_has(int fd)
+{
+    return fd >= 0 && fd < WatchedSize && Watched[fd];
+}
+
+// Internal service routine. Waits up to the given number of seconds
+// for watched descriptors to become readable and fills in the list
+// of those which are. Returns the count, which may be zero on a
+// timeout, or -1 on error.
+static int
+_watch_wait(int *ready, int max, long secs)
+{
+    int count;
+
+#if defined(linux)
+    struct epoll_event evs[WATCH_EVENTS];
+    int i;
+
+    if (max > WATCH_EVENTS) {
+	max = WATCH_EVENTS;
+    }
+    if ((count = epoll_wait(EpollFd, evs, max, (int)(secs * 1000))) > 0) {
+	for (i = 0; i < count; i++) {
+	    ready[i] = evs[i].data.fd;
+	}
+    }
+#else	/*linux*/
+    struct timeval timeout;
+    fd_set read_fds;
+    int fd;
+
+    // Some implementations of select modify the timeout, which
+    // could cause it to busy-wait as it becomes zero.
+    timeout.tv_sec = secs;
+    timeout.tv_usec = 0;
+    read_fds = WatchFds;
+
+    if ((count = select(WatchMax + 1, &read_fds, NULL, NULL, &timeout)) > 0) {
+	count = 0;
+	for (fd = 0; fd <= WatchMax && count < max; fd++) {
+	    if (FD_ISSET(fd, &read_fds)) {
+		ready[count++] = fd;
 	    }
-	} else if (num == 0) {
-	    if (len && buf[len - 1] != '\n') {
-		putil_warn("Incomplete line: '%s'", buf);
+	}
+    }
+#endif	/*linux*/
+
+    return count;
+}
+
+// Internal service routine. Sends the reply to an SOA.
+// Auditor connections are non-blocking but an ACK is far smaller
+// than a socket buffer, and nothing else is ever sent on them.
+static void
+_send_ack(SOCKET fd, unsigned monrc, CCS winner, CCS line)
+{
+    char ack[ACK_BUFFER_SIZE];
+
+    if (monrc & MON_RECYCLED) {
+	// Tell auditor we recycled so it can exit.
+	snprintf(ack, sizeof(ack), "%s\n", winner);
+    } else if (monrc & MON_STRICT) {
+	// Tell auditor we failed a requirement.
+	snprintf(ack, sizeof(ack), "%s\n", ACK_FAILURE);
+	ExitStatus = 3;
+    } else if (monrc & MON_AGG) {
+	// Tell auditor this command is aggregated.
+	snprintf(ack, sizeof(ack), "%s\n", ACK_OK_AGG);
+    } else {
+	// No special message - carry on.
+	snprintf(ack, sizeof(ack), "%s\n", ACK_OK);
+    }
+
+    if (fd == INVALID_SOCKET) {
+	putil_int("SOA with no reply channel: '%s'", line);
+    } else if (util_send_all(fd, ack, strlen(ack), 0) == -1) {
+	putil_syserr(0, "send(ack)");
+    }
+}
+
+// Shopping which gets as far as comparing path states can take a
+// while, particularly if it ends up downloading files, and the
+// monitor can't afford to stall all other auditors meanwhile. So
+// such commands are shopped for in worker processes while the
+// monitor carries on, and the ACK goes out when the verdict comes
+// back. Processes rather than threads because shopping was never
+// written to be reentrant. At most Shop.Workers run at once; any
+// further jobs wait their turn in order of arrival.
+// The workers aren't forked from the monitor itself, whose dcode
+// and publishing threads may hold locks at the time which would
+// then never be released in the child. Instead a shop server is
+// forked before those threads start and forks a worker for each
+// job it's sent. Jobs go to it as "<id> <CA header>" lines and
+// verdicts come back on a single pipe as "<id> <verdict>" lines,
+// short enough to be written atomically.
+typedef struct shop_job_s {
+    SOCKET sj_fd;		// connection awaiting the ACK
+    ca_o sj_ca;			// the CA being shopped for
+    unsigned long sj_id;	// identifies the job's verdict
+    int sj_started;		// nonzero once sent to the shop server
+    int sj_eof;			// nonzero if the connection hit EOF meanwhile
+    struct shop_job_s *sj_next;
+} shop_job_s;
+
+static shop_job_s *ShopJobs;
+static unsigned long ShopWorkers;
+static unsigned long ShopBusy;
+static unsigned long ShopNextId;
+static pid_t ShopServerPid;
+static int ShopReqFd = -1;
+static int ShopVerdictFd = -1;
+
+// Internal service routine. Queues up a shopping job.
+static void
+_shop_job_add(SOCKET fd, ca_o ca)
+{
+    shop_job_s *sjp, **tail;
+
+    sjp = (shop_job_s *)putil_calloc(1, sizeof(*sjp));
+    sjp->sj_fd = fd;
+    sjp->sj_ca = ca;
+    sjp->sj_id = ++ShopNextId;
+
+    for (tail = &ShopJobs; *tail; tail = &(*tail)->sj_next);
+    *tail = sjp;
+}
+
+// Internal service routine. Returns the job, if any, whose
+// verdict the given connection is waiting for.
+static shop_job_s *
+_shop_job_find(SOCKET fd)
+{
+    shop_job_s *sjp;
+
+    for (sjp = ShopJobs; sjp; sjp = sjp->sj_next) {
+	if (sjp->sj_fd == fd) {
+	    break;
+	}
+    }
+
+    return sjp;
+}
+
+// Internal service routine. The worker side of a shopping job.
+// Everything it learns dies with it except the verdict, the number
+// of files recycled, and the winning PTX, which are written to the
+// pipe.
+static void
+_shop_worker(unsigned long id, CCS hdr, int wfd)
+{
+    shop_e shoprc;
+    int count;
+    CCS winner;
+    ca_o ca;
+    char verdict[ACK_BUFFER_SIZE + 64];
+
+    signal(SIGCHLD, SIG_DFL);
+    http_fork_child();
+
+    if (!(ca = ca_newFromCSVString(hdr))) {
+	_exit(2);
+    }
+
+    count = shop_get_count();
+    shoprc = shop(ca, NULL, 1);
+    winner = ca_get_recycled(ca);
+
+    snprintf(verdict, sizeof(verdict), "%lu %d %d %s\n", id, (int)shoprc,
+	     shop_get_count() - count, winner ? winner : "-");
+    if (util_write_all(wfd, verdict, strlen(verdict)) == -1) {
+	putil_syserr(0, "write(verdict)");
+    }
+
+    fflush(NULL);
+    _exit(0);
+}
+
+// Does nothing but interrupt the shop server's wait for a new job.
+static void
+_shop_sigchld(int signum)
+{
+    UNUSED(signum);
+}
+
+// Internal service routine. The shop server: forks a worker for each
+// job read from rfd and, should one die without a verdict, writes a
+// malformed one on its behalf so the auditor isn't left waiting.
+// Exits once the monitor closes its end and all workers are done.
+static void
+_shop_server(int rfd, int wfd)
+{
+    struct {
+	pid_t sw_pid;
+	unsigned long sw_id;
+    } *workers = NULL;
+    int nworkers = 0, maxworkers = 0;
+    CS buf = NULL, req, nl, hdr;
+    size_t len = 0, size = 0;
+    unsigned long id;
+    ssize_t num;
+    int eof = 0, wstat, i;
+    pid_t pid;
+    struct pollfd pfd;
+    struct sigaction sa;
+    char verdict[64];
+
+    // An exiting worker should be noticed right away.
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _shop_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
+	putil_syserr(2, "sigaction(SIGCHLD)");
+    }
+
+    for (;;) {
+	while ((pid = waitpid(-1, &wstat, eof ? 0 : WNOHANG)) > 0) {
+	    for (i = 0; i < nworkers && workers[i].sw_pid != pid; i++);
+	    if (i == nworkers) {
+		continue;
+	    }
+	    if (!WIFEXITED(wstat) || WEXITSTATUS(wstat)) {
+		snprintf(verdict, sizeof(verdict), "%lu -\n",
+			 workers[i].sw_id);
+		(void)util_write_all(wfd, verdict, strlen(verdict));
 	    }
+	    workers[i] = workers[--nworkers];
+	}
+
+	if (eof) {
 	    break;
+	}
+
+	// Wake up now and then in case a signal came just too soon.
+	pfd.fd = rfd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 1000) <= 0) {
+	    continue;
+	}
+
+	if (size - len <= PIPE_BUF) {
+	    size = len + PIPE_BUF * 2;
+	    buf = (CS)putil_realloc(buf, size);
+	}
+	if ((num = read(rfd, buf + len, size - len)) == -1) {
+	    if (errno != EINTR) {
+		putil_syserr(0, "read(shop)");
+		eof = 1;
+	    }
+	    continue;
+	} else if (num == 0) {
+	    eof = 1;
+	    continue;
+	}
+	len += num;
+
+	for (req = buf; (nl = (CS)memchr(req, '\n', len - (req - buf)));
+		req = nl + 1) {
+	    *nl = '\0';
+	    id = strtoul(req, &hdr, 10);
+
+	    // Don't let buffered output be flushed twice.
+	    fflush(NULL);
+
+	    if ((pid = fork()) == -1) {
+		putil_syserr(2, "fork(shop)");
+	    } else if (pid == 0) {
+		close(rfd);
+		_shop_worker(id, hdr + 1, wfd);
+	    }
+
+	    if (nworkers == maxworkers) {
+		maxworkers = maxworkers ? maxworkers * 2 : 8;
+		workers = putil_realloc(workers,
+					maxworkers * sizeof(*workers));
+	    }
+	    workers[nworkers].sw_pid = pid;
+	    workers[nworkers].sw_id = id;
+	    nworkers++;
+	}
+	len -= req - buf;
+	memmove(buf, req, len);
+    }
+
+    fflush(NULL);
+    _exit(0);
+}
+
+// Internal service routine. Forks the shop server, which must not
+// hold any of the monitor's descriptors open, in particular auditor
+// connections.
+static void
+_shop_server_start(void)
+{
+    int reqpipe[2], verdictpipe[2];
+    int fd;
+
+    if (pipe(reqpipe) == -1 || pipe(verdictpipe) == -1) {
+	putil_syserr(2, "pipe(shop)");
+    }
+
+    // Don't let buffered output be flushed twice.
+    fflush(NULL);
+
+    if ((ShopServerPid = fork()) == -1) {
+	putil_syserr(2, "fork(shop)");
+    } else if (ShopServerPid == 0) {
+	for (fd = 0; fd <= WatchMax; fd++) {
+	    if (Watched[fd]) {
+		close(fd);
+	    }
+	}
+#if defined(linux)
+	close(EpollFd);
+#endif	/*linux*/
+	close(done_pipe[1]);
+	close(reqpipe[1]);
+	close(verdictpipe[0]);
+	_shop_server(reqpipe[0], verdictpipe[1]);
+    }
+
+    close(reqpipe[0]);
+    close(verdictpipe[1]);
+    ShopReqFd = reqpipe[1];
+    ShopVerdictFd = verdictpipe[0];
+    fcntl(ShopReqFd, F_SETFD, fcntl(ShopReqFd, F_GETFD) | FD_CLOEXEC);
+    fcntl(ShopVerdictFd, F_SETFD, fcntl(ShopVerdictFd, F_GETFD) | FD_CLOEXEC);
+    _watch_add(ShopVerdictFd);
+
+    vb_printf(VB_MON, "SHOP SERVER: PID %ld", (long)ShopServerPid);
+}
+
+// Internal service routine. Starts what works alongside the monitor
+// once the first PTX has begun, by which time the server has set any
+// properties it's going to. The shop server comes first because it
+// must be forked while the monitor is still single-threaded; the
+// dcode and publishing threads follow.
+static void
+_helpers_start(void)
+{
+    if (prop_has_value(P_SERVER) && prop_get_ulong(P_SHOP_WORKERS)) {
+	_shop_server_start();
+	ShopWorkers = prop_get_ulong(P_SHOP_WORKERS);
+    }
+
+    mon_start_threads();
+
+    if ((PubFd = mon_publish_fd()) != -1) {
+	_watch_add(PubFd);
+    }
+}
+
+// Internal service routine. Processes one line from an auditor.
+// A line may arrive on a socket, in which case any reply goes back
+// on it, or through a shared-memory ring.
+// Returns nonzero if the rest of the delivery should be ignored.
+static int
+_process_line(CS line, SOCKET fd, CCS logfile)
+{
+    unsigned monrc;
+    CCS winner;
+    ca_o shopca = NULL;
+
+    if (!strcmp(line, DONE_TOKEN)) {
+	// If the top-level process has ended, we have
+	// to be finished.
+	vb_printf(VB_MON, "DONE: %lu", (unsigned long)ChildPid);
+	doneflag = 1;
+	return 0;
+    }
+
+    // Shopping may be handed off to a worker only if there's
+    // somewhere to send the eventual verdict.
+    monrc = mon_record(line, &ExitStatus, NULL, &winner,
+		       (ShopWorkers && fd != INVALID_SOCKET) ? &shopca : NULL);
+
+    if (monrc & MON_NEXT) {
+	// Nothing more to do - hit me again.
+    } else if (monrc & MON_ERR) {
+	// Nothing more to do - error already handled.
+    } else if (monrc & MON_CANTRUN) {
+	// This means the top-level process was unable
+	// to run at all.
+	doneflag = 1;
+	return 1;
+    } else if (monrc & MON_SOA) {
+	if (monrc & MON_SHOP) {
+	    // The ACK will be sent when the verdict comes in.
+	    _shop_job_add(fd, shopca);
 	} else {
-	    len += num;
-	    buf[len] = '\0';
-	    if (len + 1 >= bufsize) {
-		bufsize *= 2;
-		buf = putil_realloc(buf, bufsize);
+	    _send_ack(fd, monrc, winner, line);
+	}
+
+	if (monrc & MON_TOP) {
+	    if (Started) {
+		mon_ptx_end(ExitStatus, logfile);
+	    }
+	    mon_ptx_start();
+	    if (!Started) {
+		_helpers_start();
+	    }
+	    Started = 1;
+	}
+    } else if (monrc & MON_EOA) {
+	// Nothing more to do - end processing handled elsewhere
+    } else {
+	putil_warn("unrecognized line '%s'", line);
+    }
+
+    return 0;
+}
+
+// Internal service routine. Finds the extent of the record at the
+// start of a buffer. Lines end with a newline, which is replaced
+// with a null, while binary records (see the Audit.Format property)
+// carry their own length. Returns the length including any newline,
+// or zero if the record is not all there yet or never will be
+// (see _record_too_long()).
+static size_t
+_next_record(CS buf, size_t avail)
+{
+    CS nl;
+    size_t reclen;
+
+    if (avail && buf[0] == BIN_REC_MARK) {
+	reclen = pa_binary_reclen(buf, avail);
+	return reclen <= avail && reclen <= BIN_REC_MAX_SIZE ? reclen : 0;
+    }
+
+    if (!(nl = (CS)memchr(buf, '\n', avail))) {
+	return 0;
+    }
+    *nl = '\0';
+
+    return nl - buf + 1;
+}
+
+// Internal service routine. Boolean - true if the buffer starts
+// with a binary record whose header claims more than any legal
+// record could need. Its length can't be trusted, so neither can
+// anything after it.
+static int
+_record_too_long(CCS buf, size_t avail)
+{
+    size_t reclen;
+
+    if (avail && buf[0] == BIN_REC_MARK &&
+	    (reclen = pa_binary_reclen(buf, avail)) > BIN_REC_MAX_SIZE) {
+	putil_warn("bad record length: %lu bytes", (unsigned long)reclen);
+	return 1;
+    }
+
+    return 0;
+}
+
+// Callback for deliveries arriving through the shared-memory ring.
+static void
+_process_ring_delivery(CS buffer, size_t len, void *data)
+{
+    CS rec;
+    size_t reclen;
+
+    for (rec = buffer; (reclen = _next_record(rec, len)); rec += reclen) {
+	len -= reclen;
+
+	if (rec[0] == BIN_REC_MARK) {
+	    (void)mon_record_binary(rec, reclen);
+	} else if (!*rec) {
+	    continue;
+	} else if (_process_line(rec, INVALID_SOCKET, (CCS)data)) {
+	    break;
+	}
+    }
+
+    (void)_record_too_long(rec, len);
+
+    putil_free(buffer);
+}
+
+// Per-connection state for audit deliveries arriving on sockets.
+// A connection may carry a single delivery or, with the
+// Monitor.Persistent property, stay open from SOA to EOA, so
+// lines are processed as they arrive rather than at EOF.
+// A connection which has carried an SOA is tagged with that
+// command's cmdid and depth. These provide explicit sequencing
+// for exec chains: data sent by a program before it execs must
+// be seen before the EOA of its successor, which may well show
+// up first on a different connection. So an EOA is held back
+// (the connection is "parked") while any other connection tagged
+// with the same cmdid and a lesser depth remains open.
+// Tagged and parked connections are each chained by cmdid so that
+// neither finding a predecessor nor waking the connections parked
+// behind one means looking at every connection.
+typedef struct {
+    int cl_next;		// next descriptor in the chain, or -1
+    int cl_prev;		// previous descriptor in the chain, or -1
+} conn_link_s;
+
+enum { CONN_TAGGED, CONN_PARKED, CONN_CHAINS };
+
+typedef struct {
+    CS cn_buf;			// bytes read but not yet processed
+    size_t cn_len;		// number of bytes in cn_buf
+    size_t cn_size;		// allocated size of cn_buf
+    unsigned long cn_cmdid;	// cmdid of the SOA seen here
+    unsigned long cn_depth;	// depth of the SOA seen here
+    unsigned long cn_parkid;	// cmdid of the EOA held back here
+    int cn_tagged;		// nonzero once an SOA has been seen
+    int cn_parked;		// nonzero while holding back an EOA
+    conn_link_s cn_links[CONN_CHAINS];	// see ConnChains
+} conn_s;
+
+#define CONN_READ_SIZE		65536
+#define CONN_BUCKETS		1024
+
+// Indexed by descriptor and grown as connections are accepted.
+static conn_s *Conns;
+static int ConnsSize;
+
+// The first descriptor in each chain of tagged or parked connections,
+// hashed by cmdid, or -1.
+static int ConnChains[CONN_CHAINS][CONN_BUCKETS];
+
+// Internal service routine. Makes room for a connection on the
+// given descriptor.
+static void
+_conn_open(int fd)
+{
+    if (!Conns) {
+	memset(ConnChains, -1, sizeof(ConnChains));
+    }
+
+    if (fd >= ConnsSize) {
+	int size;
+
+	size = fd + 256;
+	Conns = (conn_s *)putil_realloc(Conns, size * sizeof(*Conns));
+	memset(Conns + ConnsSize, 0, (size - ConnsSize) * sizeof(*Conns));
+	ConnsSize = size;
+    }
+}
+
+// Internal service routine. Adds a connection to the given chain
+// under the given cmdid.
+static void
+_conn_link(int chain, int fd, unsigned long cmdid)
+{
+    conn_link_s *cl;
+    int *headp;
+
+    headp = &ConnChains[chain][cmdid % CONN_BUCKETS];
+    cl = &Conns[fd].cn_links[chain];
+    cl->cl_prev = -1;
+    cl->cl_next = *headp;
+    if (*headp != -1) {
+	Conns[*headp].cn_links[chain].cl_prev = fd;
+    }
+    *headp = fd;
+}
+
+// Internal service routine. Takes a connection out of the given chain,
+// in which it was linked under the given cmdid.
+static void
+_conn_unlink(int chain, int fd, unsigned long cmdid)
+{
+    conn_link_s *cl;
+
+    cl = &Conns[fd].cn_links[chain];
+    if (cl->cl_prev != -1) {
+	Conns[cl->cl_prev].cn_links[chain].cl_next = cl->cl_next;
+    } else {
+	ConnChains[chain][cmdid % CONN_BUCKETS] = cl->cl_next;
+    }
+    if (cl->cl_next != -1) {
+	Conns[cl->cl_next].cn_links[chain].cl_prev = cl->cl_prev;
+    }
+}
+
+// Internal service routine. Every SOA and EOA header begins with
+// the cmdid and depth of its command; this extracts them.
+// Returns nonzero if the line is not such a header.
+static int
+_conn_key(CCS line, unsigned long *cmdidp, unsigned long *depthp)
+{
+    CCS p;
+    CS e;
+
+    if (line[0] != '<') {
+	return 1;
+    }
+
+    // SOA and EOA markers have the same length.
+    p = line + strlen(SOA);
+
+    // Skip the exit status in an EOA.
+    if (*p == '[') {
+	if (!(p = strchr(p, ']'))) {
+	    return 1;
+	}
+	p++;
+    }
+
+    *cmdidp = strtoul(p, &e, 10);
+    if (e == p || strncmp(e, FS1, strlen(FS1))) {
+	return 1;
+    }
+    *depthp = strtoul(e + strlen(FS1), NULL, 10);
+
+    return 0;
+}
+
+// Internal service routine. Returns true if an EOA for the given
+// command arriving on the given connection must wait for data
+// still to come from an exec predecessor.
+static int
+_conn_must_wait(int fd, unsigned long cmdid, unsigned long depth)
+{
+    int i;
+
+    for (i = ConnChains[CONN_TAGGED][cmdid % CONN_BUCKETS]; i != -1;
+	    i = Conns[i].cn_links[CONN_TAGGED].cl_next) {
+	if (i != fd && Conns[i].cn_cmdid == cmdid &&
+		Conns[i].cn_depth < depth) {
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+// Internal service routine. Reads whatever is waiting on a
+// connection into its buffer. Returns zero on EOF, or -1 if there
+// turned out to be nothing to read. Only one read is done so that
+// a connection with a lot to say can't hold up the others.
+static ssize_t
+_conn_read(int fd)
+{
+    conn_s *cn;
+    ssize_t num;
+
+    cn = &Conns[fd];
+    if (cn->cn_size - cn->cn_len < CONN_READ_SIZE) {
+	cn->cn_size = cn->cn_len + CONN_READ_SIZE;
+	cn->cn_buf = (CS)putil_realloc(cn->cn_buf, cn->cn_size);
+    }
+
+    for (;;) {
+	num = read(fd, cn->cn_buf + cn->cn_len, cn->cn_size - cn->cn_len);
+	if (num >= 0) {
+	    break;
+	} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	    return -1;
+	} else if (errno != EINTR) {
+	    putil_syserr(0, "read");
+	    return 0;
+	}
+    }
+
+    cn->cn_len += num;
+    return num;
+}
+
+// Internal service routine. Processes all complete records buffered
+// for a connection. Returns nonzero if it had to park on an EOA.
+static int
+_conn_process(int fd, CCS logfile)
+{
+    conn_s *cn;
+    CS line;
+    size_t used, reclen;
+    unsigned long cmdid, depth;
+
+    cn = &Conns[fd];
+    if (cn->cn_parked) {
+	_conn_unlink(CONN_PARKED, fd, cn->cn_parkid);
+	cn->cn_parked = 0;
+    }
+
+    for (line = cn->cn_buf;
+	 (reclen = _next_record(line, cn->cn_len - (line - cn->cn_buf)));
+	 line += reclen) {
+	if (line[0] == BIN_REC_MARK) {
+	    (void)mon_record_binary(line, reclen);
+	    continue;
+	}
+
+	if (!*line) {
+	    continue;
+	}
+
+	if (!_conn_key(line, &cmdid, &depth)) {
+	    if (line[1] == 'E') {
+		if (_conn_must_wait(fd, cmdid, depth)) {
+		    vb_printf(VB_MON, "PARKING: SOCKET %d", fd);
+		    line[reclen - 1] = '\n';
+		    cn->cn_parkid = cmdid;
+		    cn->cn_parked = 1;
+		    _conn_link(CONN_PARKED, fd, cmdid);
+		    break;
+		}
+	    } else {
+		if (cn->cn_tagged) {
+		    _conn_unlink(CONN_TAGGED, fd, cn->cn_cmdid);
+		}
+		cn->cn_cmdid = cmdid;
+		cn->cn_depth = depth;
+		cn->cn_tagged = 1;
+		_conn_link(CONN_TAGGED, fd, cmdid);
+	    }
+	}
+
+	if (_process_line(line, fd, logfile)) {
+	    line = cn->cn_buf + cn->cn_len;
+	    break;
+	}
+    }
+
+    used = line - cn->cn_buf;
+    memmove(cn->cn_buf, line, cn->cn_len - used);
+    cn->cn_len -= used;
+
+    return cn->cn_parked;
+}
+
+// Internal service routine. Closes a connection and gives any
+// connections parked behind it a chance to proceed.
+static void
+_conn_close(int fd, CCS logfile)
+{
+    conn_s *cn;
+    int *waiters, count = 0, i;
+    unsigned long cmdid;
+
+    cn = &Conns[fd];
+    if (cn->cn_len && cn->cn_buf[0] == BIN_REC_MARK) {
+	putil_warn("Incomplete record: %lu bytes", (unsigned long)cn->cn_len);
+    } else if (cn->cn_len) {
+	putil_warn("Incomplete line: '%.*s'", (int)cn->cn_len, cn->cn_buf);
+    }
+    cn->cn_len = 0;
+    if (cn->cn_parked) {
+	_conn_unlink(CONN_PARKED, fd, cn->cn_parkid);
+	cn->cn_parked = 0;
+    }
+
+    _watch_del(fd);
+    close(fd);
+
+    if (!cn->cn_tagged) {
+	return;
+    }
+    cn->cn_tagged = 0;
+    cmdid = cn->cn_cmdid;
+    _conn_unlink(CONN_TAGGED, fd, cmdid);
+
+    // Only an EOA of the same command can have been waiting on this.
+    // The waiters are gathered first since they may park again.
+    for (i = ConnChains[CONN_PARKED][cmdid % CONN_BUCKETS]; i != -1;
+	    i = Conns[i].cn_links[CONN_PARKED].cl_next) {
+	count++;
+    }
+    if (!count) {
+	return;
+    }
+    waiters = (int *)putil_malloc(count * sizeof(*waiters));
+    for (count = 0, i = ConnChains[CONN_PARKED][cmdid % CONN_BUCKETS];
+	    i != -1; i = Conns[i].cn_links[CONN_PARKED].cl_next) {
+	if (Conns[i].cn_parkid == cmdid) {
+	    waiters[count++] = i;
+	}
+    }
+
+    for (i = 0; i < count; i++) {
+	if (Conns[waiters[i]].cn_parked &&
+		!_conn_process(waiters[i], logfile)) {
+	    vb_printf(VB_MON, "UNPARKING: SOCKET %d", waiters[i]);
+	    _watch_add(waiters[i]);
+	}
+    }
+    putil_free(waiters);
+}
+
+// Internal service routine. Sends queued shopping jobs to the
+// shop server as far as the limit allows.
+static void
+_shop_jobs_start(void)
+{
+    shop_job_s *sjp;
+    CCS hdr;
+    CS req;
+
+    for (sjp = ShopJobs; sjp && ShopBusy < ShopWorkers; sjp = sjp->sj_next) {
+	if (sjp->sj_started) {
+	    continue;
+	}
+
+	hdr = ca_format_header(sjp->sj_ca);
+	if (asprintf(&req, "%lu %s", sjp->sj_id, hdr) < 0) {
+	    putil_syserr(2, NULL);
+	}
+	putil_free(hdr);
+	if (util_write_all(ShopReqFd, req, strlen(req)) == -1) {
+	    putil_syserr(2, "write(shop)");
+	}
+	putil_free(req);
+
+	vb_printf(VB_MON, "SHOPPING: SOCKET %d JOB %lu",
+		  (int)sjp->sj_fd, sjp->sj_id);
+
+	sjp->sj_started = 1;
+	ShopBusy++;
+    }
+}
+
+// Internal service routine. Sends the delayed ACK for a shopping
+// job given its verdict, which may be malformed if the worker failed.
+static void
+_shop_job_finish(shop_job_s *sjp, CCS verdict, CCS logfile)
+{
+    char winbuf[ACK_BUFFER_SIZE];
+    int rc, count;
+    unsigned monrc;
+    CCS winner;
+
+    ShopBusy--;
+
+    if (sscanf(verdict, "%d %d %s", &rc, &count, winbuf) != 3) {
+	putil_warn("shopping worker failed for '%s'",
+		   ca_get_line(sjp->sj_ca));
+	rc = SHOP_ERR;
+	count = 0;
+    }
+
+    shop_add_count(count);
+    if (rc == SHOP_RECYCLED) {
+	ca_set_recycled(sjp->sj_ca, winbuf);
+    }
+
+    winner = NULL;
+    monrc = MON_SOA | mon_shop_verdict(sjp->sj_ca, (shop_e)rc, &winner);
+    _send_ack(sjp->sj_fd, monrc, winner, ca_get_line(sjp->sj_ca));
+
+    // If the auditor finished its side of the conversation while
+    // waiting, the connection can finally be closed.
+    if (sjp->sj_eof) {
+	_conn_close(sjp->sj_fd, logfile);
+    }
+
+    putil_free(sjp);
+}
+
+// Internal service routine. Reads whatever verdicts the shop server
+// has sent and finishes their jobs. Should the server itself go away
+// the jobs it had are failed, and any later shopping is done by the
+// monitor itself.
+static void
+_shop_verdicts_read(CCS logfile)
+{
+    static char buf[PIPE_BUF * 2];
+    static size_t len;
+    shop_job_s *sjp, **prev;
+    CS line, nl, e;
+    ssize_t num;
+    unsigned long id;
+
+    while ((num = read(ShopVerdictFd, buf + len, sizeof(buf) - 1 - len)) == -1 &&
+	   errno == EINTR);
+
+    if (num <= 0) {
+	if (num == -1) {
+	    putil_syserr(0, "read(verdict)");
+	}
+	putil_warn("shop server %ld went away", (long)ShopServerPid);
+	_watch_del(ShopVerdictFd);
+	close(ShopVerdictFd);
+	ShopVerdictFd = -1;
+	ShopWorkers = 0;
+	while ((sjp = ShopJobs)) {
+	    ShopJobs = sjp->sj_next;
+	    if (!sjp->sj_started) {
+		ShopBusy++;
 	    }
+	    _shop_job_finish(sjp, "", logfile);
+	}
+	return;
+    }
+
+    len += num;
+    for (line = buf; (nl = (CS)memchr(line, '\n', len - (line - buf)));
+	    line = nl + 1) {
+	*nl = '\0';
+	id = strtoul(line, &e, 10);
+	for (prev = &ShopJobs; (sjp = *prev); prev = &sjp->sj_next) {
+	    if (sjp->sj_started && sjp->sj_id == id) {
+		break;
+	    }
+	}
+	if (!sjp) {
+	    putil_int("verdict for unknown shopping job: '%s'", line);
+	    continue;
 	}
+	*prev = sjp->sj_next;
+	_shop_job_finish(sjp, e, logfile);
+    }
+    len -= line - buf;
+    memmove(buf, line, len);
+}
+
+// Internal service routine. Sees all remaining shopping jobs
+// through to completion, since each has an auditor waiting on it.
+// Then lets the shop server go.
+static void
+_shop_jobs_drain(CCS logfile)
+{
+    int wstat;
+
+    while (ShopJobs) {
+	_shop_jobs_start();
+	_shop_verdicts_read(logfile);
     }
 
-    return buf;
+    if (ShopServerPid) {
+	close(ShopReqFd);
+	ShopReqFd = -1;
+	while (waitpid(ShopServerPid, &wstat, 0) == -1 && errno == EINTR);
+	ShopServerPid = 0;
+    }
 }
 
 // Making this static instead of automatic makes Coverity happy.
@@ -171,19 +1215,17 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
     CS path;
     pid_t childpid;
     int reuseaddr = 1;
-    struct timeval master_timeout, timeout;
-    int64_t session_timeout, last_heartbeat, heartbeat_interval;
-    int sockmin = 3, sockmax = 0;
+    long master_timeout;
+    int64_t session_timeout, last_heartbeat, heartbeat_interval, last_reap;
     int *listeners;
     unsigned long ports;
-    fd_set listen_fds;
-    fd_set master_read_fds;
     int sret;
     char *pdir;
     char *shlibdir = NULL;
     int sync_pipe[2];
     int wstat = 0;
     unsigned int i;
+    unsigned long slots;
 
     path = argv[0];
 
@@ -269,12 +1311,11 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
     // expicitly in the server's web.xml file. This allows us to
     // assume that default via HTTP_SESSION_TIMEOUT_SECS_DEFAULT.
 
-    master_timeout.tv_sec = prop_get_ulong(P_MONITOR_TIMEOUT_SECS);
-    master_timeout.tv_usec = 0;
+    master_timeout = prop_get_ulong(P_MONITOR_TIMEOUT_SECS);
     session_timeout = prop_get_ulong(P_SESSION_TIMEOUT_SECS);
     if (session_timeout) {
-	if ((session_timeout / 4 < master_timeout.tv_sec)) {
-	    master_timeout.tv_sec = session_timeout / 4;
+	if ((session_timeout / 4 < master_timeout)) {
+	    master_timeout = session_timeout / 4;
 	}
 	heartbeat_interval = session_timeout / 2;
     } else {
@@ -348,6 +1389,38 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 	putil_free(portstr);
     }
 
+    // Optionally let auditors deliver audit data through shared memory
+    // instead of a socket. The name is exported to the auditors, and
+    // if anything goes wrong here they'll simply use the sockets.
+    if ((slots = prop_get_ulong(P_RING_SLOTS))) {
+	CCS rname;
+
+	if ((rname = ring_create(slots))) {
+	    if (pipe(ring_pipe) == -1) {
+		putil_syserr(2, "pipe(ring_pipe)");
+	    }
+	    for (i = 0; i < 2; i++) {
+		fcntl(ring_pipe[i], F_SETFD,
+		      fcntl(ring_pipe[i], F_GETFD) | FD_CLOEXEC);
+		fcntl(ring_pipe[i], F_SETFL,
+		      fcntl(ring_pipe[i], F_GETFL) | O_NONBLOCK);
+	    }
+	    prop_override_str(P_RING_NAME, rname);
+	}
+    }
+
+    // Over a persistent connection, auditors can carry on without
+    // waiting to be told so when their command line is certainly
+    // not in the roadmap. Strict mode must hear about every miss.
+    if (prop_is_true(P_MONITOR_PERSISTENT) &&
+	    !prop_is_true(P_STRICT_DOWNLOAD)) {
+	CCS fname;
+
+	if ((fname = shop_filter_create())) {
+	    prop_override_str(P_ROADMAP_FILTER, fname);
+	}
+    }
+
     if ((childpid = fork()) < 0) {
 	putil_syserr(2, "fork");
     } else if (childpid == 0) {
@@ -414,9 +1487,11 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
      * PARENT
      *********************************************************************/
 
+    ChildPid = childpid;
+
     _sig_setup();
 
-    last_heartbeat = time(NULL);
+    last_heartbeat = last_reap = time(NULL);
 
     // Bump the number of allowed file descriptors to the maximum,
     // because the monitor is likely to use a fair number. There
@@ -434,12 +1509,18 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 	putil_syserr(2, "pipe(done_pipe)");
     }
 
-    FD_ZERO(&master_read_fds);
-    FD_ZERO(&listen_fds);
+    _watch_init();
+
+    // Add the read end of the self-pipe to the watch set. It's
+    // read like any auditor connection.
+    _conn_open(done_pipe[0]);
+    _watch_add(done_pipe[0]);
+
+    // And the ring wakeup pipe, if in use.
+    if (ring_pipe[0] != -1) {
+	_watch_add(ring_pipe[0]);
+    }
 
-    // Add the read end of the self-pipe to the master set.
-    FD_SET(done_pipe[0], &master_read_fds);
-    sockmax = done_pipe[0];
 
     for (i = 0; i < ports; i++) {
 	// Set up these sockets as listeners.
@@ -447,37 +1528,23 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 	    putil_syserr(2, "listen");
 	}
 
-	// Add the listening sockets to the master set.
-	FD_SET(listeners[i], &master_read_fds);
-
-	// And to the listener set
-	FD_SET(listeners[i], &listen_fds);
-
-	// Keep track of the highest-numbered live socket.
-	sockmax = (listeners[i] > sockmax) ? listeners[i] : sockmax;
+	// Add the listening sockets to the watch set.
+	_watch_add(listeners[i]);
     }
 
     // Alert the child that we're ready to roll.
     close(sync_pipe[0]);
     close(sync_pipe[1]);
 
-    // The select loop.
-    // Some network gurus argue that select should never be used
-    // with blocking descriptors, but that's what we do here. Never looked
-    // into why they say so but this should be run past an expert.
+    // The event loop.
+    // Accepted sockets are non-blocking and each buffers its own
+    // partial lines (see conn_s), so a slow auditor can hold up
+    // nothing but itself.
     while (!doneflag) {
-	int fd;
-	fd_set read_fds;
-
-	// We have to reset the timeout because some implementations
-	// of select modify it. This could cause it to busy-wait
-	// as the timeout becomes zero.
-	timeout = master_timeout;
-
-	// Initialize the read fdset to its top-of-loop state.
-	read_fds = master_read_fds;
+	int ready[WATCH_EVENTS];
+	int fd, j;
 
-	sret = select(sockmax + 1, &read_fds, NULL, NULL, &timeout);
+	sret = _watch_wait(ready, WATCH_EVENTS, master_timeout);
 
 	if (sret == SOCKET_ERROR) {
 #if defined(EINTR)
@@ -485,51 +1552,59 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 		continue;
 	    }
 #endif	/*!EINTR*/
-	    putil_syserr(2, "select");
+	    putil_syserr(2, WATCH_WAIT);
 	} else {
+	    int64_t now;
+
+	    now = time(NULL);
+
 	    // We like to ping the server once in a while, partly
 	    // to make sure it's still there but primarily to keep
 	    // its session alive.
 	    if (prop_has_value(P_SERVER)) {
-		int64_t now;
-
-		now = time(NULL);
 		if ((now - last_heartbeat) >= heartbeat_interval) {
 		    http_heartbeat(now - last_heartbeat);
 		    last_heartbeat = now;
 		}
 	    }
 
-	    // Continue on select timeout.
+	    // Recover rings abandoned by dead auditors. This can't
+	    // wait for a quiet spell since a busy build may never
+	    // have one, and it's busy builds which run out of slots.
+	    if ((now - last_reap) >= RING_REAP_SECS) {
+		ring_reap();
+		last_reap = now;
+	    }
+
+	    // Continue on timeout.
 	    if (sret == 0) {
+		(void)ring_drain(_process_ring_delivery, (void *)logfile);
 		continue;
 	    }
 	}
 
-	for (i = 0; i < ports; i++) {
-	    int found = 0;
-
-	    if (FD_ISSET(listeners[i], &read_fds)) {
+	// Accept new connections first.
+	for (j = 0; j < sret; j++) {
+	    for (i = 0; i < ports; i++) {
 		SOCKET newfd;
 
+		if (ready[j] != listeners[i]) {
+		    continue;
+		}
+		ready[j] = -1;
+
 		// Accept a new connection.
 		if ((newfd = accept(listeners[i], NULL, NULL)) == INVALID_SOCKET) {
 		    putil_syserr(2, "accept");
 		}
-
-		// Add it to the master set
-		FD_SET(newfd, &master_read_fds);
-
-		// Keep track of the highest numbered socket
-		if (newfd > sockmax) {
-		    sockmax = newfd;
+		if (fcntl(newfd, F_SETFL, fcntl(newfd, F_GETFL) | O_NONBLOCK) == -1) {
+		    putil_syserr(2, "fcntl(O_NONBLOCK)");
 		}
 
-		found++;
+		_conn_open(newfd);
+		_watch_add(newfd);
+		break;
 	    }
-
-	    if (found)
-		continue;
 	}
 
 	// This can be turned on with a signal.
@@ -539,89 +1614,81 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 	}
 
 	// Run through existing connections looking for data
-	for (fd = sockmin; fd <= sockmax; fd++) {
-	    CS buffer, buftmp, line;
+	for (j = 0; j < sret; j++) {
+	    ssize_t num;
 
-	    if (FD_ISSET(fd, &listen_fds) || !FD_ISSET(fd, &read_fds)) {
+	    if (!_watch_has(fd = ready[j])) {
 		continue;
 	    }
 
-	    buffer = _read_available(fd);
+	    // Shopping verdicts have come in.
+	    if (fd == ShopVerdictFd) {
+		_shop_verdicts_read(logfile);
+		continue;
+	    }
 
-	    for (buftmp = buffer, line = util_strsep(&buftmp, "\n");
-		     line && *line; line = util_strsep(&buftmp, "\n")) {
+	    // Published CAs are ready to be uploaded and freed.
+	    if (fd == PubFd) {
+		mon_publish_reap();
+		continue;
+	    }
 
-		if (!strcmp(line, DONE_TOKEN)) {
-		    // If the top-level process has ended, we have
-		    // to be finished.
-		    vb_printf(VB_MON, "DONE: %lu", childpid);
-		    doneflag = 1;
-		} else {
-		    unsigned monrc;
-		    CCS winner;
-
-		    monrc = mon_record(line, &ExitStatus, NULL, &winner);
-
-		    if (monrc & MON_NEXT) {
-			// Nothing more to do - hit me again.
-		    } else if (monrc & MON_ERR) {
-			// Nothing more to do - error already handled.
-		    } else if (monrc & MON_CANTRUN) {
-			// This means the top-level process was unable
-			// to run at all.
-			doneflag = 1;
-			break;
-		    } else if (monrc & MON_SOA) {
-			char ack[ACK_BUFFER_SIZE];
-
-			if (monrc & MON_RECYCLED) {
-			    // Tell auditor we recycled so it can exit.
-			    snprintf(ack, sizeof(ack), "%s\n", winner);
-			} else if (monrc & MON_STRICT) {
-			    // Tell auditor we failed a requirement.
-			    snprintf(ack, sizeof(ack), "%s\n", ACK_FAILURE);
-			    ExitStatus = 3;
-			} else if (monrc & MON_AGG) {
-			    // Tell auditor this command is aggregated.
-			    snprintf(ack, sizeof(ack), "%s\n", ACK_OK_AGG);
-			} else {
-			    // No special message - carry on.
-			    snprintf(ack, sizeof(ack), "%s\n", ACK_OK);
-			}
-
-			if (util_send_all(fd, ack, strlen(ack), 0) == -1) {
-			    putil_syserr(0, "send(ack)");
-			}
-
-			if (monrc & MON_TOP) {
-			    if (Started) {
-				mon_ptx_end(ExitStatus, logfile);
-			    }
-			    mon_ptx_start();
-			    Started = 1;
-			}
-		    } else if (monrc & MON_EOA) {
-			// Nothing more to do - end processing handled elsewhere
-		    } else {
-			putil_warn("unrecognized line '%s'", line);
-		    }
+	    // This is only a wakeup call; the rings are drained below.
+	    if (fd == ring_pipe[0]) {
+		char junk[256];
+
+		(void)read(fd, junk, sizeof(junk));
+		continue;
+	    }
+
+	    if ((num = _conn_read(fd)) > 0) {
+		// Handle whatever complete lines have arrived. If
+		// this connection must wait for another, stop
+		// listening to it until that one is closed. If what's
+		// left can never be a legal record, drop the connection
+		// rather than buffer whatever it claims to need.
+		if (_conn_process(fd, logfile)) {
+		    _watch_del(fd);
+		} else if (_record_too_long(Conns[fd].cn_buf,
+					    Conns[fd].cn_len)) {
+		    Conns[fd].cn_len = 0;
+		    num = 0;
 		}
 	    }
 
-	    // We've reached EOF on a particular delivery;
-	    // close the socket, remove it from the select mask, and
-	    // return to the loop.
-	    close(fd);
-	    FD_CLR(fd, &master_read_fds);
+	    if (num == 0) {
+		shop_job_s *sjp;
 
-	    putil_free(buffer);
+		// We've reached EOF on a particular connection;
+		// close the socket, remove it from the watch set, and
+		// return to the loop. Unless, that is, it's still owed
+		// an ACK, in which case it's closed when that's sent.
+		if ((sjp = _shop_job_find(fd))) {
+		    sjp->sj_eof = 1;
+		    _watch_del(fd);
+		} else {
+		    _conn_close(fd, logfile);
+		}
+	    }
 	}
 
+	// Hand any new shopping jobs to workers.
+	_shop_jobs_start();
+
+	// Pick up anything delivered through shared memory.
+	(void)ring_drain(_process_ring_delivery, (void *)logfile);
+
 	http_async_transfer(0);
     }
 
-    // Wait for ending child, reap its exit code.
-    if (waitpid(childpid, &wstat, 0) == -1) {
+    // Auditors may still be waiting on shopping verdicts.
+    _shop_jobs_drain(logfile);
+
+    // Wait for ending child, reap its exit code. It may already
+    // have been reaped by the signal handler.
+    if (ChildReaped) {
+	wstat = ChildWstat;
+    } else if (waitpid(childpid, &wstat, 0) == -1) {
 	putil_syserr(0, path);
 	ExitStatus = 5;
     }
@@ -647,6 +1714,10 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 
     mon_fini();
 
+    ring_destroy();
+
+    bloom_destroy();
+
     for (i = 0; i < ports; i++) {
 	if (close(listeners[i]) == SOCKET_ERROR) {
 	    putil_syserr(0, "close(socket)");
@@ -1165,6 +1165,129 @@ util_format_to_radix(unsigned radix, CS buf, size_t len, uint64_t val)
     return buf;
 }
 
+/// Stores an unsigned integer in a binary record. Integers are
+/// written 7 bits at a time, low-order bits first, with the high bit
+/// of each byte set if more follow. Thus small values, which are the
+/// common case, take only a byte or two regardless of type.
+/// @param[in] p        where to store it
+/// @param[in] val      the value
+/// @return a pointer just past the stored value
+CS
+util_bin_put_uint(CS p, uint64_t val)
+{
+    while (val >= 0x80) {
+	*p++ = (char)(val | 0x80);
+	val >>= 7;
+    }
+    *p++ = (char)val;
+
+    return p;
+}
+
+/// Retrieves an unsigned integer from a binary record.
+/// @param[in] p        where the value is stored
+/// @param[in] end      the end of the record
+/// @param[out] valp    set to the value
+/// @return a pointer just past the value, or NULL if it's malformed
+CCS
+util_bin_get_uint(CCS p, CCS end, uint64_t *valp)
+{
+    uint64_t val = 0;
+    unsigned shift;
+
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+	val |= (uint64_t)(*p & 0x7f) << shift;
+	if (!(*p++ & 0x80)) {
+	    *valp = val;
+	    return p;
+	}
+    }
+
+    return NULL;
+}
+
+/// Stores a signed integer in a binary record. The sign is moved to
+/// the low-order bit so that small negative values stay small.
+/// @param[in] p        where to store it
+/// @param[in] val      the value
+/// @return a pointer just past the stored value
+CS
+util_bin_put_int(CS p, int64_t val)
+{
+    return util_bin_put_uint(p, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+/// Retrieves a signed integer from a binary record.
+/// @param[in] p        where the value is stored
+/// @param[in] end      the end of the record
+/// @param[out] valp    set to the value
+/// @return a pointer just past the value, or NULL if it's malformed
+CCS
+util_bin_get_int(CCS p, CCS end, int64_t *valp)
+{
+    uint64_t val;
+
+    if ((p = util_bin_get_uint(p, end, &val))) {
+	*valp = (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+
+    return p;
+}
+
+/// Returns the most space a string can occupy in a binary record:
+/// its length, the bytes themselves, and a terminating null which
+/// lets the reader use the string in place.
+/// @param[in] str      the string, or NULL which is stored as ""
+/// @return the number of bytes required at most
+size_t
+util_bin_str_size(CCS str)
+{
+    return BIN_INT_MAX_SIZE + (str ? strlen(str) : 0) + 1;
+}
+
+/// Stores a string in a binary record.
+/// @param[in] p        where to store it
+/// @param[in] str      the string, or NULL which is stored as ""
+/// @return a pointer just past the stored string
+CS
+util_bin_put_str(CS p, CCS str)
+{
+    size_t len;
+
+    if (!str) {
+	str = "";
+    }
+
+    len = strlen(str);
+    p = util_bin_put_uint(p, len);
+    memcpy(p, str, len + 1);
+
+    return p + len + 1;
+}
+
+/// Retrieves a string from a binary record without copying it.
+/// @param[in] p        where the string is stored
+/// @param[in] end      the end of the record
+/// @param[out] strp    set to point to the string within the record
+/// @return a pointer just past the string, or NULL if it's malformed
+CCS
+util_bin_get_str(CCS p, CCS end, CCS *strp)
+{
+    uint64_t len;
+
+    if (!(p = util_bin_get_uint(p, end, &len))) {
+	return NULL;
+    }
+
+    // Written so that a huge length can't wrap around.
+    if (len >= (uint64_t)(end - p) || p[len] != '\0') {
+	return NULL;
+    }
+    *strp = p;
+
+    return p + len + 1;
+}
+
 /*-
  * Copyright (c) 1990, 1993
  *	The Regents of the University of California.  All rights reserved.
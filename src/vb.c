@@ -170,7 +170,12 @@ vb_init(void)
 FILE *
 vb_get_stream(void)
 {
-    return VerbosityStream ? VerbosityStream : stderr;
+    // Verbosity meant for stderr goes wherever messages are going,
+    // which may depend on the thread (see putil_set_msg_stream).
+    if (!VerbosityStream || VerbosityStream == stderr) {
+	return putil_get_msg_stream();
+    }
+    return VerbosityStream;
 }
 
 /// Add the named verbosity flags in string form. Verbosity flags are
@@ -295,6 +295,9 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 	putil_free(portstr);
     }
 
+    // This monitor reads only lines, so binary records are not an option.
+    prop_override_str(P_AUDIT_FORMAT, "csv");
+
     last_heartbeat = time(NULL);
 
     // Do an explicit runtime load of the auditing DLL, not because
@@ -355,6 +358,7 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 
     // Perform any one-time initializations related to upload.
     mon_init();
+    mon_start_threads();
 
     FD_ZERO(&master_read_fds);
     FD_ZERO(&listen_fds);
@@ -476,7 +480,7 @@ run_cmd(CCS exe, CS *argv, CCS logfile)
 		    CCS winner;
 		    DWORD cmdpid = -1;
 
-		    monrc = mon_record(line, &ExitStatus, &cmdpid, &winner);
+		    monrc = mon_record(line, &ExitStatus, &cmdpid, &winner, NULL);
 
 		    if (monrc & MON_NEXT) {
 			// Nothing more to do - hit me again.
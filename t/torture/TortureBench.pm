@@ -0,0 +1,50 @@
+# What the *-bench.pl scripts have in common: parsing their options,
+# the ways of running a program with and without the auditor, and
+# timing a number of iterations of something.
+
+package TortureBench;
+
+use strict;
+use Benchmark qw(:hireswallclock timediff timestr);
+use Exporter qw(import);
+use Getopt::Long;
+
+our @EXPORT = qw(bench_options bench_modes bench_time timestr);
+
+# Parses the command line into a hash seeded with the given defaults,
+# each of which names an option taking an integer. Any further option
+# specs are passed to GetOptions as is; the optional usage string
+# describes whatever follows the options.
+sub bench_options {
+    my($defaults, $usage, @specs) = @_;
+    my %opt = %$defaults;
+    my @names = sort keys %$defaults;
+    GetOptions(\%opt, (map { "$_=i" } @names), @specs)
+	|| die "Usage: $0 ", join(' ', map { "[-$_ N]" } @names),
+	    ($usage ? " $usage" : ''), "\n";
+    return %opt;
+}
+
+# Returns a hash of the command prefixes which run a program
+# unaudited and audited, the latter writing its audit to the given
+# file. Dies unless "ao" is on PATH.
+sub bench_modes {
+    my $ofile = shift;
+    grep { -x "$_/ao" } split(/:/, $ENV{PATH})
+	or die "$0: ao must be on PATH\n";
+    return (
+	'unaudited' => [],
+	'audited'   => [qw(ao -q -o), $ofile, 'run'],
+    );
+}
+
+# Calls the given code the given number of times and returns the
+# time taken as a Benchmark object.
+sub bench_time {
+    my($iterations, $code) = @_;
+    my $t0 = new Benchmark;
+    $code->($_) for 1 .. $iterations;
+    return timediff(new Benchmark, $t0);
+}
+
+1;
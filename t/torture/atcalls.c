@@ -0,0 +1,69 @@
+// gcc -o atcalls atcalls.c
+
+// Makes file accesses through the newer Linux calls, relative to a
+// directory descriptor where they allow it, so that atops.pl can
+// check each is audited. In the given directory it creates
+// ATOPS.openat2.X via openat2(), renames it to ATOPS.renameat.X via
+// renameat(), then to ATOPS.renameat2.X via renameat2(), and finally
+// renames that to ATOPS.syscall.X via a raw syscall(SYS_renameat2)
+// as programs built against older C libraries must.
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+
+int
+main(int argc, char *argv[])
+{
+    struct open_how how;
+    int dfd, fd;
+
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s dir\n", argv[0]);
+	return 2;
+    }
+
+    if ((dfd = open(argv[1], O_RDONLY | O_DIRECTORY)) == -1) {
+	perror(argv[1]);
+	return 2;
+    }
+
+    memset(&how, 0, sizeof(how));
+    how.flags = O_WRONLY | O_CREAT | O_TRUNC;
+    how.mode = 0644;
+    fd = (int)syscall(SYS_openat2, dfd, "ATOPS.openat2.X", &how, sizeof(how));
+    if (fd == -1) {
+	perror("openat2");
+	return 2;
+    }
+    if (write(fd, "ATOPS\n", 6) != 6) {
+	perror("write");
+	return 2;
+    }
+    close(fd);
+
+    if (renameat(dfd, "ATOPS.openat2.X", dfd, "ATOPS.renameat.X")) {
+	perror("renameat");
+	return 2;
+    }
+
+    if (renameat2(dfd, "ATOPS.renameat.X", dfd, "ATOPS.renameat2.X",
+		  RENAME_NOREPLACE)) {
+	perror("renameat2");
+	return 2;
+    }
+
+    if (syscall(SYS_renameat2, dfd, "ATOPS.renameat2.X",
+		dfd, "ATOPS.syscall.X", 0)) {
+	perror("syscall(renameat2)");
+	return 2;
+    }
+
+    close(dfd);
+    return 0;
+}
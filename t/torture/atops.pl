@@ -0,0 +1,37 @@
+# Checks that file accesses made through openat2(), renameat(),
+# renameat2() and syscall() are audited, with paths relative to a
+# directory descriptor resolved. See atcalls.c for the sequence.
+# Since each rename moves a file made within the same command, the
+# chain should coalesce to a single rename op on the final name;
+# any hop which went unaudited would leave an intermediate behind.
+# Note that "ao" must be on PATH and atcalls must be built.
+
+my $prog = './atcalls';
+my $dir = 'ATOPS.dir.X';
+my $ofile = 'ATOPS.out.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+unlink($ofile, glob("$dir/*"));
+rmdir($dir);
+mkdir($dir) || die "$dir: $!";
+
+system(qw(ao -q -o), $ofile, 'run', $prog, $dir) == 0
+    || die "$0: $prog failed\n";
+
+my %seen;
+open(OUT, $ofile) || die "$ofile: $!";
+while (<OUT>) {
+    next unless m%^([CMU]),(\w+),.*[,/]\Q$dir\E/(ATOPS\.\w+\.X)$%;
+    $seen{"$1 $3"} = $2;
+}
+close(OUT);
+
+my @want = ('M ATOPS.syscall.X');
+my @missing = grep { !exists $seen{$_} } @want;
+die "$0: not recorded: @missing\n" if @missing;
+my @extra = grep { my $w = $_; !grep { $_ eq $w } @want } sort keys %seen;
+die "$0: left behind: @extra\n" if @extra;
+
+unlink($ofile, glob("$dir/*"));
+rmdir($dir);
@@ -0,0 +1,43 @@
+# Times the auditing of a single command which writes several large
+# files, as a link step writing a binary and its debug info does,
+# with the outputs dcoded one after another and by the monitor's
+# hashing threads (Dcode.Workers). The records written must be the
+# same either way.
+# Usage: perl dcode-bench.pl [-iterations N] [-files N] [-mb N]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+
+my %opt = bench_options({iterations => 3, files => 4, mb => 256});
+
+my $ofile = 'DCODE.out.X';
+my @outs = map { "DCODE.$_.X" } 1 .. $opt{files};
+my %modes = bench_modes($ofile);
+
+# Distinct contents, the same from one run to the next.
+my $script = join('; ', map {
+    "head -c ${\($opt{mb} * 1024 * 1024)} /dev/zero | tr '\\0' '$_'" .
+	" > $outs[$_ - 1]"
+} 1 .. $opt{files});
+
+my %records;
+for my $workers (0, 4) {
+    local $ENV{AO_DCODE_WORKERS} = $workers;
+    my $td = bench_time($opt{iterations}, sub {
+	unlink($ofile, @outs);
+	system(@{$modes{audited}}, '/bin/sh', '-c', $script) == 0
+	    || die "$0: ao run failed\n";
+    });
+    open(OFILE, $ofile) || die "$ofile: $!";
+    $records{$workers} = join('', map { /^C,.*?(,\w+,,DCODE\.\d+\.X)$/ } <OFILE>);
+    close(OFILE);
+    printf "Dcode.Workers=%d %d x %d MB %8.3f s/cmd %s\n",
+	$workers, $opt{files}, $opt{mb},
+	$td->real / $opt{iterations}, timestr($td);
+}
+
+$records{0} || die "$0: no records of the outputs\n";
+$records{0} eq $records{4} || die "$0: records differ between modes\n";
+
+unlink($ofile, @outs);
@@ -0,0 +1,93 @@
+// gcc -o envcalls envcalls.c
+
+// Execs a copy of itself with environ after each of several ways of
+// changing the environment, so that envops.pl can check that every
+// child sees the change. Each child prints the value of FOO, or
+// "(unset)". The changes are, in order: none; an entry of environ
+// replaced in place; putenv(); the string passed to putenv()
+// modified; and clearenv() followed by setenv(). The LD_* settings are
+// put back after the clearenv() so the last child is audited too.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static int
+run(const char *self)
+{
+    char *cargv[] = {(char *)self, "-child", NULL};
+    pid_t pid;
+    int wstat;
+
+    fflush(stdout);
+    if ((pid = fork()) == -1) {
+	perror("fork");
+	return 2;
+    } else if (pid == 0) {
+	execve(self, cargv, environ);
+	perror(self);
+	_exit(2);
+    }
+    if (waitpid(pid, &wstat, 0) == -1) {
+	perror("waitpid");
+	return 2;
+    }
+    return WIFEXITED(wstat) && !WEXITSTATUS(wstat) ? 0 : 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static char putstr[] = "FOO=put";
+    char **ep, *ld[16];
+    int i, n;
+    int rc;
+
+    if (argc == 2 && !strcmp(argv[1], "-child")) {
+	printf("%s\n", getenv("FOO") ? getenv("FOO") : "(unset)");
+	return 0;
+    } else if (argc != 1) {
+	fprintf(stderr, "Usage: %s\n", argv[0]);
+	return 2;
+    }
+
+    setenv("FOO", "orig", 1);
+    if ((rc = run(argv[0]))) {
+	return rc;
+    }
+
+    for (ep = environ; *ep; ep++) {
+	if (!strncmp(*ep, "FOO=", 4)) {
+	    *ep = "FOO=changed";
+	}
+    }
+    if ((rc = run(argv[0]))) {
+	return rc;
+    }
+
+    putenv(putstr);
+    if ((rc = run(argv[0]))) {
+	return rc;
+    }
+    strcpy(putstr, "FOO=mod");
+    if ((rc = run(argv[0]))) {
+	return rc;
+    }
+
+    for (ep = environ, n = 0; *ep && n < 16; ep++) {
+	if (!strncmp(*ep, "LD_", 3)) {
+	    ld[n++] = strdup(*ep);
+	}
+    }
+    clearenv();
+    for (i = 0; i < n; i++) {
+	putenv(ld[i]);
+    }
+    setenv("FOO", "cleared", 1);
+    return run(argv[0]);
+}
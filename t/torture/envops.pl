@@ -0,0 +1,19 @@
+# Checks that a program which changes its environment and then execs
+# with environ passes on each change, however it was made. See
+# envcalls.c for the sequence.
+# Note that "ao" must be on PATH and envcalls must be built.
+
+my $prog = './envcalls';
+my $ofile = 'ENV.out.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+unlink($ofile);
+
+my @want = qw(orig changed put mod cleared);
+my @got = map { chomp; $_ } qx(ao -q -o $ofile run $prog);
+$? == 0 || die "$0: $prog failed\n";
+
+"@got" eq "@want" || die "$0: children saw '@got', not '@want'\n";
+
+unlink($ofile);
@@ -0,0 +1,44 @@
+# Measures how long an audited process with a large resident set
+# takes to exit. This is mostly a matter of how the auditor learns
+# the exit status, which once required forking the whole process.
+# It's measured with the auditor activated both by default and by
+# request (Activation.Prog.RE), since these have historically taken
+# different exit paths, and once unaudited for reference.
+# Note that exitlatency must be built.
+# Usage: perl exitlatency-bench.pl [-iterations N] [-megabytes N]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+use Time::HiRes qw(gettimeofday);
+
+my %opt = bench_options({iterations => 5, megabytes => 2048});
+
+my $prog = './exitlatency';
+my $stamp = 'EXITLATENCY.X';
+my $ofile = 'EXITLATENCY.out.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+my %modes = bench_modes($ofile);
+$modes{'by-default'} = $modes{'by-request'} = delete $modes{audited};
+
+for my $mode (qw(unaudited by-default by-request)) {
+    local $ENV{AO_ACTIVATION_PROG_RE} = 'exitlatency'
+	if $mode eq 'by-request';
+    my $total = 0;
+    for (1 .. $opt{iterations}) {
+	unlink($stamp, $ofile);
+	system(@{$modes{$mode}}, $prog, $opt{megabytes}, $stamp) == 0
+	    || die "$0: $prog failed\n";
+	my ($s, $us) = gettimeofday;
+	open(STAMP, $stamp) || die "$stamp: $!";
+	chomp(my $then = <STAMP>);
+	close(STAMP);
+	$total += ($s * 1000000 + $us) - $then;
+    }
+    printf "%-10s %6d MB %9.3f ms/exit\n",
+	$mode, $opt{megabytes}, $total / $opt{iterations} / 1000;
+}
+
+unlink($stamp, $ofile);
@@ -0,0 +1,42 @@
+// gcc -o exitlatency exitlatency.c
+
+// Grows to the given number of megabytes of resident memory, then
+// writes the time (in microseconds) to the file named by the second
+// arg and returns from main. The difference between that time and
+// when the parent sees the process end is the cost of exiting.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+int
+main(int argc, char *argv[])
+{
+    FILE *fp;
+    char *mem;
+    size_t size;
+    struct timeval tv;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: %s megabytes stampfile\n", argv[0]);
+	return 2;
+    }
+
+    size = (size_t)atol(argv[1]) << 20;
+    if (!(mem = malloc(size))) {
+	perror("malloc");
+	return 2;
+    }
+    memset(mem, 'X', size);
+
+    if (!(fp = fopen(argv[2], "w"))) {
+	perror(argv[2]);
+	return 2;
+    }
+    gettimeofday(&tv, NULL);
+    fprintf(fp, "%ld%06ld\n", (long)tv.tv_sec, (long)tv.tv_usec);
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+# Compares the per-process cost of auditing under the two ways an
+# auditor can talk to the monitor: a fresh connection for each
+# message (the default) and a single connection held open from SOA
+# to EOA (Monitor.Persistent). Each mode runs fastprocs.pl under ao
+# a number of times and the wall time is divided by the number of
+# commands audited.
+# Usage: perl fastprocs-bench.pl [-iterations N] [program ...]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+
+my %opt = bench_options({iterations => 5}, '[prog ...]');
+
+my @progs = @ARGV ? @ARGV : qw(ls cat cp mv rm sh make perl cc ld);
+my $ofile = 'FASTPROCS.X';
+my %modes = bench_modes($ofile);
+
+# Each command gets its own record so they can be counted.
+$ENV{AO_AGGREGATION_STYLE} = '-';
+
+for my $mode (qw(false true)) {
+    local $ENV{AO_MONITOR_PERSISTENT} = $mode;
+    my $cmds = 0;
+    my $td = bench_time($opt{iterations}, sub {
+	unlink($ofile);
+	system(@{$modes{audited}}, $^X, 'fastprocs.pl', @progs) == 0
+	    || die "$0: ao run failed\n";
+	open(OFILE, $ofile) || die "$ofile: $!";
+	$cmds += grep { /^\d/ } <OFILE>;
+	close(OFILE);
+    });
+    printf "Monitor.Persistent=%-5s %5d cmds %8.3f ms/cmd %s\n",
+	$mode, $cmds, $cmds ? $td->real * 1000 / $cmds : 0, timestr($td);
+}
+
+unlink($ofile);
@@ -0,0 +1,101 @@
+// gcc -o manyconns manyconns.c
+
+// Runs N copies of itself at once, each of which creates a file
+// MANYCONNS.<n>.X and then holds on until all N are running. Each
+// copy is exec-ed and is thus a command in its own right, so under
+// "ao" with Monitor.Persistent the monitor has N auditor connections
+// open at the same time. Exits nonzero if any copy fails.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int
+child(int n, int holdfd, int readyfd)
+{
+    char path[64], junk;
+    int fd;
+
+    snprintf(path, sizeof(path), "MANYCONNS.%d.X", n);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+	perror(path);
+	return 2;
+    }
+    if (write(fd, path, strlen(path)) == -1) {
+	perror(path);
+	return 2;
+    }
+    close(fd);
+
+    // Say we're here, then wait for the parent to let go.
+    if (write(readyfd, "x", 1) != 1) {
+	perror("write");
+	return 2;
+    }
+    close(readyfd);
+    while (read(holdfd, &junk, 1) > 0);
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int hold[2], ready[2], count, started, i, wstat, rc = 0;
+    char nbuf[16], hbuf[16], rbuf[16], junk;
+
+    if (argc == 5 && !strcmp(argv[1], "-child")) {
+	return child(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+    } else if (argc != 2 || (count = atoi(argv[1])) <= 0) {
+	fprintf(stderr, "Usage: %s count\n", argv[0]);
+	return 2;
+    }
+
+    if (pipe(hold) == -1 || pipe(ready) == -1) {
+	perror("pipe");
+	return 2;
+    }
+
+    snprintf(hbuf, sizeof(hbuf), "%d", hold[0]);
+    snprintf(rbuf, sizeof(rbuf), "%d", ready[1]);
+
+    for (i = 0; i < count; i++) {
+	switch (fork()) {
+	case -1:
+	    perror("fork");
+	    return 2;
+	case 0:
+	    close(hold[1]);
+	    close(ready[0]);
+	    snprintf(nbuf, sizeof(nbuf), "%d", i);
+	    execl(argv[0], argv[0], "-child", nbuf, hbuf, rbuf, (char *)NULL);
+	    perror(argv[0]);
+	    _exit(2);
+	}
+    }
+    close(hold[0]);
+    close(ready[1]);
+
+    // Every copy is running once all have checked in.
+    for (started = 0; started < count && read(ready[0], &junk, 1) == 1;) {
+	started++;
+    }
+    close(ready[0]);
+    close(hold[1]);
+
+    while (wait(&wstat) != -1) {
+	if (!WIFEXITED(wstat) || WEXITSTATUS(wstat)) {
+	    rc = 1;
+	}
+    }
+
+    if (started != count) {
+	fprintf(stderr, "%s: only %d of %d started\n", argv[0], started, count);
+	rc = 1;
+    }
+
+    return rc;
+}
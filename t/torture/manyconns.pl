@@ -0,0 +1,30 @@
+# A load test for the monitor. Runs N audited commands at once, each
+# holding its persistent connection to the monitor open until all N
+# are running (see manyconns.c), so the monitor must juggle N live
+# connections. Every file the commands created must be reported.
+# Note that "ao" must be on PATH and manyconns must be built.
+# Usage: perl manyconns.pl [-count N]
+
+use Getopt::Long;
+
+my %opt = (count => 2000);
+GetOptions(\%opt, qw(count=i)) || die "Usage: $0 [-c N]\n";
+
+my $prog = './manyconns';
+my $ofile = 'MANYCONNS.out.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+unlink($ofile, glob('MANYCONNS.*.X'));
+
+$ENV{AO_MONITOR_PERSISTENT} = 1;
+system(qw(ao -q -o), $ofile, 'run', $prog, $opt{count}) == 0
+    || die "$0: $prog failed\n";
+
+open(OFILE, $ofile) || die "$ofile: $!";
+my %seen = map { $_ => 1 } map { /^C,.*(MANYCONNS\.\d+\.X)$/ } <OFILE>;
+close(OFILE);
+keys(%seen) == $opt{count}
+    || die "$0: audited ", scalar(keys %seen), " of $opt{count} files\n";
+
+unlink($ofile, glob('MANYCONNS.*.X'));
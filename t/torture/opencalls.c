@@ -0,0 +1,44 @@
+// gcc -o opencalls opencalls.c
+
+// Opens a file for writing the given number of times, closing it
+// each time, then prints its own peak RSS in kilobytes. Under the
+// auditor every open is recorded, so this shows whether the records
+// of a long-running process are delivered as it goes (see the
+// Audit.Flush.Count property) or pile up until it exits.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+int
+main(int argc, char *argv[])
+{
+    struct rusage ru;
+    long count, i;
+    int fd;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: %s count file\n", argv[0]);
+	return 2;
+    }
+
+    count = strtol(argv[1], NULL, 0);
+
+    for (i = 0; i < count; i++) {
+	if ((fd = open(argv[2], O_WRONLY | O_CREAT, 0644)) == -1) {
+	    perror(argv[2]);
+	    return 2;
+	}
+	close(fd);
+    }
+
+    if (getrusage(RUSAGE_SELF, &ru)) {
+	perror("getrusage");
+	return 2;
+    }
+    printf("%ld\n", ru.ru_maxrss);
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+# Checks that a long-running command which records a great many
+# file accesses doesn't hold them all until it exits. See
+# opencalls.c; with the default Audit.Flush.Count its peak RSS
+# stays small however many opens it does.
+# Note that "ao" must be on PATH and opencalls must be built.
+# Usage: perl openops.pl [-count N] [-maxrss KB]
+
+use Getopt::Long;
+
+my %opt = (count => 1000000, maxrss => 65536);
+GetOptions(\%opt, qw(count=i maxrss=i))
+    || die "Usage: $0 [-c N] [-m KB]\n";
+
+my $prog = './opencalls';
+my $ofile = 'OPENCALLS.out.X';
+my $tfile = 'OPENCALLS.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+unlink($ofile, $tfile);
+
+my $rss = qx(ao -q -o $ofile run $prog $opt{count} $tfile);
+$? == 0 || die "$0: $prog failed\n";
+chomp($rss);
+
+$rss <= $opt{maxrss}
+    || die "$0: peak RSS was $rss KB after $opt{count} opens\n";
+
+unlink($ofile, $tfile);
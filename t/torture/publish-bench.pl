@@ -0,0 +1,49 @@
+# Times a parallel make whose every command writes a sizable output,
+# with finished audits published by the monitor itself and by its
+# pool of publishing threads (Publish.Workers). Dcoding the outputs
+# is the bulk of publishing, so under a high -j the monitor's own
+# thread becomes the critical path when it has to do it all.
+# The records written must be the same either way.
+# Note that "make" must be on PATH.
+# Usage: perl publish-bench.pl [-iterations N] [-jobs N] [-targets N] [-kb N]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+
+my %opt = bench_options({iterations => 3, jobs => 64, targets => 256, kb => 4096});
+
+my $mfile = 'PUBLISH.mk.X';
+my $ofile = 'PUBLISH.out.X';
+my %modes = bench_modes($ofile);
+
+open(MF, '>', $mfile) || die "$mfile: $!";
+my @tgts = map { "PUBLISH.$_.X" } 1 .. $opt{targets};
+print MF "all: @tgts\n";
+print MF "PUBLISH.%.X:\n\tdd if=/dev/zero of=\$@ bs=1024 count=$opt{kb} 2>/dev/null\n";
+close(MF);
+
+# Each command gets its own record.
+$ENV{AO_AGGREGATION_STYLE} = '-';
+
+my %records;
+for my $workers (0, 4) {
+    local $ENV{AO_PUBLISH_WORKERS} = $workers;
+    my $td = bench_time($opt{iterations}, sub {
+	unlink($ofile, @tgts);
+	system(@{$modes{audited}},
+	       'make', '-s', "-j$opt{jobs}", '-f', $mfile) == 0
+	    || die "$0: ao run failed\n";
+    });
+    open(OFILE, $ofile) || die "$ofile: $!";
+    $records{$workers} = join('', sort map { /^C,.*?(,\w+,,PUBLISH\.\d+\.X)$/ } <OFILE>);
+    close(OFILE);
+    printf "Publish.Workers=%d %4d targets -j%-3d %8.3f s/build %s\n",
+	$workers, $opt{targets}, $opt{jobs},
+	$td->real / $opt{iterations}, timestr($td);
+}
+
+$records{0} || die "$0: no records of the targets\n";
+$records{0} eq $records{4} || die "$0: records differ between modes\n";
+
+unlink($mfile, $ofile, @tgts);
@@ -0,0 +1,59 @@
+# Measures what a large audit group costs the commands around it.
+# A shell (and thus a strong group) runs N commands and then holds
+# on, keeping all N live in the monitor, while a stream of M other
+# commands runs on its own, each published as it finishes. The time
+# per command of that stream is reported with and without the group.
+# Retiring published CAs should cost the same either way rather than
+# growing with the number of CAs the monitor is holding.
+# The default group is slow to build.
+# Usage: perl retire-bench.pl [-count N] [-cmds M]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+use Time::HiRes qw(time sleep);
+
+my %opt = bench_options({count => 100000, cmds => 2000}, '', 'inner');
+
+my $ready = 'RETIRE.ready.X';
+my $done = 'RETIRE.done.X';
+my $tfile = 'RETIRE.time.X';
+
+if ($opt{inner}) {
+    my $pid = fork();
+    die "$0: fork: $!\n" unless defined $pid;
+    if (!$pid) {
+	exec('/bin/sh', '-c', "i=0; while [ \$i -lt $opt{count} ];" .
+	     " do /bin/true; i=\$((i+1)); done; : > $ready;" .
+	     " while [ ! -f $done ]; do sleep 1; done");
+	die "$0: /bin/sh: $!\n";
+    }
+    sleep(0.1) until -f $ready;
+    my $t0 = time();
+    for (1 .. $opt{cmds}) {
+	system('/bin/true') == 0 || die "$0: /bin/true failed\n";
+    }
+    my $elapsed = time() - $t0;
+    open(DONE, '>', $done) && close(DONE);
+    waitpid($pid, 0);
+    open(TFILE, '>', $tfile) || die "$tfile: $!";
+    print TFILE "$elapsed\n";
+    close(TFILE);
+    exit(0);
+}
+
+my %modes = bench_modes('/dev/null');
+
+for my $count (0, $opt{count}) {
+    unlink($ready, $done, $tfile);
+    system(@{$modes{audited}}, $^X, $0, '-inner',
+	   '-count', $count, '-cmds', $opt{cmds}) == 0
+	|| die "$0: ao run failed\n";
+    open(TFILE, $tfile) || die "$tfile: $!";
+    chomp(my $elapsed = <TFILE>);
+    close(TFILE);
+    printf "%6d cmds in group %5d cmds alongside %8.3f ms/cmd\n",
+	$count, $opt{cmds}, $elapsed * 1000 / $opt{cmds};
+}
+
+unlink($ready, $done, $tfile);
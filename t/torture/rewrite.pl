@@ -0,0 +1,63 @@
+# Checks that a file which is read and then replaced before the
+# reading process exits is recorded as it was when read. An audited
+# process opens and reads the file, then waits while we rename a
+# larger one over it. The file is kept out of the project so it's
+# sampled by the auditor rather than dcoded later by the monitor.
+# Note that "ao" must be on PATH.
+
+use Cwd;
+
+my $base = 'REWRITE.base.X';
+my $path = 'REWRITE.X';
+my $ready = 'REWRITE.ready.X';
+my $go = 'REWRITE.go.X';
+my $ofile = 'REWRITE.out.X';
+my $orig = "ORIGINAL CONTENTS\n";
+
+unlink($path, $ready, $go, $ofile);
+mkdir($base);
+
+open(ORIG, ">$path") || die "$path: $!";
+print ORIG $orig;
+close(ORIG);
+
+my $reader = qq(
+    open(F, '<$path') || die; \$_ = <F>;
+    open(R, '>$ready') || die; close(R);
+    select(undef, undef, undef, 0.05) until -e '$go';
+);
+
+$ENV{AO_BASE_DIR} = getcwd() . "/$base";
+my $pid = fork;
+defined($pid) || die "$0: fork: $!";
+if (!$pid) {
+    exec(qw(ao -q -o), $ofile, 'run', $^X, '-e', $reader);
+    die "$0: ao: $!";
+}
+
+select(undef, undef, undef, 0.05) until -e $ready;
+open(NEW, ">$path.new") || die "$path.new: $!";
+print NEW 'REPLACEMENT ' x 10, "\n";
+close(NEW);
+rename("$path.new", $path) || die "$path: $!";
+open(GO, ">$go") || die "$go: $!";
+close(GO);
+
+waitpid($pid, 0);
+$? == 0 || die "$0: audited reader failed\n";
+
+my $size;
+open(OUT, $ofile) || die "$ofile: $!";
+while (<OUT>) {
+    next unless m%^R,.*/\Q$path\E$%;
+    chomp;
+    $size = (split ',')[12];
+}
+close(OUT);
+
+defined($size) || die "$0: no read of $path recorded\n";
+$size == length($orig) ||
+    die "$0: $path recorded with size $size, not ", length($orig), "\n";
+
+unlink($path, $ready, $go, $ofile);
+rmdir($base);
@@ -0,0 +1,67 @@
+// gcc -o spawncalls spawncalls.c
+
+// Starts commands through posix_spawn() and posix_spawnp() so that
+// spawnops.pl can check that each is audited as a child of this one.
+// It spawns a copy of itself via posix_spawn(), which creates
+// SPAWN.posix_spawn.X, and "touch" via posix_spawnp(), which must
+// find it on PATH, to create SPAWN.posix_spawnp.X.
+
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static int
+reap(pid_t pid, const char *what)
+{
+    int wstat;
+
+    if (waitpid(pid, &wstat, 0) == -1) {
+	perror("waitpid");
+	return 2;
+    }
+    if (!WIFEXITED(wstat) || WEXITSTATUS(wstat)) {
+	fprintf(stderr, "%s: child failed\n", what);
+	return 1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *sargv[] = {argv[0], "-child", "SPAWN.posix_spawn.X", NULL};
+    char *pargv[] = {"touch", "SPAWN.posix_spawnp.X", NULL};
+    pid_t pid;
+    int fd, err, rc;
+
+    if (argc == 3 && !strcmp(argv[1], "-child")) {
+	if ((fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+	    perror(argv[2]);
+	    return 2;
+	}
+	close(fd);
+	return 0;
+    } else if (argc != 1) {
+	fprintf(stderr, "Usage: %s\n", argv[0]);
+	return 2;
+    }
+
+    if ((err = posix_spawn(&pid, argv[0], NULL, NULL, sargv, environ))) {
+	fprintf(stderr, "posix_spawn: %s\n", strerror(err));
+	return 2;
+    }
+    if ((rc = reap(pid, "posix_spawn"))) {
+	return rc;
+    }
+
+    if ((err = posix_spawnp(&pid, "touch", NULL, NULL, pargv, environ))) {
+	fprintf(stderr, "posix_spawnp: %s\n", strerror(err));
+	return 2;
+    }
+    return reap(pid, "posix_spawnp");
+}
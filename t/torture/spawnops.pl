@@ -0,0 +1,44 @@
+# Checks that commands started through posix_spawn() and posix_spawnp()
+# are audited, each in a record of its own whose parent is the
+# command which spawned it. See spawncalls.c for the sequence.
+# Note that "ao" must be on PATH and spawncalls must be built.
+
+my $prog = './spawncalls';
+my $ofile = 'SPAWN.out.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+unlink($ofile, glob('SPAWN.*.X'));
+
+# Each cmd gets its own record.
+$ENV{AO_AGGREGATION_STYLE} = '-';
+system(qw(ao -q -o), $ofile, 'run', $prog) == 0
+    || die "$0: $prog failed\n";
+
+# Note the cmdid and parent cmdid heading each record, along with
+# which of the files, if any, the record shows being created.
+my (%cmdid, %pcmdid, $hdr);
+open(OUT, $ofile) || die "$ofile: $!";
+while (<OUT>) {
+    chomp;
+    if (/^(\d+),\d+,(\d+),.*,(.*)$/) {
+	$hdr = [$1, $2, $3];
+	$cmdid{spawncalls} = $1 if $3 eq $prog;
+    } elsif ($hdr && /^C,.*\b(SPAWN\.\w+\.X)$/) {
+	$cmdid{$1} = $hdr->[0];
+	$pcmdid{$1} = $hdr->[1];
+    }
+}
+close(OUT);
+
+$cmdid{spawncalls} || die "$0: $prog not recorded\n";
+for my $file (qw(SPAWN.posix_spawn.X SPAWN.posix_spawnp.X)) {
+    exists $pcmdid{$file} || die "$0: $file not recorded\n";
+    $cmdid{$file} != $cmdid{spawncalls}
+	|| die "$0: $file recorded as made by $prog itself\n";
+    $pcmdid{$file} == $cmdid{spawncalls}
+	|| die "$0: $file recorded with parent $pcmdid{$file},",
+	    " not $cmdid{spawncalls}\n";
+}
+
+unlink($ofile, glob('SPAWN.*.X'));
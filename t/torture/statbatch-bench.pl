@@ -0,0 +1,64 @@
+# Compares the two ways the auditor can stat the non-member reads of
+# a CA at flush time: one lstat after another, or all at once through
+# an io_uring (see ps_stat_batch). A synthetic include tree of N
+# headers spread over many directories is generated and its paths are
+# statted both ways. The dentry and inode caches are dropped before
+# each run when we have the privilege to do so; otherwise the numbers
+# are for a warm cache and a warning says so. The ring only pays for
+# its per-stat worker handoff when lookups are slow, which is why
+# Stat.Uring is off by default; this shows where the crossover lies.
+# Note that statbatch must be built.
+# Usage: perl statbatch-bench.pl [-iterations N] [-headers N] [-dirs N]
+
+use File::Path qw(mkpath rmtree);
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+
+my %opt = bench_options({iterations => 5, headers => 2000, dirs => 40});
+
+my $prog = './statbatch';
+my $tree = 'STATBATCH.X';
+my $list = 'STATBATCH.list.X';
+my $drop = '/proc/sys/vm/drop_caches';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+rmtree($tree);
+open(LIST, '>', $list) || die "$list: $!";
+for my $i (0 .. $opt{headers} - 1) {
+    my $dir = sprintf("$tree/inc%02d/sys", $i % $opt{dirs});
+    mkpath($dir) unless -d $dir;
+    my $hdr = "$dir/h$i.h";
+    open(HDR, '>', $hdr) || die "$hdr: $!";
+    print HDR "#define H$i $i\n";
+    close(HDR);
+    print LIST "$hdr\n";
+}
+close(LIST);
+
+my $cold = -w $drop;
+warn "$0: cannot write $drop, timing a warm cache only\n" unless $cold;
+
+for my $mode (qw(serial uring)) {
+    my $total = 0;
+    for (1 .. $opt{iterations}) {
+	if ($cold) {
+	    system('sync');
+	    open(DROP, '>', $drop) || die "$drop: $!";
+	    print DROP "2\n";
+	    close(DROP);
+	}
+	chomp(my $out = `$prog $mode < $list`);
+	die "$0: $prog $mode failed\n" if $? || !$out;
+	my($us, $count, $missing) = split ' ', $out;
+	die "$0: $missing of $count headers not found\n" if $missing;
+	$total += $us;
+    }
+    printf "%-6s %6d headers %9.3f ms/flush (%s)\n",
+	$mode, $opt{headers}, $total / $opt{iterations} / 1000,
+	$cold ? 'cold' : 'warm';
+}
+
+rmtree($tree);
+unlink($list);
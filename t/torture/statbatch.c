@@ -0,0 +1,155 @@
+// gcc -o statbatch statbatch.c
+
+// Stats each of the files named on stdin, either one lstat at a time
+// or all together through an io_uring as ps_stat_batch() does, and
+// prints the elapsed time in microseconds. Files which do not exist
+// are counted but not treated as errors.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/io_uring.h>
+
+#define ENTRIES	256
+
+static int
+uring_stat(char **paths, int count)
+{
+    struct io_uring_params p;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    struct statx *stxs;
+    unsigned char *sq, *cq;
+    unsigned *sqtail, *sqarray, *cqhead, *cqtail, sqmask, cqmask;
+    int fd, done, i, missing = 0;
+
+    memset(&p, 0, sizeof(p));
+    if ((fd = (int)syscall(__NR_io_uring_setup, ENTRIES, &p)) < 0) {
+	perror("io_uring_setup");
+	exit(2);
+    }
+    sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+	      PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING);
+    cq = mmap(NULL, p.cq_off.cqes + p.cq_entries * sizeof(*cqes),
+	      PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_CQ_RING);
+    sqes = mmap(NULL, p.sq_entries * sizeof(*sqes),
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+	perror("mmap");
+	exit(2);
+    }
+    sqtail = (unsigned *)(sq + p.sq_off.tail);
+    sqmask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    sqarray = (unsigned *)(sq + p.sq_off.array);
+    cqhead = (unsigned *)(cq + p.cq_off.head);
+    cqtail = (unsigned *)(cq + p.cq_off.tail);
+    cqmask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    stxs = calloc(count, sizeof(*stxs));
+
+    for (done = 0; done < count;) {
+	unsigned tail, head;
+	int chunk, reaped;
+
+	chunk = count - done < (int)p.sq_entries ?
+	    count - done : (int)p.sq_entries;
+	tail = *sqtail;
+	for (i = done; i < done + chunk; i++, tail++) {
+	    struct io_uring_sqe *sqe = &sqes[tail & sqmask];
+
+	    memset(sqe, 0, sizeof(*sqe));
+	    sqe->opcode = IORING_OP_STATX;
+	    sqe->fd = AT_FDCWD;
+	    sqe->addr = (unsigned long)paths[i];
+	    sqe->len = STATX_BASIC_STATS;
+	    sqe->off = (unsigned long)&stxs[i];
+	    sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+	    sqe->user_data = i;
+	    sqarray[tail & sqmask] = tail & sqmask;
+	}
+	__atomic_store_n(sqtail, tail, __ATOMIC_RELEASE);
+
+	for (reaped = 0; reaped < chunk;) {
+	    if (syscall(__NR_io_uring_enter, fd, reaped ? 0 : chunk,
+			chunk - reaped, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+		    && errno != EINTR) {
+		perror("io_uring_enter");
+		exit(2);
+	    }
+	    head = *cqhead;
+	    while (head != __atomic_load_n(cqtail, __ATOMIC_ACQUIRE)) {
+		int res = cqes[head & cqmask].res;
+
+		if (res == -EINVAL) {
+		    fprintf(stderr, "IORING_OP_STATX not supported\n");
+		    exit(2);
+		} else if (res < 0) {
+		    missing++;
+		}
+		head++;
+		reaped++;
+	    }
+	    __atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+	}
+	done += chunk;
+    }
+
+    free(stxs);
+    close(fd);
+    return missing;
+}
+
+static int
+serial_stat(char **paths, int count)
+{
+    struct stat st;
+    int i, missing = 0;
+
+    for (i = 0; i < count; i++) {
+	if (lstat(paths[i], &st)) {
+	    missing++;
+	}
+    }
+    return missing;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char line[4096], **paths = NULL;
+    int count = 0, missing;
+    struct timeval t0, t1;
+
+    if (argc != 2 || (strcmp(argv[1], "serial") && strcmp(argv[1], "uring"))) {
+	fprintf(stderr, "Usage: %s serial|uring < pathlist\n", argv[0]);
+	return 2;
+    }
+
+    while (fgets(line, sizeof(line), stdin)) {
+	line[strcspn(line, "\n")] = '\0';
+	paths = realloc(paths, (count + 1) * sizeof(*paths));
+	paths[count++] = strdup(line);
+    }
+
+    gettimeofday(&t0, NULL);
+    if (!strcmp(argv[1], "uring")) {
+	missing = uring_stat(paths, count);
+    } else {
+	missing = serial_stat(paths, count);
+    }
+    gettimeofday(&t1, NULL);
+
+    printf("%ld %d %d\n",
+	   (long)((t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_usec - t0.tv_usec),
+	   count, missing);
+    return 0;
+}
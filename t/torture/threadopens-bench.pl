@@ -0,0 +1,39 @@
+# Measures how long a threaded program takes to open many files,
+# both unaudited and audited. Each of N threads creates M files and
+# reads them back, so the auditor records 2*N*M opens from N threads
+# at once. The audited run must also report every file it created.
+# Note that threadopens must be built.
+# Usage: perl threadopens-bench.pl [-iterations N] [-threads N] [-files N]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+
+my %opt = bench_options({iterations => 5, threads => 16, files => 500});
+
+my $prog = './threadopens';
+my $ofile = 'THREADOPENS.out.X';
+
+-x $prog || die "$0: $prog: must be built first\n";
+
+my %modes = bench_modes($ofile);
+
+for my $mode (qw(unaudited audited)) {
+    my $td = bench_time($opt{iterations}, sub {
+	unlink($ofile, glob('THREADOPENS.*.*.X'));
+	system(@{$modes{$mode}}, $prog, $opt{threads}, $opt{files}) == 0
+	    || die "$0: $prog failed\n";
+	return unless $mode eq 'audited';
+	open(OFILE, $ofile) || die "$ofile: $!";
+	my %seen = map { $_ => 1 } map { /(THREADOPENS\.\d+\.\d+\.X)/ } <OFILE>;
+	close(OFILE);
+	my $want = $opt{threads} * $opt{files};
+	keys(%seen) == $want
+	    || die "$0: audited ", scalar(keys %seen), " of $want files\n";
+    });
+    printf "%-9s %3d threads x %5d files %9.3f ms/run %s\n",
+	$mode, $opt{threads}, $opt{files},
+	$td->real * 1000 / $opt{iterations}, timestr($td);
+}
+
+unlink($ofile, glob('THREADOPENS.*.*.X'));
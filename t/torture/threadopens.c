@@ -0,0 +1,81 @@
+// gcc -o threadopens threadopens.c -lpthread
+
+// Starts the given number of threads, each of which creates the
+// given number of files in the current directory and then reads
+// them back. The files are named THREADOPENS.<thread>.<file>.X
+// and are left in place for the caller to count and remove.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static long Files;
+
+static void *
+opener(void *arg)
+{
+    long t = (long)arg, f;
+    char path[64], buf[64];
+    int fd;
+
+    for (f = 0; f < Files; f++) {
+	snprintf(path, sizeof(path), "THREADOPENS.%ld.%ld.X", t, f);
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+	    perror(path);
+	    exit(2);
+	}
+	if (write(fd, path, strlen(path)) == -1) {
+	    perror(path);
+	    exit(2);
+	}
+	close(fd);
+    }
+
+    for (f = 0; f < Files; f++) {
+	snprintf(path, sizeof(path), "THREADOPENS.%ld.%ld.X", t, f);
+	if ((fd = open(path, O_RDONLY)) == -1) {
+	    perror(path);
+	    exit(2);
+	}
+	if (read(fd, buf, sizeof(buf)) == -1) {
+	    perror(path);
+	    exit(2);
+	}
+	close(fd);
+    }
+
+    return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+    pthread_t *tids;
+    long threads, t;
+    int rc;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: %s threads files\n", argv[0]);
+	return 2;
+    }
+
+    threads = atol(argv[1]);
+    Files = atol(argv[2]);
+
+    tids = calloc(threads, sizeof(*tids));
+    for (t = 0; t < threads; t++) {
+	if ((rc = pthread_create(&tids[t], NULL, opener, (void *)t))) {
+	    fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+	    return 2;
+	}
+    }
+    for (t = 0; t < threads; t++) {
+	pthread_join(tids[t], NULL);
+    }
+
+    return 0;
+}
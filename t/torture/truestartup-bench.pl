@@ -0,0 +1,34 @@
+# Measures the per-exec cost of auditing a trivial program. A shell
+# loop runs /bin/true many times, once unaudited and once under ao,
+# and the difference is divided by the number of execs. Since
+# /bin/true opens no files of its own this is mostly the cost of
+# initializing the auditor and exchanging SOA and EOA with the
+# monitor.
+# Usage: perl truestartup-bench.pl [-iterations N] [-execs N]
+
+use FindBin;
+use lib $FindBin::Bin;
+use TortureBench;
+
+my %opt = bench_options({iterations => 5, execs => 500});
+
+my $ofile = 'TRUESTARTUP.X';
+my $loop = "i=0; while [ \$i -lt $opt{execs} ]; do /bin/true; i=\$((i+1)); done";
+
+my %modes = bench_modes($ofile);
+
+my %ms;
+for my $mode (qw(unaudited audited)) {
+    my $td = bench_time($opt{iterations}, sub {
+	unlink($ofile);
+	system(@{$modes{$mode}}, '/bin/sh', '-c', $loop) == 0
+	    || die "$0: $mode run failed\n";
+    });
+    $ms{$mode} = $td->real * 1000 / ($opt{iterations} * $opt{execs});
+    printf "%-9s %6d execs %8.3f ms/exec\n",
+	$mode, $opt{execs}, $ms{$mode};
+}
+printf "%-9s %6s       %8.3f ms/exec\n", 'overhead', '',
+    $ms{audited} - $ms{unaudited};
+
+unlink($ofile);